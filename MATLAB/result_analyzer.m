@@ -7,7 +7,7 @@ VALVE__MAX_THRUST=0.36; % [N]
 %% OPEN FILES
 
 control_log = fopen('./logs/control_log.txt','r');
-control_data = textscan(control_log,'%f %f %f %f %f %f %f %f %f %f %f %f %f');
+control_data = textscan(control_log,'%f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f');
 fclose(control_log);
 
 time_control_glob=control_data{1}/1000000; % [s]
@@ -23,9 +23,13 @@ PWM1=control_data{10};
 PWM2=control_data{11};
 PWM3=control_data{12};
 PWM4=control_data{13};
+attitude_epoch=control_data{14}; % filter update the command was computed from
+attitude_time=control_data{15}/1000000; % [s] reception time of the IMU frame behind that update
+allocation_status=control_data{16}; % 0: OK, 2: demand reduced to what the valves can produce, <0: the valves were closed (see allocation_header.h)
+simplex_pivots=control_data{17}; % Simplex pivots of each allocation (simplex allocation mode only)
 %----------------------------------------------------------------------------------------
 imu_log = fopen('./logs/imu_log.txt','r');
-imu_data = textscan(imu_log,'%f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f');
+imu_data = textscan(imu_log,'%f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f %f');
 fclose(imu_log);
 
 % Give loaded data meaningful names
@@ -49,6 +53,7 @@ wz=imu_data{17};
 accelX_save=imu_data{18};
 accelY_save=imu_data{19};
 accelZ_save=imu_data{20};
+latency=imu_data{21}; % [us] time from frame reception to published estimate
 
 start_idx=1;
 end_idx=1;
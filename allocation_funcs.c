@@ -0,0 +1,476 @@
+/**
+ * @file allocation_funcs.c
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Thrust allocation functions file.
+ *
+ * This file contains the functions which distribute the control demand (#Fpitch, #Fyaw, #Mroll) over the four RCS
+ * valves. The thrusts R1, R2, R3, R4 >= 0 are chosen so as to produce exactly the demanded forces and moment with the
+ * least total thrust (i.e. the least gas), given the roll angle phi of the rocket and the valve offset #d :
+ * @verbatim
+   minimize   R1 + R2 + R3 + R4
+   subject to Fpitch = -cos(phi)*R1 + sin(phi)*R2 + cos(phi)*R3 - sin(phi)*R4
+              Fyaw   = -sin(phi)*R1 - cos(phi)*R2 + sin(phi)*R3 + cos(phi)*R4
+              Mroll  = d*(-R1 + R2 - R3 + R4)
+              R1, R2, R3, R4 >= 0
+   @endverbatim
+ * In #ALLOCATION_BOUNDED mode the thrusts are also kept below VALVE__MAX_THRUST, and a demand the valves cannot produce
+ * is reduced to one they can (see Allocate_thrust_bounded()).
+ */
+
+# include <stdio.h>
+# include <math.h>
+# include "master_header.h"
+# include "simplex_header.h"
+# include "allocation_header.h"
+
+/**
+ * @struct Roll_trig
+ * Cosine and sine of one roll angle.
+ */
+struct Roll_trig {
+	double c; ///< Cosine
+	double s; ///< Sine
+};
+
+struct Simplex_context allocation_simplex; ///< Simplex context of the control loop (#ALLOCATION_SIMPLEX mode)
+
+struct Roll_trig roll_trig_table[ALLOCATION_TABLE_SIZE+1]; ///< Cosine and sine of the roll angles k*2*pi/#ALLOCATION_TABLE_SIZE (see Allocation_table_init())
+
+/**
+ * @fn static void split_thrust(double u, double v, double m, double *R1, double *R2, double *R3, double *R4)
+ *
+ * This function computes the least total valve thrusts with R1-R3=u, R2-R4=v and (R1+R3)-(R2+R4)=m (see
+ * Allocate_thrust_closed_form()).
+ *
+ * @param u Difference R1-R3.
+ * @param v Difference R2-R4.
+ * @param m Difference (R1+R3)-(R2+R4), i.e. -Mroll/d.
+ * @param R1 Pointer to the memory holding the R1 valve thrust.
+ * @param R2 Pointer to the memory holding the R2 valve thrust.
+ * @param R3 Pointer to the memory holding the R3 valve thrust.
+ * @param R4 Pointer to the memory holding the R4 valve thrust.
+ */
+static void split_thrust(double u, double v, double m, double *R1, double *R2, double *R3, double *R4) {
+	double b=fmax(fabs(v),fabs(u)-m); // R2+R4
+	double a=b+m; // R1+R3
+
+	*R1=fmax(0.5*(a+u),0.0); // fmax() only removes the -1e-17 rounding errors of the exactly closed valves
+	*R3=fmax(0.5*(a-u),0.0);
+	*R2=fmax(0.5*(b+v),0.0);
+	*R4=fmax(0.5*(b-v),0.0);
+}
+
+/**
+ * @fn int Allocate_thrust(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4)
+ *
+ * This function computes the valve thrusts for a control demand with the method chosen by #ALLOCATION__MODE. Both
+ * #ALLOCATION_SIMPLEX and #ALLOCATION_CLOSED_FORM solve the same problem and give the same thrusts (see
+ * Allocation_self_test()), which are not saturated to VALVE__MAX_THRUST. #ALLOCATION_BOUNDED gives the same thrusts
+ * whenever they are all below VALVE__MAX_THRUST (see Allocation_bounded_self_test()), and #ALLOCATION_TABLE gives the
+ * thrusts of #ALLOCATION_BOUNDED up to the interpolation error (see Allocation_table_self_test()).
+ *
+ * @param Fpitch Demanded pitch force.
+ * @param Fyaw Demanded yaw force.
+ * @param Mroll Demanded roll moment.
+ * @param phi Roll angle of the rocket.
+ * @param R1 Pointer to the memory holding the R1 valve thrust.
+ * @param R2 Pointer to the memory holding the R2 valve thrust.
+ * @param R3 Pointer to the memory holding the R3 valve thrust.
+ * @param R4 Pointer to the memory holding the R4 valve thrust.
+ *
+ * @return #ALLOCATION_OK, #ALLOCATION_SATURATED, or an error status (the thrusts are then all 0).
+ */
+int Allocate_thrust(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4) {
+	if (ALLOCATION__MODE==ALLOCATION_SIMPLEX) {
+		return Allocate_thrust_simplex(Fpitch,Fyaw,Mroll,phi,R1,R2,R3,R4);
+	}
+	if (ALLOCATION__MODE==ALLOCATION_BOUNDED) {
+		return Allocate_thrust_bounded(Fpitch,Fyaw,Mroll,phi,R1,R2,R3,R4);
+	}
+	if (ALLOCATION__MODE==ALLOCATION_TABLE) {
+		return Allocate_thrust_table(Fpitch,Fyaw,Mroll,phi,R1,R2,R3,R4);
+	}
+	return Allocate_thrust_closed_form(Fpitch,Fyaw,Mroll,phi,R1,R2,R3,R4);
+}
+
+/**
+ * @fn int Allocate_thrust_simplex(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4)
+ *
+ * This function solves the allocation problem with the general Simplex method in the context of the control loop
+ * (#allocation_simplex), see Allocate_thrust_simplex_context().
+ *
+ * @param Fpitch Demanded pitch force.
+ * @param Fyaw Demanded yaw force.
+ * @param Mroll Demanded roll moment.
+ * @param phi Roll angle of the rocket.
+ * @param R1 Pointer to the memory holding the R1 valve thrust.
+ * @param R2 Pointer to the memory holding the R2 valve thrust.
+ * @param R3 Pointer to the memory holding the R3 valve thrust.
+ * @param R4 Pointer to the memory holding the R4 valve thrust.
+ *
+ * @return #ALLOCATION_OK, or an error status (the thrusts are then all 0).
+ */
+int Allocate_thrust_simplex(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4) {
+	return Allocate_thrust_simplex_context(&allocation_simplex,Fpitch,Fyaw,Mroll,phi,R1,R2,R3,R4);
+}
+
+/**
+ * @fn int Allocate_thrust_simplex_context(struct Simplex_context *context, double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4)
+ *
+ * This function solves the allocation problem with the general Simplex method : it fills the Simplex table of context
+ * with the cost function and the three equality constraints, then runs Simplex_solve() (which starts from the optimal
+ * basis of the previous problem solved in context). Calls with different contexts may run concurrently.
+ *
+ * @param context The Simplex context (see Simplex_context_init()).
+ * @param Fpitch Demanded pitch force.
+ * @param Fyaw Demanded yaw force.
+ * @param Mroll Demanded roll moment.
+ * @param phi Roll angle of the rocket.
+ * @param R1 Pointer to the memory holding the R1 valve thrust.
+ * @param R2 Pointer to the memory holding the R2 valve thrust.
+ * @param R3 Pointer to the memory holding the R3 valve thrust.
+ * @param R4 Pointer to the memory holding the R4 valve thrust.
+ *
+ * @return #ALLOCATION_OK, or an error status (the thrusts are then all 0).
+ */
+int Allocate_thrust_simplex_context(struct Simplex_context *context, double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4) {
+	REAL (*A)[NMAX] = context->a;
+	double c, s;
+	*R1=0; *R2=0; *R3=0; *R4=0;
+	if (!isfinite(Fpitch) || !isfinite(Fyaw) || !isfinite(Mroll) || !isfinite(phi)) return ALLOCATION_BAD_INPUT;
+	c=cos(phi); s=sin(phi);
+
+	// Create Simplex parameter matrix
+	A[1][1]=0; A[1][2]=-1; A[1][3]=-1; A[1][4]=-1; A[1][5]=-1; // Cost function (negative since we want to minimize), A[1][1] is
+															   // constant term which is zero for cost function
+	// Fpitch equality constraint
+	if (Fpitch>=0) { A[2][1]=Fpitch; A[2][2]=c; A[2][3]=-s; A[2][4]=-c; A[2][5]=s; }
+	else { A[2][1]=-Fpitch; A[2][2]=-c; A[2][3]=s; A[2][4]=c; A[2][5]=-s; }
+	// Fyaw equality constraint
+	if (Fyaw>=0) { A[3][1]=Fyaw; A[3][2]=s; A[3][3]=c; A[3][4]=-s; A[3][5]=-c; }
+	else { A[3][1]=-Fyaw; A[3][2]=-s; A[3][3]=-c; A[3][4]=s; A[3][5]=c; }
+	// Mroll equality constraint
+	if (Mroll>=0) { A[4][1]=Mroll; A[4][2]=d; A[4][3]=-d; A[4][4]=d; A[4][5]=-d; }
+	else { A[4][1]=-Mroll; A[4][2]=-d; A[4][3]=d; A[4][4]=-d; A[4][5]=d; }
+
+	Simplex_solve(context,M,N); // Solve linear optimization problem using the Simplex method
+	if (context->icase==1) return ALLOCATION_UNBOUNDED;
+	if (context->icase!=0) return ALLOCATION_INFEASIBLE;
+	get_simplex_solution(context->icase,context->iposv,context->a,M,N,R1,R2,R3,R4); // Push simplex optimal result into the R1, R2, R3, R4 valve thrust variables
+	return ALLOCATION_OK;
+}
+
+/**
+ * @fn int Allocate_thrust_closed_form(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4)
+ *
+ * This function solves the allocation problem analytically, in constant time and without branches. The pitch and yaw
+ * forces only depend on the differences of opposite valves, u=R1-R3 and v=R2-R4, which are found by rotating
+ * (Fpitch,Fyaw) by -phi :
+ * @verbatim
+   u = -(cos(phi)*Fpitch + sin(phi)*Fyaw)
+   v = sin(phi)*Fpitch - cos(phi)*Fyaw
+   @endverbatim
+ * The roll moment only depends on the sums a=R1+R3 and b=R2+R4, through a-b=-Mroll/d. Since R1,...,R4>=0 requires
+ * a>=|u| and b>=|v|, the least total thrust a+b is reached with b=max(|v|,|u|+Mroll/d) and a=b-Mroll/d; then
+ * R1=(a+u)/2, R3=(a-u)/2, R2=(b+v)/2 and R4=(b-v)/2. This solution always exists and is unique, so it is the one
+ * Allocate_thrust_simplex() finds.
+ *
+ * @param Fpitch Demanded pitch force.
+ * @param Fyaw Demanded yaw force.
+ * @param Mroll Demanded roll moment.
+ * @param phi Roll angle of the rocket.
+ * @param R1 Pointer to the memory holding the R1 valve thrust.
+ * @param R2 Pointer to the memory holding the R2 valve thrust.
+ * @param R3 Pointer to the memory holding the R3 valve thrust.
+ * @param R4 Pointer to the memory holding the R4 valve thrust.
+ *
+ * @return #ALLOCATION_OK, or #ALLOCATION_BAD_INPUT (the thrusts are then all 0).
+ */
+int Allocate_thrust_closed_form(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4) {
+	double c=cos(phi), s=sin(phi);
+	double u=-(c*Fpitch+s*Fyaw); // R1-R3
+	double v=s*Fpitch-c*Fyaw; // R2-R4
+	double m=-Mroll/d; // (R1+R3)-(R2+R4)
+
+	if (!isfinite(u) || !isfinite(v) || !isfinite(m)) {
+		*R1=0; *R2=0; *R3=0; *R4=0;
+		return ALLOCATION_BAD_INPUT;
+	}
+	split_thrust(u,v,m,R1,R2,R3,R4);
+	return ALLOCATION_OK;
+}
+
+/**
+ * @fn static int bounded_thrust(double c, double s, double Fpitch, double Fyaw, double Mroll, double *R1, double *R2, double *R3, double *R4)
+ *
+ * This function is Allocate_thrust_bounded() given the cosine and sine of the roll angle.
+ *
+ * @param c Cosine of the roll angle.
+ * @param s Sine of the roll angle.
+ * @param Fpitch Demanded pitch force.
+ * @param Fyaw Demanded yaw force.
+ * @param Mroll Demanded roll moment.
+ * @param R1 Pointer to the memory holding the R1 valve thrust.
+ * @param R2 Pointer to the memory holding the R2 valve thrust.
+ * @param R3 Pointer to the memory holding the R3 valve thrust.
+ * @param R4 Pointer to the memory holding the R4 valve thrust.
+ *
+ * @return #ALLOCATION_OK, #ALLOCATION_SATURATED or #ALLOCATION_BAD_INPUT.
+ */
+static int bounded_thrust(double c, double s, double Fpitch, double Fyaw, double Mroll, double *R1, double *R2, double *R3, double *R4) {
+	double Rmax=VALVE__MAX_THRUST;
+	double u=-(c*Fpitch+s*Fyaw); // R1-R3
+	double v=s*Fpitch-c*Fyaw; // R2-R4
+	double m=-Mroll/d; // (R1+R3)-(R2+R4)
+	double m_max, scale=1.0;
+	int status=ALLOCATION_OK;
+
+	if (!isfinite(u) || !isfinite(v) || !isfinite(m) || !(Rmax>0)) {
+		*R1=0; *R2=0; *R3=0; *R4=0;
+		return ALLOCATION_BAD_INPUT;
+	}
+
+	if (ALLOCATION__PRIORITY==ALLOCATION_PRIORITY_ROLL) {
+		m_max=2*Rmax; // All four valves on the roll moment
+		if (fabs(m)>m_max) { m=copysign(m_max,m); status=ALLOCATION_SATURATED; }
+		if (fabs(u)*scale>Rmax) scale=Rmax/fabs(u);
+		if (fabs(v)*scale>Rmax) scale=Rmax/fabs(v);
+		if ((fabs(u)+fabs(v))*scale>m_max-fabs(m)) scale=(m_max-fabs(m))/(fabs(u)+fabs(v));
+		if (scale<1.0) { u*=scale; v*=scale; status=ALLOCATION_SATURATED; }
+	} else {
+		if (fabs(u)*scale>Rmax) scale=Rmax/fabs(u);
+		if (fabs(v)*scale>Rmax) scale=Rmax/fabs(v);
+		if (scale<1.0) { u*=scale; v*=scale; status=ALLOCATION_SATURATED; }
+		m_max=fmax(2*Rmax-fabs(u)-fabs(v),0.0); // What the pitch/yaw force leaves for the roll moment
+		if (fabs(m)>m_max) { m=copysign(m_max,m); status=ALLOCATION_SATURATED; }
+	}
+
+	split_thrust(u,v,m,R1,R2,R3,R4);
+	*R1=fmin(*R1,Rmax); // fmin() only removes the rounding errors of the fully opened valves
+	*R2=fmin(*R2,Rmax);
+	*R3=fmin(*R3,Rmax);
+	*R4=fmin(*R4,Rmax);
+	return status;
+}
+
+/**
+ * @fn int Allocate_thrust_bounded(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4)
+ *
+ * This function solves the allocation problem analytically with the additional bounds R1,...,R4<=VALVE__MAX_THRUST=Rmax.
+ * With the notations of Allocate_thrust_closed_form(), the bounds allow a demand if and only if
+ * @verbatim
+   |u| <= Rmax,  |v| <= Rmax  and  |m| <= 2*Rmax - |u| - |v|
+   @endverbatim
+ * and the least total thrust is then the unbounded one, so in that case this function gives the same thrusts as
+ * Allocate_thrust_closed_form(). Otherwise the demand is reduced to one the valves can produce, according to
+ * #ALLOCATION__PRIORITY :
+ * 	- #ALLOCATION_PRIORITY_ROLL : m is clipped to [-2*Rmax,2*Rmax], then (u,v) is scaled down to fit in what is left
+ * 	- #ALLOCATION_PRIORITY_PITCH_YAW : (u,v) is scaled down to fit |u|,|v|<=Rmax, then m is clipped to what is left
+ *
+ * Scaling (u,v) keeps the direction of the pitch/yaw force, so the rocket is still pushed towards its reference
+ * attitude, only more slowly. There is no iteration : the worst case costs the same few operations as the best case.
+ *
+ * @param Fpitch Demanded pitch force.
+ * @param Fyaw Demanded yaw force.
+ * @param Mroll Demanded roll moment.
+ * @param phi Roll angle of the rocket.
+ * @param R1 Pointer to the memory holding the R1 valve thrust.
+ * @param R2 Pointer to the memory holding the R2 valve thrust.
+ * @param R3 Pointer to the memory holding the R3 valve thrust.
+ * @param R4 Pointer to the memory holding the R4 valve thrust.
+ *
+ * @return #ALLOCATION_OK, #ALLOCATION_SATURATED if the demand was reduced, or #ALLOCATION_BAD_INPUT (the thrusts are
+ * then all 0).
+ */
+int Allocate_thrust_bounded(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4) {
+	return bounded_thrust(cos(phi),sin(phi),Fpitch,Fyaw,Mroll,R1,R2,R3,R4);
+}
+
+/**
+ * @fn void Allocation_table_init(void)
+ *
+ * This function fills #roll_trig_table with the cosine and sine of #ALLOCATION_TABLE_SIZE roll angles evenly spread
+ * over one turn (plus a copy of the first one at the end, so that interpolation never wraps). It must be called
+ * before Allocate_thrust_table() is.
+ */
+void Allocation_table_init(void) {
+	unsigned int k;
+	for (k=0;k<=ALLOCATION_TABLE_SIZE;k++) {
+		roll_trig_table[k].c = cos(k*(2*M_PI/ALLOCATION_TABLE_SIZE));
+		roll_trig_table[k].s = sin(k*(2*M_PI/ALLOCATION_TABLE_SIZE));
+	}
+}
+
+/**
+ * @fn int Allocate_thrust_table(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4)
+ *
+ * This function is Allocate_thrust_bounded() with the cosine and sine of the roll angle linearly interpolated in
+ * #roll_trig_table instead of computed : the roll angle is the only geometry that changes in flight, while the demand
+ * enters the solution linearly and is used exactly. The roll angle may be any number of turns away from 0 (it is not
+ * wrapped by the IMU filter).
+ *
+ * @param Fpitch Demanded pitch force.
+ * @param Fyaw Demanded yaw force.
+ * @param Mroll Demanded roll moment.
+ * @param phi Roll angle of the rocket.
+ * @param R1 Pointer to the memory holding the R1 valve thrust.
+ * @param R2 Pointer to the memory holding the R2 valve thrust.
+ * @param R3 Pointer to the memory holding the R3 valve thrust.
+ * @param R4 Pointer to the memory holding the R4 valve thrust.
+ *
+ * @return #ALLOCATION_OK, #ALLOCATION_SATURATED if the demand was reduced, or #ALLOCATION_BAD_INPUT (the thrusts are
+ * then all 0).
+ */
+int Allocate_thrust_table(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4) {
+	double x=phi*(ALLOCATION_TABLE_SIZE/(2*M_PI)); // Roll angle in table steps
+	double x_floor, fraction;
+	const struct Roll_trig *below;
+
+	if (!(fabs(x)<1e9)) { // Also true for NaN, keeps the conversion to an index defined
+		*R1=0; *R2=0; *R3=0; *R4=0;
+		return ALLOCATION_BAD_INPUT;
+	}
+	x_floor=floor(x);
+	fraction=x-x_floor;
+	below=&roll_trig_table[(long int)x_floor & (ALLOCATION_TABLE_SIZE-1)];
+	return bounded_thrust(below->c+fraction*(below[1].c-below->c),below->s+fraction*(below[1].s-below->s),Fpitch,Fyaw,Mroll,R1,R2,R3,R4);
+}
+
+/**
+ * @fn double Allocation_self_test(void)
+ *
+ * This function checks, before flight, that Allocate_thrust_closed_form() gives the same valve thrusts as
+ * Allocate_thrust_simplex() over a grid of roll angles and pitch/yaw/roll demands (of both signs, zero included).
+ *
+ * @return The largest difference [N] between the valve thrusts of the two methods (HUGE_VAL if the Simplex method
+ * failed), to be compared to #ALLOCATION_SELF_TEST_TOLERANCE.
+ */
+double Allocation_self_test(void) {
+	const double demand[] = {-0.3,-0.07,0.0,0.05,0.2};
+	const unsigned int demand_count = sizeof(demand)/sizeof(double);
+	unsigned int ip, iy, ir, iphi;
+	double phi, Mr;
+	double simplex[4], closed_form[4];
+	double deviation = 0.0;
+	int k;
+	struct Simplex_context context; // Not the one of the control loop, whose statistics are those of the flight
+
+	Simplex_context_init(&context);
+
+	for (iphi=0;iphi<24;iphi++) {
+		phi = -M_PI+iphi*M_PI/12.0+0.01; // Not only the multiples of 15 [deg]
+		for (ip=0;ip<demand_count;ip++) {
+			for (iy=0;iy<demand_count;iy++) {
+				for (ir=0;ir<demand_count;ir++) {
+					Mr = demand[ir]*d; // Roll moments of the same order as the forces times the valve offset
+					if (Allocate_thrust_simplex_context(&context,demand[ip],demand[iy],Mr,phi,&simplex[0],&simplex[1],&simplex[2],&simplex[3])!=ALLOCATION_OK) return HUGE_VAL;
+					Allocate_thrust_closed_form(demand[ip],demand[iy],Mr,phi,&closed_form[0],&closed_form[1],&closed_form[2],&closed_form[3]);
+					for (k=0;k<4;k++) deviation = fmax(deviation,fabs(simplex[k]-closed_form[k]));
+				}
+			}
+		}
+	}
+	return deviation;
+}
+
+/**
+ * @fn double Allocation_bounded_self_test(void)
+ *
+ * This function checks, before flight and for both #ALLOCATION__PRIORITY values, that Allocate_thrust_bounded() keeps
+ * every valve thrust within [0,VALVE__MAX_THRUST], and that it gives the thrusts of Allocate_thrust_closed_form() if
+ * and only if these are within the bounds, over a grid of roll angles and demands going well beyond what the valves can
+ * produce.
+ *
+ * @return The largest bound violation or thrust difference [N] (HUGE_VAL if a demand the valves can produce was
+ * reduced), to be compared to #ALLOCATION_SELF_TEST_TOLERANCE.
+ */
+double Allocation_bounded_self_test(void) {
+	const double demand[] = {-2.0,-1.0,-0.5,-0.3,-0.07,0.0,0.05,0.2,0.4,0.8,1.5}; // In units of VALVE__MAX_THRUST
+	const unsigned int demand_count = sizeof(demand)/sizeof(double);
+	const unsigned char flight_priority = ALLOCATION__PRIORITY;
+	unsigned int ip, iy, ir, iphi;
+	unsigned char priority;
+	double phi, Fp, Fy, Mr;
+	double bounded[4], closed_form[4];
+	double deviation = 0.0;
+	int k, status, within_bounds;
+
+	for (priority=ALLOCATION_PRIORITY_ROLL;priority<=ALLOCATION_PRIORITY_PITCH_YAW;priority++) {
+		ALLOCATION__PRIORITY = priority;
+		for (iphi=0;iphi<24;iphi++) {
+			phi = -M_PI+iphi*M_PI/12.0+0.01;
+			for (ip=0;ip<demand_count;ip++) {
+				for (iy=0;iy<demand_count;iy++) {
+					for (ir=0;ir<demand_count;ir++) {
+						Fp = demand[ip]*VALVE__MAX_THRUST;
+						Fy = demand[iy]*VALVE__MAX_THRUST;
+						Mr = demand[ir]*VALVE__MAX_THRUST*d;
+						status = Allocate_thrust_bounded(Fp,Fy,Mr,phi,&bounded[0],&bounded[1],&bounded[2],&bounded[3]);
+						Allocate_thrust_closed_form(Fp,Fy,Mr,phi,&closed_form[0],&closed_form[1],&closed_form[2],&closed_form[3]);
+						within_bounds = 1;
+						for (k=0;k<4;k++) {
+							if (bounded[k]<0 || bounded[k]>VALVE__MAX_THRUST) deviation = fmax(deviation,fmax(-bounded[k],bounded[k]-VALVE__MAX_THRUST));
+							if (closed_form[k]>VALVE__MAX_THRUST*(1-1e-9)) within_bounds = 0;
+						}
+						if (status==ALLOCATION_OK) {
+							for (k=0;k<4;k++) deviation = fmax(deviation,fabs(bounded[k]-closed_form[k]));
+						} else if (status!=ALLOCATION_SATURATED || within_bounds) {
+							deviation = HUGE_VAL;
+						}
+					}
+				}
+			}
+		}
+	}
+	ALLOCATION__PRIORITY = flight_priority;
+	return deviation;
+}
+
+/**
+ * @fn double Allocation_table_self_test(void)
+ *
+ * This function reports, before flight, the accuracy of Allocate_thrust_table() over a dense grid of roll angles
+ * (falling between the table entries) and demands : the thrusts are compared to the exact Simplex solution
+ * (Allocate_thrust_simplex()) where that solution is within VALVE__MAX_THRUST, and to Allocate_thrust_bounded() where
+ * the demand saturates the valves.
+ *
+ * @return The largest valve thrust difference [N] (HUGE_VAL if a method failed), to be compared to
+ * #ALLOCATION_TABLE_TOLERANCE.
+ */
+double Allocation_table_self_test(void) {
+	const double demand[] = {-1.5,-0.4,-0.1,0.0,0.07,0.3,0.9}; // In units of VALVE__MAX_THRUST
+	const unsigned int demand_count = sizeof(demand)/sizeof(double);
+	unsigned int ip, iy, ir, iphi;
+	double phi, Fp, Fy, Mr;
+	double table[4], exact[4];
+	double deviation = 0.0;
+	int k, status;
+	struct Simplex_context context;
+
+	Simplex_context_init(&context);
+
+	for (iphi=0;iphi<1000;iphi++) {
+		phi = -2*M_PI+iphi*(4*M_PI/1000)+0.0013; // Two turns, both signs
+		for (ip=0;ip<demand_count;ip++) {
+			for (iy=0;iy<demand_count;iy++) {
+				for (ir=0;ir<demand_count;ir++) {
+					Fp = demand[ip]*VALVE__MAX_THRUST;
+					Fy = demand[iy]*VALVE__MAX_THRUST;
+					Mr = demand[ir]*VALVE__MAX_THRUST*d;
+					status = Allocate_thrust_table(Fp,Fy,Mr,phi,&table[0],&table[1],&table[2],&table[3]);
+					if (status==ALLOCATION_OK) {
+						if (Allocate_thrust_simplex_context(&context,Fp,Fy,Mr,phi,&exact[0],&exact[1],&exact[2],&exact[3])!=ALLOCATION_OK) return HUGE_VAL;
+					} else if (status==ALLOCATION_SATURATED) {
+						Allocate_thrust_bounded(Fp,Fy,Mr,phi,&exact[0],&exact[1],&exact[2],&exact[3]);
+					} else {
+						return HUGE_VAL;
+					}
+					for (k=0;k<4;k++) deviation = fmax(deviation,fabs(table[k]-exact[k]));
+				}
+			}
+		}
+	}
+	return deviation;
+}
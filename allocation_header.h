@@ -0,0 +1,70 @@
+/**
+ * @file allocation_header.h
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Thrust allocation header file.
+ *
+ * This is the header to allocation_funcs.c containing necessary definitions and
+ * initializations.
+ */
+
+#ifndef ALLOCATION_HEADER_H_
+#define ALLOCATION_HEADER_H_
+
+# include "simplex_header.h"
+
+/**
+ * @name Allocation modes
+ * Values of #ALLOCATION__MODE, i.e. how Allocate_thrust() distributes the control demand over the valves
+ * @{
+ */
+# define ALLOCATION_SIMPLEX 0 ///< Solve the linear program with the general Simplex method (see Allocate_thrust_simplex())
+# define ALLOCATION_CLOSED_FORM 1 ///< Solve the same linear program analytically (see Allocate_thrust_closed_form())
+# define ALLOCATION_BOUNDED 2 ///< Solve it analytically with the valve thrusts also bounded by VALVE__MAX_THRUST (see Allocate_thrust_bounded())
+# define ALLOCATION_TABLE 3 ///< Same as #ALLOCATION_BOUNDED, with the roll angle geometry interpolated in a table (see Allocate_thrust_table())
+/** @} */
+
+/**
+ * @name Allocation priorities
+ * Values of #ALLOCATION__PRIORITY, i.e. which part of a demand the valves cannot produce is kept by Allocate_thrust_bounded()
+ * @{
+ */
+# define ALLOCATION_PRIORITY_ROLL 0 ///< Produce as much of the roll moment as possible, then scale down the pitch and yaw forces to what is left
+# define ALLOCATION_PRIORITY_PITCH_YAW 1 ///< Produce as much of the pitch and yaw forces as possible, then reduce the roll moment to what is left
+/** @} */
+
+/**
+ * @name Allocation status codes
+ * Returned by Allocate_thrust() and recorded with every control iteration
+ * @{
+ */
+# define ALLOCATION_OK 0 ///< The valve thrusts produce the demanded forces and moment with the least total thrust
+# define ALLOCATION_SATURATED 2 ///< The valves cannot produce the demand : the thrusts produce the reduced demand chosen by #ALLOCATION__PRIORITY
+# define ALLOCATION_UNBOUNDED 1 ///< The Simplex method found the problem unbounded (the valves are closed)
+# define ALLOCATION_INFEASIBLE -1 ///< The Simplex method found no solution (the valves are closed)
+# define ALLOCATION_BAD_INPUT -2 ///< The demand or the roll angle is not a finite number (the valves are closed)
+/** @} */
+
+# define ALLOCATION_SELF_TEST_TOLERANCE 1e-9 ///< [N] Largest valve thrust difference allowed between the allocation modes by Allocation_self_test()
+# define ALLOCATION_TABLE_SIZE 1024 ///< Number of roll angles in the #ALLOCATION_TABLE table (power of 2, 16 kB of cosines and sines)
+# define ALLOCATION_TABLE_TOLERANCE 1e-5 ///< [N] Largest valve thrust error allowed for the #ALLOCATION_TABLE mode by Allocation_table_self_test()
+
+extern unsigned char ALLOCATION__MODE; ///< Allocation mode used in flight (#ALLOCATION_SIMPLEX, #ALLOCATION_CLOSED_FORM, #ALLOCATION_BOUNDED or #ALLOCATION_TABLE)
+extern unsigned char ALLOCATION__PRIORITY; ///< Part of a saturated demand kept in #ALLOCATION_BOUNDED and #ALLOCATION_TABLE modes (#ALLOCATION_PRIORITY_ROLL or #ALLOCATION_PRIORITY_PITCH_YAW)
+extern struct Simplex_context allocation_simplex; ///< Simplex context of the control loop (#ALLOCATION_SIMPLEX mode)
+
+/** @cond INCLUDE_WITH_DOXYGEN */
+int Allocate_thrust(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4);
+int Allocate_thrust_simplex(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4);
+int Allocate_thrust_simplex_context(struct Simplex_context *context, double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4);
+int Allocate_thrust_closed_form(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4);
+int Allocate_thrust_bounded(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4);
+double Allocation_self_test(void);
+double Allocation_bounded_self_test(void);
+void Allocation_table_init(void);
+int Allocate_thrust_table(double Fpitch, double Fyaw, double Mroll, double phi, double *R1, double *R2, double *R3, double *R4);
+double Allocation_table_self_test(void);
+/** @endcond */
+
+#endif /* ALLOCATION_HEADER_H_ */
@@ -0,0 +1,170 @@
+/**
+ * @file decimator_funcs.c
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Fixed-point decimation filters functions file.
+ *
+ * This file contains the anti-aliasing filters used to bring a signal sampled at a high rate
+ * down to a lower rate (see Pressure_read_sensors()). They work on integers only, so that their
+ * cost per input sample is small and does not depend on the values filtered.
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <math.h>
+# include "decimator_header.h"
+
+/**
+ * @fn void Decimator_design(struct Decimator_design *design, unsigned char type, unsigned int factor)
+ *
+ * This function computes a decimation filter. The #DECIMATOR_FIR is a Hamming-windowed sinc whose cutoff is
+ * #DECIMATOR_FIR_CUTOFF times the output sampling rate, so that it is well attenuated at the output Nyquist
+ * frequency. Its coefficients are rounded to Q#DECIMATOR_Q, the rounding error being moved to the central coefficient
+ * so that the DC gain is exactly 1. The #DECIMATOR_CIC has no coefficients, its gain factor^#DECIMATOR_CIC_ORDER
+ * being divided out of each output.
+ *
+ * @param design The filter.
+ * @param type #DECIMATOR_FIR or #DECIMATOR_CIC.
+ * @param factor Decimation factor, from 1 to #DECIMATOR_MAX_FACTOR.
+ */
+void Decimator_design(struct Decimator_design *design, unsigned char type, unsigned int factor) {
+	double ideal[DECIMATOR_FIR_MAX_TAPS], sum=0, x;
+	unsigned int taps=DECIMATOR_FIR_TAPS_PER_PHASE*factor, k;
+	int32_t quantized_sum=0;
+
+	if (factor<1 || factor>DECIMATOR_MAX_FACTOR || (type!=DECIMATOR_FIR && type!=DECIMATOR_CIC)) {
+		printf("CRITICAL ERROR: Decimator type (%u) must be DECIMATOR_FIR or DECIMATOR_CIC and factor (%u) between 1 and %d.\n",type,factor,DECIMATOR_MAX_FACTOR);
+		exit(-2);
+	}
+	memset(design,0,sizeof(struct Decimator_design));
+	design->type=type;
+	design->factor=factor;
+	if (type==DECIMATOR_CIC) {
+		design->warmup=DECIMATOR_CIC_ORDER;
+		design->delay=DECIMATOR_CIC_ORDER*(factor-1);
+		return;
+	}
+	design->warmup=DECIMATOR_FIR_TAPS_PER_PHASE-1;
+	design->delay=taps-1;
+	for (k=0;k<taps;k++) {
+		x=((double)k-(taps-1)/2.0)*2.0*DECIMATOR_FIR_CUTOFF/factor; // Time from the center, in half-periods of the cutoff
+		ideal[k]=((x==0) ? 1.0 : sin(M_PI*x)/(M_PI*x))*(0.54-0.46*cos(2.0*M_PI*k/(taps-1))); // Sinc times the Hamming window
+		sum+=ideal[k];
+	}
+	for (k=0;k<taps;k++) {
+		design->coefficients[k]=(int16_t)lround(ideal[k]/sum*(1<<DECIMATOR_Q));
+		quantized_sum+=design->coefficients[k];
+	}
+	design->coefficients[taps/2]+=(1<<DECIMATOR_Q)-quantized_sum;
+}
+
+/**
+ * @fn void Decimator_init(struct Decimator *decimator, const struct Decimator_design *design)
+ *
+ * This function resets the decimation of a signal.
+ *
+ * @param decimator The decimator.
+ * @param design Its filter (must live as long as the decimator).
+ */
+void Decimator_init(struct Decimator *decimator, const struct Decimator_design *design) {
+	memset(decimator,0,sizeof(struct Decimator));
+	decimator->design=design;
+}
+
+/**
+ * @fn int Decimator_push(struct Decimator *decimator, int32_t input, int32_t *output)
+ *
+ * This function filters one input sample and, every #Decimator_design.factor samples, produces an output. The cost
+ * is at most #DECIMATOR_FIR_TAPS_PER_PHASE multiply-accumulates (#DECIMATOR_FIR) or 2*#DECIMATOR_CIC_ORDER additions
+ * (#DECIMATOR_CIC) per input. The output is delayed by #Decimator_design.delay half input samples with respect to
+ * the latest input.
+ *
+ * @param decimator The decimator.
+ * @param input The input sample (must fit in #DECIMATOR_INPUT_BITS bits).
+ * @param output The filtered signal in Q#DECIMATOR_Q (i.e. multiplied by 2^#DECIMATOR_Q), when an output is produced.
+ *
+ * @return 1 if an output was produced, 0 otherwise (including during the #Decimator_design.warmup).
+ */
+int Decimator_push(struct Decimator *decimator, int32_t input, int32_t *output) {
+	const struct Decimator_design *design=decimator->design;
+	unsigned int factor=design->factor, stage, j, slot;
+	uint32_t value, previous;
+	int64_t gain=1;
+
+	if (design->type==DECIMATOR_FIR) {
+		// The accumulator j outputs after the current one completes factor-1-phase+j*factor inputs from now
+		for (j=0;j<DECIMATOR_FIR_TAPS_PER_PHASE;j++) {
+			slot=(decimator->next+j)%DECIMATOR_FIR_TAPS_PER_PHASE;
+			decimator->accumulators[slot]+=(int32_t)design->coefficients[factor-1-decimator->phase+j*factor]*input;
+		}
+	} else {
+		value=(uint32_t)input;
+		for (stage=0;stage<DECIMATOR_CIC_ORDER;stage++) {
+			decimator->integrators[stage]+=value;
+			value=decimator->integrators[stage];
+		}
+	}
+	if (++decimator->phase<factor) return 0;
+	decimator->phase=0;
+
+	if (design->type==DECIMATOR_FIR) {
+		*output=decimator->accumulators[decimator->next];
+		decimator->accumulators[decimator->next]=0;
+		decimator->next=(decimator->next+1)%DECIMATOR_FIR_TAPS_PER_PHASE;
+	} else {
+		value=decimator->integrators[DECIMATOR_CIC_ORDER-1];
+		for (stage=0;stage<DECIMATOR_CIC_ORDER;stage++) {
+			previous=decimator->combs[stage];
+			decimator->combs[stage]=value;
+			value-=previous;
+		}
+		for (stage=0;stage<DECIMATOR_CIC_ORDER;stage++) gain*=factor;
+		*output=(int32_t)((int64_t)(int32_t)value*(1<<DECIMATOR_Q)/gain);
+	}
+	if (decimator->outputs<design->warmup) {
+		decimator->outputs++;
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * @fn double Decimator_self_test(unsigned char type)
+ *
+ * This function checks, before flight, the decimators of a type for every factor up to #DECIMATOR_MAX_FACTOR, over
+ * the whole #DECIMATOR_INPUT_BITS input range : the first output after the warm-up of a constant input must be that
+ * input exactly (DC gain of 1), and after a full-range step the outputs must stay within
+ * #DECIMATOR_SELF_TEST_OVERSHOOT of the step and, once the filter has only seen the new level, be it exactly.
+ *
+ * @param type #DECIMATOR_FIR or #DECIMATOR_CIC.
+ *
+ * @return The largest deviation [input units] : from the expected output, or beyond the allowed overshoot.
+ */
+double Decimator_self_test(unsigned char type) {
+	const int32_t low=-(1<<(DECIMATOR_INPUT_BITS-1)), high=(1<<(DECIMATOR_INPUT_BITS-1))-1;
+	const double overshoot=DECIMATOR_SELF_TEST_OVERSHOOT*((double)high-low);
+	struct Decimator_design design;
+	struct Decimator decimator;
+	unsigned int factor, outputs, settling;
+	int32_t output;
+	double value, deviation=0;
+
+	for (factor=1;factor<=DECIMATOR_MAX_FACTOR;factor++) {
+		Decimator_design(&design,type,factor);
+		Decimator_init(&decimator,&design);
+		settling=(type==DECIMATOR_FIR) ? DECIMATOR_FIR_TAPS_PER_PHASE : DECIMATOR_CIC_ORDER; // Outputs until only the new level is seen
+		// Constant input : the first output is already exact
+		while (!Decimator_push(&decimator,low,&output));
+		deviation=fmax(deviation,fabs((double)output/(1<<DECIMATOR_Q)-low));
+		// Full-range step
+		for (outputs=0;outputs<settling+2;) {
+			if (!Decimator_push(&decimator,high,&output)) continue;
+			value=(double)output/(1<<DECIMATOR_Q);
+			if (outputs++<settling) deviation=fmax(deviation,fmax(low-overshoot-value,value-high-overshoot));
+			else deviation=fmax(deviation,fabs(value-high));
+		}
+	}
+	return deviation;
+}
@@ -0,0 +1,65 @@
+/**
+ * @file decimator_header.h
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Fixed-point decimation filters header file
+ *
+ * This is the header to decimator_funcs.c containing necessary definitions and
+ * initializations.
+ */
+
+#ifndef DECIMATOR_HEADER_H_
+#define DECIMATOR_HEADER_H_
+
+# include <stdint.h>
+
+# define DECIMATOR_FIR 0 ///< #Decimator_design.type value : windowed-sinc low-pass FIR of #DECIMATOR_FIR_TAPS_PER_PHASE*factor taps
+# define DECIMATOR_CIC 1 ///< #Decimator_design.type value : cascaded integrator-comb filter of order #DECIMATOR_CIC_ORDER (no multiplication, but a sinc^3 passband droop)
+# define DECIMATOR_MAX_FACTOR 32 ///< Largest decimation factor (keeps the CIC registers and the FIR accumulators within 32 bits for #DECIMATOR_INPUT_BITS inputs)
+# define DECIMATOR_INPUT_BITS 16 ///< Inputs must fit in this many bits (signed)
+# define DECIMATOR_Q 15 ///< Number of fractional bits of the FIR coefficients and of the outputs
+# define DECIMATOR_FIR_TAPS_PER_PHASE 8 ///< FIR length in output periods, i.e. number of multiply-accumulates per input sample
+# define DECIMATOR_FIR_MAX_TAPS (DECIMATOR_FIR_TAPS_PER_PHASE*DECIMATOR_MAX_FACTOR) ///< Longest FIR
+# define DECIMATOR_FIR_CUTOFF 0.3 ///< FIR cutoff (-6 [dB]) frequency, as a fraction of the output sampling rate
+# define DECIMATOR_CIC_ORDER 3 ///< Number of integrator and comb stages of the CIC filter
+# define DECIMATOR_SELF_TEST_TOLERANCE (1.0/(1<<DECIMATOR_Q)) ///< Largest deviation allowed by Decimator_self_test() (one output LSB)
+# define DECIMATOR_SELF_TEST_OVERSHOOT 0.05 ///< Largest overshoot of the step response allowed by Decimator_self_test(), as a fraction of the step (the #DECIMATOR_FIR, only #DECIMATOR_FIR_TAPS_PER_PHASE output periods long, overshoots by about 4%, the #DECIMATOR_CIC not at all)
+
+/**
+ * @struct Decimator_design
+ * The filter of a decimator (see Decimator_design()), which can be shared by several #Decimator filtering different
+ * signals in lockstep.
+ */
+struct Decimator_design {
+	unsigned char type; ///< #DECIMATOR_FIR or #DECIMATOR_CIC
+	unsigned int factor; ///< Decimation factor : one output every factor inputs
+	unsigned int warmup; ///< Number of first outputs dropped by Decimator_push() because the filter has not seen enough inputs yet
+	unsigned int delay; ///< Delay of the outputs (group delay of the filter), in half input samples
+	int16_t coefficients[DECIMATOR_FIR_MAX_TAPS]; ///< FIR coefficients in Q#DECIMATOR_Q (they sum to exactly 1), coefficients[k] weighting the input k samples before the output
+};
+
+/**
+ * @struct Decimator
+ * State of the decimation of one signal. The FIR is computed in polyphase form : every input is multiplied into the
+ * #DECIMATOR_FIR_TAPS_PER_PHASE outputs it contributes to, so the cost per input is constant (no burst of
+ * computation when an output is due).
+ */
+struct Decimator {
+	const struct Decimator_design *design; ///< The filter
+	unsigned int phase; ///< Number of inputs since the last output
+	unsigned int next; ///< Index in #accumulators of the output completed next (#DECIMATOR_FIR)
+	unsigned int outputs; ///< Number of outputs dropped so far (up to #Decimator_design.warmup)
+	int32_t accumulators[DECIMATOR_FIR_TAPS_PER_PHASE]; ///< Partial sums of the next outputs (#DECIMATOR_FIR)
+	uint32_t integrators[DECIMATOR_CIC_ORDER]; ///< Integrator registers (#DECIMATOR_CIC, in modulo 2^32 arithmetic)
+	uint32_t combs[DECIMATOR_CIC_ORDER]; ///< Previous input of each comb stage (#DECIMATOR_CIC)
+};
+
+/** @cond INCLUDE_WITH_DOXYGEN */
+void Decimator_design(struct Decimator_design *design, unsigned char type, unsigned int factor);
+void Decimator_init(struct Decimator *decimator, const struct Decimator_design *design);
+int Decimator_push(struct Decimator *decimator, int32_t input, int32_t *output);
+double Decimator_self_test(unsigned char type);
+/** @endcond */
+
+#endif /* DECIMATOR_HEADER_H_ */
@@ -18,16 +18,22 @@
 # include <stdint.h>
 # include <stdlib.h>
 # include <sys/ioctl.h>
-# include <sys/time.h>
 # include <math.h>
 # include <pthread.h>
+# include <poll.h>
 # include "imu_header.h"
 # include "master_header.h"
 # include "la_header.h"
+# include "kalman_header.h"
+# include "scheduler_header.h"
+# include "timebase_header.h"
+# include "recorder_header.h"
 
 //%%%%%%%%%%%%%%%%%%%%%%%%%%% VARIABLE DEFINITIONS %%%%%%%%%%%%%%%%%%%%%%%%%%%
 
-unsigned char IMU_SYNCHED=0; ///< If =1, then the IMU and Raspberry Pi UART communication has been synced, =0 otherwise
+unsigned char IMU_SYNCHED=0; ///< If =1, then the IMU and Raspberry Pi UART communication has been synced, =0 otherwise (set with IMU_set_synched())
+static pthread_mutex_t IMU_sync_lock=PTHREAD_MUTEX_INITIALIZER; ///< Protects #IMU_SYNCHED for IMU_wait_synched()
+static pthread_cond_t IMU_sync_condition=PTHREAD_COND_INITIALIZER; ///< Signalled when #IMU_SYNCHED is set
 
 unsigned char IMU_TX[2]="#f"; ///< Buffer holding transmit message to IMU (call to send Euler angles NOW)
 
@@ -56,6 +62,8 @@ int num_av_vars=0; ///< How many angles have we collected to average?
 
 float dt; ///< The timestep for derivatives (time passed in [s] between current and last iteration)
 
+struct IMU_framing_statistics IMU_framing; ///< Framing errors of the Razor IMU stream
+
 //%%%%%%%%%%%%%%%%%%%%%%%%%%% FUNCTION DEFINITIONS %%%%%%%%%%%%%%%%%%%%%%%%%%%
 
 /**
@@ -170,6 +178,26 @@ void set_to_blocking(int fd) {
 	}
 }
 
+/**
+ * @fn void set_to_nonblocking(int fd)
+ *
+ * This function sets O_NONBLOCK back on a serial connection (see set_to_blocking()), so that a read() returns at once
+ * with whatever has been received. It is used for the connections served by the I/O reactor (see IO_reactor_add()).
+ *
+ * @param fd The file handle
+ */
+void set_to_nonblocking(int fd) {
+	int saved_args;
+	if ((saved_args=fcntl(fd, F_GETFL))<0) {
+		perror("fcntl F_GETFL failed.\n");
+		exit(-2);
+	}
+	if ((fcntl(fd,F_SETFL,saved_args|O_NONBLOCK))<0) { // Set the non-blocking flag
+		perror("fcntl F_SETFL failed.\n");
+		exit(-2);
+	}
+}
+
 /**
  * @fn float min_of_set(float now, float before)
  *
@@ -216,12 +244,35 @@ float min_of_set(float now, float before) {
 }
 
 /**
- * @fn void Find_raw_Euler_angular_velocities()
+ * @fn unsigned long long int IMU_frame_interval(unsigned long long int time, unsigned long long int last_time)
+ *
+ * This function gives the time step between two IMU frames to differentiate and filter with. The frames are stamped on
+ * the Razor IMU cadence (see IMU_receive()), but two stamps may still be close, or equal, when the stamping starts over
+ * from a late reception : below #IMU_DT_MIN_PERIODS the nominal IMU__READ_TIMESTEP is used, and beyond #IMU_DT_MAX_PERIODS
+ * (frames lost) the time step is clamped. It is therefore never 0 and the rates never infinite.
+ *
+ * @param time Time stamp [us] of the current frame.
+ * @param last_time Time stamp [us] of the previous frame (may be later than time).
+ *
+ * @return The time step [us].
+ */
+unsigned long long int IMU_frame_interval(unsigned long long int time, unsigned long long int last_time) {
+	long long int interval=(long long int)(time-last_time); // Negative if the current frame is stamped before the previous one
+
+	if (interval<IMU_DT_MIN_PERIODS*IMU__READ_TIMESTEP) return IMU__READ_TIMESTEP; // Frames bunched up : assume the nominal cadence
+	if (interval>IMU_DT_MAX_PERIODS*IMU__READ_TIMESTEP) return IMU_DT_MAX_PERIODS*IMU__READ_TIMESTEP; // Do not spread one step over a long gap
+	return interval;
+}
+
+/**
+ * @fn void Find_raw_Euler_angular_velocities(unsigned long long int sample_time)
  *
  * Take a numerical derivative of the euler angles to get angular rates [(rad)/s].
+ *
+ * @param sample_time The time [us] between the current and the previous IMU frame (see IMU_frame_interval(), must not be 0).
  */
-void Find_raw_Euler_angular_velocities() {
-	dt = (float)(time_imu)/1000000.0; // Convert the [us] timestep reading the IMU into [s]
+void Find_raw_Euler_angular_velocities(unsigned long long int sample_time) {
+	dt = (float)(sample_time)/1000000.0; // Convert the [us] timestep between IMU frames into [s]
 	psi_dot=(psi_save-psi_save_last)/dt; // [rad/s] YAW RATE
 	theta_dot=(theta_save-theta_save_last)/dt; // [rad/s] PITCH RATE
 	phi_dot=(phi_save-phi_save_last)/dt; // [rad/s] ROLL RATE
@@ -266,7 +317,7 @@ void construct_zeroed_DCM() {
 	DCM_MATRIX.matrix[1][2]=cos(phi_save)*sin(theta_save)*sin(psi_save)-sin(phi_save)*cos(psi_save); // c2
 	DCM_MATRIX.matrix[2][2]=cos(phi_save)*cos(theta_save); // c3
 
-	DCM_MATRIX=mmultiply(R_MATRIX,DCM_MATRIX); // Zero the DCM matrix with respect to the calibration orientation
+	mmultiply_3x3_3x3(&R_MATRIX,&DCM_MATRIX,&DCM_MATRIX); // Zero the DCM matrix with respect to the calibration orientation
 }
 
 /**
@@ -303,31 +354,35 @@ void zero_Euler_angles() {
  *
  * Zero the IMU data, which means spend some time to get an average reading for psi, theta and phi and then use
  * that average reading to construct a matrix that would zero all three angles for the rocket orientation at which
- * the rocket is in when this function executes (i.e. rocket _s_t_a_t_i_o_n_n_a_r_y_ on launch pad).
+ * the rocket is in when this function executes (i.e. rocket _s_t_a_t_i_o_n_n_a_r_y_ on launch pad). Until
+ * get_filtered_attitude_parallel() is started, this function is the consumer of #IMU_ring.
  */
 void Calibrate_IMU() {
-	gettimeofday(&before_loop, NULL); // Get starting point for timing just before beginning the calibration
-	gettimeofday(&before_imu, NULL);
+	struct IMU_frame frame; // Frame popped from #IMU_ring
+	struct Periodic_task calibration_task;
+	Periodic_task_start(&calibration_task,"IMU calibration",IMU__READ_TIMESTEP); // Get starting point for timing just before beginning the calibration
 	do {
-		check_time(&now_loop,before_loop,elapsed_loop,&time_loop);
-
-		passive_wait(&now_imu,&before_imu,&elapsed_imu,&time_imu,IMU__READ_TIMESTEP);
+		Periodic_task_wait(&calibration_task);
 
-		// Register the values
-		psi_save=psi;
-		theta_save=theta;
-		phi_save=phi;
+		while (SPSC_ring_pop(&IMU_ring,&frame)==0) { // Average every frame received since the last iteration
+			// Register the values
+			psi_save=frame.psi;
+			theta_save=frame.theta;
+			phi_save=frame.phi;
+			IMU_last_frame_time=frame.time;
 
-		// Update averages
-		psi_av=psi_av+psi_save;
-		theta_av=theta_av+theta_save;
-		phi_av=phi_av+phi_save;
+			// Update averages
+			psi_av=psi_av+psi_save;
+			theta_av=theta_av+theta_save;
+			phi_av=phi_av+phi_save;
 
-		num_av_vars++;
+			num_av_vars++;
+		}
 
 		// Display values we are receiving
-		printf("time_imu: %llu \t psi: %.4f \t theta: %.4f \t phi: %.4f\n",time_imu,TO_DEG(psi),TO_DEG(theta),TO_DEG(phi));
-	} while(time_loop<=CALIB__TIME); // Calibrate while calibration time has not elapsed
+		printf("time_imu: %llu \t psi: %.4f \t theta: %.4f \t phi: %.4f\n",calibration_task.last_step,TO_DEG(psi_save),TO_DEG(theta_save),TO_DEG(phi_save));
+	} while(calibration_task.elapsed<=CALIB__TIME); // Calibrate while calibration time has not elapsed
+	Periodic_task_report(&calibration_task);
 
 	// Now do the average
 	psi_av=psi_av/num_av_vars;
@@ -347,10 +402,10 @@ void Calibrate_IMU() {
 }
 
 /**
- * @fn void Kalman_filter(struct MATRIX *x,struct MATRIX *P,float z,struct MATRIX Q,struct MATRIX R,float dt,struct MATRIX EYE2)
+ * @fn void Kalman_filter(struct MATRIX2x1 *x,struct MATRIX2x2 *P,float z,const struct MATRIX2x2 *Q,const struct MATRIX1x1 *R,float dt,const struct MATRIX2x2 *EYE2)
  *
  * This function applies a real-time Kalman filter on the signal z. Consequently, this function is called each time a new
- * value of z is read.
+ * value of z is read. All intermediate matrices live on the stack, so no heap memory is used.
  *
  * @param x Predicted a priori and then updated a posteriori state estimate (it's the matrix version of the filtered value!).
  * @param P Predicted a priori and then updated a posteriori estimate covariance.
@@ -360,41 +415,181 @@ void Calibrate_IMU() {
  * @param dt The time step.
  * @param EYE2 A [2x2] identity matrix.
  */
-void Kalman_filter(struct MATRIX *x,struct MATRIX *P,float z,struct MATRIX Q,struct MATRIX R,float dt,struct MATRIX EYE2) {
+void Kalman_filter(struct MATRIX2x1 *x,struct MATRIX2x2 *P,float z,const struct MATRIX2x2 *Q,const struct MATRIX1x1 *R,float dt,const struct MATRIX2x2 *EYE2) {
+	struct MATRIX2x2 A; // Discrete-time dynamics matrix
+	struct MATRIX2x2 A_T; // A'
+	struct MATRIX2x1 C_T; // C'
+	struct MATRIX2x2 M22; // Temporary [2x2] product
+	struct MATRIX2x1 M21; // Temporary [2x1] product
+	struct MATRIX1x2 M12; // Temporary [1x2] product
+	struct MATRIX1x1 M11; // Temporary [1x1] product
+	struct MATRIX1x1 z_temp; // z as a [1x1] matrix
+	struct MATRIX1x1 inn; // Innovation or measurement residual
+	struct MATRIX1x1 S; // Innovation (or residual) covariance
+	struct MATRIX1x1 S_inv; // inv(S)
+	struct MATRIX2x1 K; // Optimal Kalman gain
+
 	// Initialize discrete-time model
-	A_kalman.matrix[0][1]=dt;
+	A=A_kalman;
+	A.matrix[0][1]=dt;
+	transpose_2x2(&A,&A_T);
+	transpose_1x2(&C_kalman,&C_T);
 
 	// Prediction
-	*x = mmultiply(A_kalman,*x); // x=A*x
-	*P = madd(mmultiply(A_kalman,mmultiply(*P,transpose(A_kalman))),Q); // P=A*P*A'+Q
+	mmultiply_2x2_2x1(&A,x,x); // x=A*x
+	mmultiply_2x2_2x2(P,&A_T,&M22);
+	mmultiply_2x2_2x2(&A,&M22,&M22);
+	madd_2x2(&M22,Q,P); // P=A*P*A'+Q
 
 	// Update
 	z_temp.matrix[0][0]=z;
-	inn = msubtract(z_temp,mmultiply(C_kalman,*x)); // inn=z-C*x
-	S = madd(mmultiply(C_kalman,mmultiply(*P,transpose(C_kalman))),R); // S=C*P*C'+R
-	K = mmultiply(*P,mmultiply(transpose(C_kalman),minverse_1x1(S))); // K=P*C'*inv(S)
+	mmultiply_1x2_2x1(&C_kalman,x,&M11);
+	msubtract_1x1(&z_temp,&M11,&inn); // inn=z-C*x
+	mmultiply_1x2_2x2(&C_kalman,P,&M12);
+	mmultiply_1x2_2x1(&M12,&C_T,&M11);
+	madd_1x1(&M11,R,&S); // S=C*P*C'+R
+	minverse_1x1_fixed(&S,&S_inv);
+	mmultiply_2x1_1x1(&C_T,&S_inv,&M21);
+	mmultiply_2x2_2x1(P,&M21,&K); // K=P*C'*inv(S)
+
+	mmultiply_2x1_1x1(&K,&inn,&M21);
+	madd_2x1(x,&M21,x); // xNext=x+K*inn
+	mmultiply_2x1_1x2(&K,&C_kalman,&M22);
+	msubtract_2x2(EYE2,&M22,&M22);
+	mmultiply_2x2_2x2(&M22,P,P); // PNext=(eye(2)-K*C)*P
+}
 
-	*x = madd(*x,mmultiply(K,inn)); // xNext=x+K*inn
-	*P = mmultiply(msubtract(EYE2,mmultiply(K,C_kalman)),*P); // PNext=(eye(2)-K*C)*P
+/**
+ * @fn void Kalman_filter_cv(struct MATRIX2x1 *x,struct MATRIX2x2 *P,float z,const struct MATRIX2x2 *Q,const struct MATRIX1x1 *R,float dt)
+ *
+ * This function does exactly the same as Kalman_filter(), but written out in closed form for our constant-velocity model
+ * A=[1 dt;0 1], C=[1 0]. Since P stays symmetric (for a symmetric Q), only P[0][0], P[0][1] and P[1][1] are computed and
+ * P[1][0] is set equal to P[0][1]. This removes all the transposes, the [1x1] "inverse" and the zero multiplications of the
+ * matrix version, leaving a handful of scalar operations and a single division.
+ *
+ * @param x Predicted a priori and then updated a posteriori state estimate.
+ * @param P Predicted a priori and then updated a posteriori estimate covariance (symmetric).
+ * @param z The input, i.e. the noisy signal.
+ * @param Q Covariance matrix of process noise (symmetric).
+ * @param R Covariance matrix of observation (measurement) noise.
+ * @param dt The time step.
+ */
+void Kalman_filter_cv(struct MATRIX2x1 *x,struct MATRIX2x2 *P,float z,const struct MATRIX2x2 *Q,const struct MATRIX1x1 *R,float dt) {
+	float x0, x1, p00, p01, p11, inn, S_inv, K0, K1;
+
+	// Prediction : x=A*x, P=A*P*A'+Q
+	x1 = x->matrix[1][0];
+	x0 = x->matrix[0][0]+dt*x1;
+	p11 = P->matrix[1][1];
+	p01 = P->matrix[0][1]+dt*p11;
+	p00 = P->matrix[0][0]+dt*(P->matrix[0][1]+p01)+Q->matrix[0][0];
+	p01 = p01+Q->matrix[0][1];
+	p11 = p11+Q->matrix[1][1];
+
+	// Update : inn=z-C*x, S=C*P*C'+R, K=P*C'*inv(S)
+	inn = z-x0;
+	S_inv = 1/(p00+R->matrix[0][0]);
+	K0 = p00*S_inv;
+	K1 = p01*S_inv;
+
+	x->matrix[0][0] = x0+K0*inn; // xNext=x+K*inn
+	x->matrix[1][0] = x1+K1*inn;
+	P->matrix[0][0] = p00-K0*p00; // PNext=(eye(2)-K*C)*P
+	P->matrix[0][1] = p01-K0*p01;
+	P->matrix[1][0] = P->matrix[0][1];
+	P->matrix[1][1] = p11-K1*p01;
 }
 
 /**
- * @fn void *read_IMU_parallel(void *args)
+ * @fn void IMU_parser_init(struct IMU_parser *parser)
  *
- * This is a (p)thread which does only one thing : read the raw IMU values:
- * 		- float psi
- * 		- float theta
- * 		- float phi
- * 		- float accelX
- * 		- float accelY
- * 		- float accelZ
+ * This function empties the parser and makes it look for the frame boundaries (the first call to IMU_parser_next()
+ * then asks for the sync token).
+ *
+ * @param parser The parser.
+ */
+void IMU_parser_init(struct IMU_parser *parser) {
+	memset(parser,0,sizeof(struct IMU_parser));
+	parser->sync_timeout=IMU_SYNC_TIMEOUT_MIN;
+}
+
+/**
+ * @fn int IMU_parser_next(struct IMU_parser *parser, struct IMU_frame *frame)
  *
- * Once read, these values become available to be saved & used by other threads (such as the filtering thread).
+ * This function consumes the bytes read into the parser (see #IMU_parser). While the frame boundaries are unknown, it
+ * scans the bytes for #IMU_SYNC_TOKEN, the frames starting right after it (IMU_receive() decides when to ask for "#s"
+ * again, by clearing #IMU_parser::sync_requested). Once synchronized, a complete frame is decoded straight from the buffer
+ * into frame (the Razor IMU sends the 6 floats least significant byte first, as the Raspberry Pi stores them). A
+ * frame with a value out of the plausibility bounds (#IMU_PLAUSIBLE_ANGLE, #IMU_PLAUSIBLE_ACCEL) or not a number is
+ * dropped, and #IMU_MAX_IMPLAUSIBLE_FRAMES of them in a row mean the frame boundaries were lost (e.g. a byte dropped by
+ * the UART), so the parser looks for the token again. A single implausible frame is more likely a glitch of the
+ * IMU, after which the boundaries are still right. The counters of #IMU_framing are updated.
  *
- * @param args A pointer to the input arguments (we have none for this thread)
+ * @param parser The parser.
+ * @param frame The decoded frame (the time is not set), written only if #IMU_PARSER_FRAME is returned.
+ *
+ * @return #IMU_PARSER_FRAME, #IMU_PARSER_NEED_DATA or #IMU_PARSER_REQUEST_SYNC.
  */
-void *read_IMU_parallel(void *args) { // A thread for reading the IMU
-	//######################### Now synch with the Razor IMU #########################
+int IMU_parser_next(struct IMU_parser *parser, struct IMU_frame *frame) {
+	unsigned int k, matched;
+
+	if (!parser->synched) {
+		if (!parser->sync_requested) {
+			parser->sync_requested=1;
+			parser->token_matched=0;
+			parser->length=0; // The bytes received up to now are flushed along with the UART input buffer
+			return IMU_PARSER_REQUEST_SYNC;
+		}
+		matched=parser->token_matched; // The bytes of a partially matched token are only discarded if it turns out not to be one
+		for (k=0;k<parser->length && parser->token_matched<sizeof(IMU_SYNC_TOKEN)-1;k++) {
+			if (parser->buffer[k]==IMU_SYNC_TOKEN[parser->token_matched]) parser->token_matched++;
+			else parser->token_matched=(parser->buffer[k]==IMU_SYNC_TOKEN[0]);
+		}
+		if (parser->token_matched<sizeof(IMU_SYNC_TOKEN)-1) { // Not found yet (a partially matched token is remembered)
+			atomic_fetch_add(&IMU_framing.discarded_bytes,matched+k-parser->token_matched);
+			parser->length=0;
+			return IMU_PARSER_NEED_DATA;
+		}
+		atomic_fetch_add(&IMU_framing.discarded_bytes,matched+k-(sizeof(IMU_SYNC_TOKEN)-1));
+		parser->length-=k;
+		memmove(parser->buffer,parser->buffer+k,parser->length); // The first frame starts right after the token
+		parser->synched=1;
+		parser->sync_requested=0;
+		parser->sync_timeout=IMU_SYNC_TIMEOUT_MIN; // A later loss of synchronization is recovered as fast
+		parser->implausible_run=0;
+	}
+	if (parser->length<MAX_BUFFER) return IMU_PARSER_NEED_DATA;
+
+	parser->length=0;
+	memcpy(&frame->psi,&parser->buffer[0],sizeof(float));
+	memcpy(&frame->theta,&parser->buffer[4],sizeof(float));
+	memcpy(&frame->phi,&parser->buffer[8],sizeof(float));
+	memcpy(&frame->accelX,&parser->buffer[12],sizeof(float));
+	memcpy(&frame->accelY,&parser->buffer[16],sizeof(float));
+	memcpy(&frame->accelZ,&parser->buffer[20],sizeof(float));
+	if (fabsf(frame->psi)<=IMU_PLAUSIBLE_ANGLE && fabsf(frame->theta)<=IMU_PLAUSIBLE_ANGLE && fabsf(frame->phi)<=IMU_PLAUSIBLE_ANGLE &&
+		fabsf(frame->accelX)<=IMU_PLAUSIBLE_ACCEL && fabsf(frame->accelY)<=IMU_PLAUSIBLE_ACCEL && fabsf(frame->accelZ)<=IMU_PLAUSIBLE_ACCEL) { // False for NaN
+		parser->implausible_run=0;
+		atomic_fetch_add(&IMU_framing.frames,1);
+		return IMU_PARSER_FRAME;
+	}
+	atomic_fetch_add(&IMU_framing.implausible,1);
+	if (++parser->implausible_run>=IMU_MAX_IMPLAUSIBLE_FRAMES) {
+		atomic_fetch_add(&IMU_framing.losses,1);
+		parser->synched=0;
+		return IMU_parser_next(parser,frame); // Request the token
+	}
+	return IMU_PARSER_NEED_DATA;
+}
+
+/**
+ * @fn void IMU_configure_stream(void)
+ *
+ * This function puts the Razor IMU into continuous binary streaming, after which the frames are read through an
+ * #IMU_parser (see IMU_receive()). It waits until the commands have been transmitted, but not for the Razor IMU to
+ * switch : the first "#s" is simply sent again until it is answered.
+ */
+void IMU_configure_stream(void) {
 	if((write(RAZOR_UART,"#ob",3))<0) { // Turn on binary output
 		perror("Failed to put Razor IMU into binary output mode (send \"#ob\").\n"); exit(-2);
 	}
@@ -404,146 +599,393 @@ void *read_IMU_parallel(void *args) { // A thread for reading the IMU
 	if((write(RAZOR_UART,"#oe0",4))<0) { // Turn off error message output
 		perror("Failed to put Razor IMU into no error message output mode (send \"#oe0\").\n"); exit(-2);
 	}
-	usleep(2000000);
-	if ((tcflush(RAZOR_UART,TCIOFLUSH))==-1) { // Clear the input buffer up to here
-		perror("Failed to flush the Razor IMU comm input buffer up to now.\n"); exit(-2);
+	if (tcdrain(RAZOR_UART)<0) { // The commands must be on the wire before anything else is sent
+		perror("Failed to transmit the Razor IMU output mode commands.\n"); exit(-2);
 	}
-	if ((write(RAZOR_UART,"#s",2))<0) { // Request synch token!
-		perror("Failed to request synch token from Razor IMU (send \"#s\").\n"); exit(-2);
+}
+
+/**
+ * @fn static unsigned long long int IMU_frame_stamp(struct IMU_parser *parser, unsigned long long int time)
+ *
+ * This function time-stamps a frame just decoded. The frames that are already received after it (still in #RAZOR_UART
+ * or in the parser) were sent later, one every IMU__READ_TIMESTEP, so the frame is dated back by as many periods : a
+ * backlog read in one burst is not stamped a few [us] apart. That estimate then only steers the cadence of the previous
+ * stamps (see #IMU_STAMP_GAIN), unless it is more than #IMU_STAMP_RESYNC_PERIODS off. As a backlog is dated from the
+ * time it is read, an estimate later than the cadence is trusted only for a frame read as it comes (nothing queued
+ * behind it, and not read in the same burst as the previous one). The stamp
+ * is never after the reception, but two stamps may still be close after a resynchronization (see IMU_frame_interval()).
+ *
+ * @param parser The parser, which has just decoded the frame.
+ * @param time [us] Time since #GLOBAL__TIME_STARTPOINT at which the last bytes were received.
+ *
+ * @return The time stamp [us].
+ */
+static unsigned long long int IMU_frame_stamp(struct IMU_parser *parser, unsigned long long int time) {
+	int pending=0; // Bytes received but not read yet
+	unsigned long long int backlog, estimate, expected, stamp;
+	long long int error;
+	unsigned char prompt; // 1 if the frame is read as it comes, not at the end of a backlog
+
+	if (ioctl(RAZOR_UART,FIONREAD,&pending)<0) pending=0;
+	backlog=((unsigned long long int)pending+parser->length)/MAX_BUFFER*IMU__READ_TIMESTEP; // Frames sent after this one
+	estimate=(time>backlog) ? time-backlog : 0;
+	expected=parser->last_stamp+IMU__READ_TIMESTEP;
+	error=(long long int)(estimate-expected);
+	prompt=(backlog==0 && time-parser->last_reception>=IMU_STAMP_RESYNC_PERIODS*IMU__READ_TIMESTEP);
+	parser->last_reception=time;
+	if (parser->last_stamp==0 || error<-IMU_STAMP_RESYNC_PERIODS*IMU__READ_TIMESTEP || (prompt && error>IMU_STAMP_RESYNC_PERIODS*IMU__READ_TIMESTEP)) {
+		stamp=estimate; // First frame, frames lost or stream restarted : start over from the reception
+	} else if (!prompt && error>0) {
+		stamp=expected; // Read late : the last frame of the backlog may have been received long before, so the estimate is only an upper bound
+	} else {
+		stamp=expected+error/IMU_STAMP_GAIN; // Follow the cadence
 	}
+	if (stamp>time) stamp=time;
+	parser->last_stamp=stamp;
+	return stamp;
+}
 
-	//------- Find the synch token
-	char SYNCH_TOKEN[2]="#S"; // The synch token we expect to receive from Razor IMU
-	int token_matched=0; // =1 if token has been matched
-	int iii;
-	unsigned long int trial_counter=0;
-	unsigned int global_trial_counter=0;
-	while (!token_matched) { // Search for token
-		token_matched=1; // Assume token has been found...
-		for (iii=0;iii<2;iii++) {
-			if (read(RAZOR_UART,IMU_SYNCH_RECEIVE,1)<0) { //; // Read in 1 character from buffer
-				perror("Read failed.\n");
-			}
-			if (IMU_SYNCH_RECEIVE[0]!=SYNCH_TOKEN[iii]) {
-				token_matched=0; //... by searching, proove that token has NOT been found unless this statement has not been reached, in which case
-								 // token HAS been found!
-				break;
+/**
+ * @fn void IMU_receive(struct IMU_parser *parser, unsigned long long int time)
+ *
+ * This function decodes the bytes just read into the parser with IMU_parser_next() and acts on the results : each
+ * frame is time-stamped (see IMU_frame_stamp()) and pushed into #IMU_ring (waking up the filtering thread if #IMU__FILTER_MODE is
+ * #IMU_FILTER_MODE_EVENT), and "#s" is sent whenever the sync token is needed. An unanswered "#s" is sent again after
+ * an adaptive timeout : #IMU_SYNC_TIMEOUT_MIN at first, so that a Razor IMU that is ready is found at once, then
+ * doubling up to #IMU_SYNC_TIMEOUT_MAX, so that a slow one is not flooded with requests (each of which flushes the
+ * input). The synchronization is given up, and the program quits, if the Razor IMU has not answered
+ * #IMU_SYNC_STARTUP_TIMEOUT after the first "#s". It returns when more bytes must be read, which are read at
+ * parser->buffer+parser->length (at most MAX_BUFFER-parser->length of them). It must also be called now and then
+ * while no bytes arrive, for the timeouts.
+ *
+ * @param parser The parser.
+ * @param time [us] Time since #GLOBAL__TIME_STARTPOINT at which the last bytes were received (or now).
+ */
+void IMU_receive(struct IMU_parser *parser, unsigned long long int time) {
+	struct IMU_frame frame; // The decoded frame
+	uint64_t frame_signal=1; // Value added to #IMU_frame_event for each frame pushed
+	int result;
+
+	if (!parser->synched && parser->sync_requested && time-parser->request_time>=parser->sync_timeout) { // "#s" unanswered
+		parser->sync_requested=0;
+		parser->sync_timeout=(2*parser->sync_timeout<IMU_SYNC_TIMEOUT_MAX) ? 2*parser->sync_timeout : IMU_SYNC_TIMEOUT_MAX;
+	}
+	while ((result=IMU_parser_next(parser,&frame))!=IMU_PARSER_NEED_DATA) {
+		if (result==IMU_PARSER_REQUEST_SYNC) {
+			if (atomic_load(&IMU_framing.sync_requests)==0) parser->startup_time=time;
+			if (!IMU_SYNCHED && time-parser->startup_time>=IMU_SYNC_STARTUP_TIMEOUT) {
+				printf("Failed to synch with Razor IMU (%lu requests in %llu [us]). Quitting.\n",atomic_load(&IMU_framing.sync_requests),time-parser->startup_time);
+				exit(-2); // Exit with a failure
 			}
-		}
-		trial_counter++;
-		if (trial_counter>=2000) { // If we have done "too many" trials trying to find synch token, then perhaps something went wrong and we missed it
-								   // so try sending sanch signal again
-			trial_counter=0;
-			global_trial_counter++;
-			if ((tcflush(RAZOR_UART,TCIOFLUSH))==-1) { // Clear the input buffer up to here
+			if ((tcflush(RAZOR_UART,TCIFLUSH))==-1) { // Clear the input buffer up to here
 				perror("Failed to flush the Razor IMU comm input buffer up to now.\n"); exit(-2);
 			}
 			if ((write(RAZOR_UART,"#s",2))<0) { // Request synch token!
 				perror("Failed to request synch token from Razor IMU (send \"#s\").\n"); exit(-2);
 			}
+			atomic_fetch_add(&IMU_framing.sync_requests,1);
+			parser->request_time=time;
+			continue;
 		}
-		if (global_trial_counter>=10) {
-			printf("Failed to synch with Razor IMU (global_trial_counter=%u). Quitting.\n",global_trial_counter);
-			exit(-2); // Exit with a failure
+		frame.time=IMU_frame_stamp(parser,time); // On the Razor IMU cadence, not when the frame happens to be read
+		SPSC_ring_push(&IMU_ring,&frame); // Hand the frame over to the filtering (if the queue is full, the frame is counted as dropped)
+		if (IMU__FILTER_MODE==IMU_FILTER_MODE_EVENT) {
+			if (write(IMU_frame_event,&frame_signal,sizeof(frame_signal))<0 && errno!=EAGAIN) { // Wake up the filtering thread
+				perror("Failed to signal the IMU frame event.");
+			}
 		}
 	}
+}
+
+/**
+ * @fn void IMU_reading_report(void)
+ *
+ * This function prints the framing statistics of the Razor IMU stream (see #IMU_framing) once it is no longer read,
+ * and writes to the #error_log the frames dropped because #IMU_ring was full (while the filtering was running, see
+ * get_filtered_attitude_parallel()) or because they were implausible.
+ */
+void IMU_reading_report(void) {
+	if (atomic_load(&IMU_ring.dropped)) {
+		sprintf(ERROR_MESSAGE,"IMU frame queue was full, %lu frames were dropped.\n",atomic_load(&IMU_ring.dropped));
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+	}
+	printf("\nIMU framing: %lu frames, %lu implausible, %lu losses of synchronization, %lu sync requests, %lu bytes discarded.\n",
+		atomic_load(&IMU_framing.frames),atomic_load(&IMU_framing.implausible),atomic_load(&IMU_framing.losses),
+		atomic_load(&IMU_framing.sync_requests),atomic_load(&IMU_framing.discarded_bytes));
+	if (atomic_load(&IMU_framing.implausible)) {
+		sprintf(ERROR_MESSAGE,"IMU framing: %lu implausible frames dropped, synchronization lost %lu times.\n",
+			atomic_load(&IMU_framing.implausible),atomic_load(&IMU_framing.losses));
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+	}
+}
+
+/**
+ * @fn void IMU_set_synched(void)
+ *
+ * This function sets #IMU_SYNCHED, once the frame boundaries of the Razor IMU stream have been found for the first
+ * time, and wakes up the threads waiting in IMU_wait_synched().
+ */
+void IMU_set_synched(void) {
+	pthread_mutex_lock(&IMU_sync_lock);
+	IMU_SYNCHED=1;
+	pthread_cond_broadcast(&IMU_sync_condition);
+	pthread_mutex_unlock(&IMU_sync_lock);
+}
+
+/**
+ * @fn void IMU_wait_synched(void)
+ *
+ * This function sleeps until #IMU_SYNCHED is set (see IMU_set_synched()). The program quits if the synchronization
+ * fails (see IMU_receive()), so it never waits forever.
+ */
+void IMU_wait_synched(void) {
+	pthread_mutex_lock(&IMU_sync_lock);
+	while (!IMU_SYNCHED) pthread_cond_wait(&IMU_sync_condition,&IMU_sync_lock);
+	pthread_mutex_unlock(&IMU_sync_lock);
+}
 
-	// Change blocking read parameters for IMU to the 24 bytes we expect to receive each time
-	new_razor_uart_options.c_cc[VTIME] = 0; // Return characters over UART immediately
-	new_razor_uart_options.c_cc[VMIN] = MAX_BUFFER; // Return once MAX_BUFFER characters have been received over the UART
-	set_new_attr(RAZOR_UART,TCSANOW,&new_razor_uart_options); // Set the new options for the port...
-	//######################### Finish synch with the Razor IMU #########################
-	IMU_SYNCHED=1; // Notify others that synchronization has been done
+/**
+ * @fn void *read_IMU_parallel(void *args)
+ *
+ * This is a (p)thread which does only one thing : read the raw IMU values:
+ * 		- float psi
+ * 		- float theta
+ * 		- float phi
+ * 		- float accelX
+ * 		- float accelY
+ * 		- float accelZ
+ *
+ * The bytes are read straight into an #IMU_parser and handed to IMU_receive(), which decodes them, finds the frame
+ * boundaries at startup and again whenever they are lost during the flight, and pushes each frame as an #IMU_frame into
+ * #IMU_ring, from which it is taken by the calibration and then by the filtering thread. Pushing never blocks, so this
+ * thread never waits on the filtering. It is only used when #IO__MODE is #IO_MODE_THREADS (otherwise the Razor IMU is
+ * read by IO_reactor_parallel()).
+ *
+ * @param args A pointer to the input arguments (we have none for this thread)
+ */
+void *read_IMU_parallel(void *args) { // A thread for reading the IMU
+	Thread_set_realtime("IMU reading",&IMU_READER__RT);
+	IMU_configure_stream();
+
+	struct IMU_parser parser; // Bytes received and not decoded yet
+	unsigned long long int received_time=time_since_start_us(); // Time at which the last bytes were received
+	ssize_t received; // Number of bytes received by the last read()
+	IMU_parser_init(&parser);
 	//######################### An infinite loop now (until cancelled) for reading the raw IMU data
 	do {
-		if ((read(RAZOR_UART,IMU_RX,MAX_BUFFER))<0) { // Instruction waits for 24 bytes to be received over UART from Razor IMU
+		IMU_receive(&parser,received_time);
+		if (parser.synched && !IMU_SYNCHED) {
+			// Change blocking read parameters for IMU to the 24 bytes we expect to receive each time
+			new_razor_uart_options.c_cc[VTIME] = 0; // Return characters over UART immediately
+			new_razor_uart_options.c_cc[VMIN] = MAX_BUFFER; // Return once MAX_BUFFER characters (or those requested, if fewer) have been received over the UART
+			set_new_attr(RAZOR_UART,&old_razor_uart_options,&new_razor_uart_options); // Set the new options for the port...
+			IMU_set_synched(); // Notify others that synchronization has been done
+		}
+		if ((received=read(RAZOR_UART,parser.buffer+parser.length,MAX_BUFFER-parser.length))<0) { // Never more than the rest of the current frame
 			perror("Unable to read from Razor IMU UART.\n");
 			exit(-2); // Exit with failure
 		}
-
-		/* Convert the recorded 24-bytes array sent by the IMU to 6 floating point values : the yaw, pitch, roll and 3 accelerations (along X,Y,Z).
-		 * Note that even though, as in the three line-comments below, the angle bytes are written by blocks of 4
-		 * with MSB b_Y_te _L_A_S_T_ and LSB b_Y_te _F_I_R_S_T_ by the Arduino onboard the Razor IMU, the endianness of the Linux platform makes direct memcpy work even
-		 * though the array written into yaw_bytes, as for the other *_bytes, has LSB at [0] location and MSB at [3] location
-		 * (Raspberry pi used is apparently little-endian)
-		 */
-		// Yaw={IMU_RX[3],IMU_RX[2],IMU_RX[1],IMU_RX[0]}
-		// Pitch={IMU_RX[7],IMU_RX[6],IMU_RX[5],IMU_RX[4]}
-		// Roll={IMU_RX[11],IMU_RX[10],IMU_RX[9],IMU_RX[8]}
-		memcpy(&yaw_bytes,&IMU_RX[0],4*sizeof(unsigned char));
-		memcpy(&pitch_bytes,&IMU_RX[4],4*sizeof(unsigned char));
-		memcpy(&roll_bytes,&IMU_RX[8],4*sizeof(unsigned char));
-		memcpy(&accelX_bytes,&IMU_RX[12],4*sizeof(unsigned char));
-		memcpy(&accelY_bytes,&IMU_RX[16],4*sizeof(unsigned char));
-		memcpy(&accelZ_bytes,&IMU_RX[20],4*sizeof(unsigned char));
-		// Typecast the 4 byte slices into IEEE754 float values
-		psi = *((float*)yaw_bytes);
-		theta = *((float*)pitch_bytes);
-		phi = *((float*)roll_bytes);
-		accelX = *((float*)accelX_bytes);
-		accelY = *((float*)accelY_bytes);
-		accelZ = *((float*)accelZ_bytes);
+		received_time=time_since_start_us(); // Time-stamp the bytes as soon as they are received
+		parser.length+=received; // Nothing if no byte came within VTIME (at startup only), then the sync timeout is checked
 	} while(!IMU_quit); // Continue reading sensor until quit
 
+	IMU_reading_report();
 	printf("\nQuitting IMU reading thread!\n");
 	pthread_exit(NULL); // Quit the pthread
 }
 
+/**
+ * @fn unsigned long long int Filter_IMU_frame(const struct IMU_frame *frame, unsigned long int *epoch)
+ *
+ * This function processes/filters one frame taken out of #IMU_ring: it zeroes the angles, differentiates them with the time step since
+ * the previous frame (taken from the time stamps, which follow the Razor IMU cadence, and bounded by IMU_frame_interval()), runs the
+ * #attitude_filter bank (see Kalman_bank_update()) on the six signals, publishes the result as an #attitude_snapshot and records
+ * everything as an #IMU_record. The record includes the reception-to-publish latency, i.e. the time between the time stamp of the
+ * frame (its reception by the Raspberry Pi, see IMU_receive()) and the publication of its estimate. It leaves out the sampling and
+ * transmission delays of the Razor IMU itself.
+ *
+ * @param frame The frame to filter.
+ * @param epoch Number of filter updates done so far (incremented).
+ *
+ * @return The reception-to-publish latency [us].
+ */
+unsigned long long int Filter_IMU_frame(const struct IMU_frame *frame, unsigned long int *epoch) {
+	float z[KALMAN_BANK_CHANNELS]; // Noisy signals fed to the filter bank
+	struct Attitude_snapshot snapshot; // Estimate handed over to the other threads
+	struct IMU_record record; // Flight recorder record
+	unsigned long long int latency;
+
+	// Register angles
+	psi_save=frame->psi;
+	theta_save=frame->theta;
+	phi_save=frame->phi;
+	accelX_save=frame->accelX;
+	accelY_save=frame->accelY;
+	accelZ_save=frame->accelZ;
+
+	// Zero out the angles
+	construct_zeroed_DCM();
+	zero_Euler_angles();
+	Find_raw_Euler_angular_velocities(IMU_frame_interval(frame->time,IMU_last_frame_time));
+	psi_save_last=psi_save; theta_save_last=theta_save; phi_save_last=phi_save; // Memorize the angles for next iteration
+	IMU_last_frame_time=frame->time;
+
+	// Now that raw values have been read in, it is time to apply kalman filtering (all 6 signals at once)
+	z[KALMAN_PSI]=psi_save;		z[KALMAN_PSIDOT]=psi_dot;
+	z[KALMAN_THETA]=theta_save;	z[KALMAN_THETADOT]=theta_dot;
+	z[KALMAN_PHI]=phi_save;		z[KALMAN_PHIDOT]=phi_dot;
+	Kalman_bank_update(&attitude_filter,z,dt);
+	psi_filt=attitude_filter.x0[KALMAN_PSI];
+	psi_dot_filt=attitude_filter.x0[KALMAN_PSIDOT];
+	theta_filt=attitude_filter.x0[KALMAN_THETA];
+	theta_dot_filt=attitude_filter.x0[KALMAN_THETADOT];
+	phi_filt=attitude_filter.x0[KALMAN_PHI];
+	phi_dot_filt=attitude_filter.x0[KALMAN_PHIDOT];
+	wx=phi_dot_filt-psi_dot_filt*sin(theta_filt);
+	wy=theta_dot_filt*cos(phi_filt)+psi_dot_filt*cos(theta_filt)*sin(phi_filt);
+	wz=psi_dot_filt*cos(theta_filt)*cos(phi_filt)-theta_dot_filt*sin(phi_filt);
+
+	snapshot.epoch=++(*epoch); snapshot.time=frame->time;
+	snapshot.psi=psi_filt;		snapshot.psi_dot=psi_dot_filt;
+	snapshot.theta=theta_filt;	snapshot.theta_dot=theta_dot_filt;
+	snapshot.phi=phi_filt;		snapshot.phi_dot=phi_dot_filt;
+	snapshot.wx=wx; snapshot.wy=wy; snapshot.wz=wz;
+	Publish_attitude_snapshot(&snapshot);
+	latency=time_since_start_us()-frame->time;
+
+	record.time_imu_glob=frame->time; record.dt=dt;
+	record.psi_save=psi_save; record.theta_save=theta_save; record.phi_save=phi_save;
+	record.psi_dot=psi_dot; record.theta_dot=theta_dot; record.phi_dot=phi_dot;
+	record.psi_filt=psi_filt; record.theta_filt=theta_filt; record.phi_filt=phi_filt;
+	record.psi_dot_filt=psi_dot_filt; record.theta_dot_filt=theta_dot_filt; record.phi_dot_filt=phi_dot_filt;
+	record.wx=wx; record.wy=wy; record.wz=wz;
+	record.accelX_save=accelX_save; record.accelY_save=accelY_save; record.accelZ_save=accelZ_save;
+	record.latency=latency;
+	Recorder_push(&IMU_record_stream,&record);
+	return latency;
+}
+
+/**
+ * @fn unsigned int IMU_timing_self_test(void)
+ *
+ * This function checks, before flight, that badly timed frames cannot upset the filtering : frames stamped at the same
+ * time, a few [us] apart, out of order and after a long gap are differentiated as in Filter_IMU_frame() and fed to a copy of
+ * #attitude_filter. Every time step must be within the bounds of IMU_frame_interval() and every estimate must stay finite.
+ *
+ * @return The number of failed filter updates (0 if the test passed).
+ */
+unsigned int IMU_timing_self_test(void) {
+	const unsigned long long int start=1000000; // [us] Time stamp of the first frame
+	const unsigned long long int stamps[]={start,start,start+1,start+IMU__READ_TIMESTEP+1,start+IMU__READ_TIMESTEP,start+10000000,start+10000000}; // Same stamps, 1 [us] apart, out of order, 10 [s] gap
+	const unsigned int frames=sizeof(stamps)/sizeof(stamps[0]);
+	struct Kalman_bank bank=attitude_filter;
+	float z[KALMAN_BANK_CHANNELS], angle, angle_last=0, step;
+	unsigned long long int interval;
+	unsigned int ii, jj, failures=0;
+
+	for (ii=1;ii<frames;ii++) {
+		interval=IMU_frame_interval(stamps[ii],stamps[ii-1]);
+		step=(float)interval/1000000.0;
+		angle=0.01*ii; // [rad] Steady rotation
+		z[KALMAN_PSI]=z[KALMAN_THETA]=z[KALMAN_PHI]=angle;
+		z[KALMAN_PSIDOT]=z[KALMAN_THETADOT]=z[KALMAN_PHIDOT]=(angle-angle_last)/step;
+		angle_last=angle;
+		Kalman_bank_update(&bank,z,step);
+		if (interval<IMU_DT_MIN_PERIODS*IMU__READ_TIMESTEP || interval>IMU_DT_MAX_PERIODS*IMU__READ_TIMESTEP) failures++;
+		else for (jj=0;jj<KALMAN_BANK_CHANNELS;jj++) {
+			if (!isfinite(bank.x0[jj]) || !isfinite(bank.x1[jj])) {
+				failures++;
+				break;
+			}
+		}
+	}
+	return failures;
+}
+
 /**
  * @fn void *get_filtered_attitude_parallel(void *args)
  *
- * This (p)thread does the sole job of filtering received data from the IMU. It is cadenced at the 1/IMU__READ_TIMESTEP [MHz] frequency
- * and so, each time that an interation is done, it collects the most recently available data from the IMU (stored in psi,theta,phi,accelX,
- * accelY and accelZ variables) and processes/filters it, then saves it to a log file.
+ * This (p)thread does the sole job of filtering received data from the IMU. Every frame that read_IMU_parallel() queues up in #IMU_ring
+ * is filtered by Filter_IMU_frame() (with the time step since the previous frame). When to do so depends on #IMU__FILTER_MODE :
+ * 	- #IMU_FILTER_MODE_PERIODIC : the thread is cadenced at the 1/IMU__READ_TIMESTEP [MHz] frequency and, each time that an iteration is done,
+ * 	  it processes all of the frames queued up since the previous iteration (a frame waits up to IMU__READ_TIMESTEP before being filtered)
+ * 	- #IMU_FILTER_MODE_EVENT : the thread sleeps on #IMU_frame_event, which read_IMU_parallel() signals after each push, so that every
+ * 	  frame is filtered as soon as it has been received
+ *
+ * The average and maximum reception-to-publish latency (see Filter_IMU_frame()) are printed when the thread quits.
  *
  * @param args A pointer to the input arguments (we have none for this thread)
  */
 void *get_filtered_attitude_parallel(void *args) { // A thread for reading the IMU
-	char IMU_MESSAGE[200];
-	write_to_file_custom(imu_log,"time_imu_glob \t dt \t psi_save \t theta_save \t phi_save \t psi_dot \t theta_dot \t phi_dot \t psi_filt \t theta_filt \t phi_filt \t psi_dot_filt \t theta_dot_filt \t phi_dot_filt \t wx \t wy \t wz \t accelX_save \t accelY_save \t accelZ_save\n",error_log);
+	struct IMU_frame frame; // Frame popped from #IMU_ring
+	unsigned long int epoch=0; // Number of filter updates done
+	unsigned long long int latency, latency_sum=0, latency_max=0; // Reception-to-publish latency statistics [us]
+	struct pollfd frame_event = {IMU_frame_event, POLLIN, 0};
+	uint64_t event_count;
+	struct Periodic_task filter_task; // Cadence of the #IMU_FILTER_MODE_PERIODIC mode
+	Thread_set_realtime("IMU filtering",&IMU_FILTER__RT);
+
+	// Frames queued up while the user was checking the calibration are stale : drop them, but keep the time reference
+	while (SPSC_ring_pop(&IMU_ring,&frame)==0) {
+		IMU_last_frame_time=frame.time;
+	}
+	// Nothing consumed the ring during that wait, so it overflowed : those drops are expected and are not reported as
+	// errors by IMU_reading_report(), which only counts the frames dropped from now on
+	printf("IMU frames dropped while waiting for the filtering to start: %lu\n",atomic_exchange(&IMU_ring.dropped,0));
 
-	gettimeofday(&before_imu, NULL); // Get initial read time
+	Periodic_task_start(&filter_task,"IMU filtering",IMU__READ_TIMESTEP); // Get initial read time
 	do {
-		check_time(&now_imu_glob,GLOBAL__TIME_STARTPOINT,elapsed_imu_glob,&time_imu_glob);
-
-		passive_wait(&now_imu,&before_imu,&elapsed_imu,&time_imu,IMU__READ_TIMESTEP); // Control execution frequency of the loop
-
-		// Register angles
-		psi_save=psi;
-		theta_save=theta;
-		phi_save=phi;
-		accelX_save=accelX;
-		accelY_save=accelY;
-		accelZ_save=accelZ;
-
-		// Zero out the angles
-		construct_zeroed_DCM();
-		zero_Euler_angles();
-		Find_raw_Euler_angular_velocities();
-		psi_save_last=psi_save; theta_save_last=theta_save; phi_save_last=phi_save; // Memorize the angles for next iteration
-
-
-		// Now that raw values have been read in, it is time to apply kalman filtering
-		Kalman_filter(&x_psi,&P_psi,psi_save,Q_psi,R_psi,dt,EYE2);
-		Kalman_filter(&x_psidot,&P_psidot,psi_dot,Q_psidot,R_psidot,dt,EYE2);
-		Kalman_filter(&x_theta,&P_theta,theta_save,Q_theta,R_theta,dt,EYE2);
-		Kalman_filter(&x_thetadot,&P_thetadot,theta_dot,Q_thetadot,R_thetadot,dt,EYE2);
-		Kalman_filter(&x_phi,&P_phi,phi_save,Q_phi,R_phi,dt,EYE2);
-		Kalman_filter(&x_phidot,&P_phidot,phi_dot,Q_phidot,R_phidot,dt,EYE2);
-		psi_filt=x_psi.matrix[0][0];
-		psi_dot_filt=x_psidot.matrix[0][0];
-		theta_filt=x_theta.matrix[0][0];
-		theta_dot_filt=x_thetadot.matrix[0][0];
-		phi_filt=x_phi.matrix[0][0];
-		phi_dot_filt=x_phidot.matrix[0][0];
-		wx=phi_dot_filt-psi_dot_filt*sin(theta_filt);
-		wy=theta_dot_filt*cos(phi_filt)+psi_dot_filt*cos(theta_filt)*sin(phi_filt);
-		wz=psi_dot_filt*cos(theta_filt)*cos(phi_filt)-theta_dot_filt*sin(phi_filt);
-
-		sprintf(IMU_MESSAGE,"%llu\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\n",time_imu_glob,dt,psi_save,theta_save,phi_save,psi_dot,theta_dot,phi_dot,psi_filt,theta_filt,phi_filt,psi_dot_filt,theta_dot_filt,phi_dot_filt,wx,wy,wz,accelX_save,accelY_save,accelZ_save);
-		write_to_file_custom(imu_log,IMU_MESSAGE,error_log);
+		if (IMU__FILTER_MODE==IMU_FILTER_MODE_EVENT) {
+			// Sleep until a frame has been pushed (time out now and then to check IMU_quit even if the IMU went silent)
+			if (poll(&frame_event,1,IMU_FILTER_EVENT_TIMEOUT)>0) {
+				if (read(IMU_frame_event,&event_count,sizeof(event_count))<0 && errno!=EAGAIN) { // Reset the event counter
+					perror("Failed to read the IMU frame event.");
+				}
+			}
+		} else {
+			Periodic_task_wait(&filter_task); // Control execution frequency of the loop
+		}
+
+		while (SPSC_ring_pop(&IMU_ring,&frame)==0) { // Filter every frame received since the last iteration
+			latency=Filter_IMU_frame(&frame,&epoch);
+			latency_sum+=latency;
+			if (latency>latency_max) latency_max=latency;
+		}
 	} while(!IMU_quit); // Continue reading sensor until quit
 
+	if (IMU__FILTER_MODE==IMU_FILTER_MODE_PERIODIC) Periodic_task_report(&filter_task);
+	if (epoch>0) {
+		printf("\nIMU reception-to-publish latency over %lu frames: average %llu [us], maximum %llu [us]\n",epoch,latency_sum/epoch,latency_max);
+	}
 	printf("\nQuitting filtering thread!\n");
 	pthread_exit(NULL); // Quit the pthread
 }
+
+/**
+ * @fn void Publish_attitude_snapshot(const struct Attitude_snapshot *snapshot)
+ *
+ * This function makes a new attitude estimate available to the other threads, replacing #attitude_snapshot as a whole.
+ * Only get_filtered_attitude_parallel() may call it. It never blocks.
+ *
+ * @param snapshot The new estimate.
+ */
+void Publish_attitude_snapshot(const struct Attitude_snapshot *snapshot) {
+	Seqlock_write(&attitude_snapshot_lock,&attitude_snapshot,snapshot,sizeof(struct Attitude_snapshot));
+}
+
+/**
+ * @fn void Get_attitude_snapshot(struct Attitude_snapshot *snapshot)
+ *
+ * This function copies the latest attitude estimate published by the filtering thread. All the fields of the copy
+ * come from the same filter update (check snapshot->epoch to know which one). Any thread may call it; it never takes a
+ * lock, the copy is only redone if the filtering thread was publishing at that very moment.
+ *
+ * @param snapshot Where to copy the estimate.
+ */
+void Get_attitude_snapshot(struct Attitude_snapshot *snapshot) {
+	Seqlock_read(&attitude_snapshot_lock,snapshot,&attitude_snapshot,sizeof(struct Attitude_snapshot));
+}
@@ -13,11 +13,94 @@
 #define IMU_HEADER_H_
 
 # include <termios.h>
+# include "la_header.h"
+# include "lockfree_header.h"
 
-# define MAX_BUFFER 24 ///< The max buffer size for receving data from IMU
+# include <stdatomic.h>
 
-unsigned char IMU_RX[MAX_BUFFER]; ///< Buffer holding received values via UART from Razor IMU
-char IMU_SYNCH_RECEIVE[1]; ///< Buffer used for receving the 2-character (2-byte) synch token from the IMU during sychronization.
+# define MAX_BUFFER 24 ///< Size of a frame of the Razor IMU (6 floats), hence of the receive buffer of #IMU_parser
+# define IMU_RING_SIZE 64 ///< Number of IMU frames that can wait in #IMU_ring for the filtering thread (power of 2)
+# define IMU_FILTER_MODE_PERIODIC 0 ///< #IMU__FILTER_MODE value : the filtering thread runs every IMU__READ_TIMESTEP and filters the frames queued up meanwhile
+# define IMU_FILTER_MODE_EVENT 1 ///< #IMU__FILTER_MODE value : read_IMU_parallel() wakes up the filtering thread for each frame it receives
+# define IMU_FILTER_EVENT_TIMEOUT 100 ///< [ms] Longest time the filtering thread sleeps on #IMU_frame_event before checking whether it must quit
+
+/**
+ * @name IMU framing
+ * The Razor IMU streams its frames back to back, without any marker : the frame boundaries are found with the sync
+ * token it sends back when asked "#s", and lost frame boundaries are noticed with the plausibility of the values (see
+ * IMU_parser_next()).
+ * @{
+ */
+# define IMU_SYNC_TOKEN "#S" ///< Token the Razor IMU sends back when asked "#s", followed by the first byte of a frame
+# define IMU_SYNC_TIMEOUT_MIN 100000 ///< [us] Time #IMU_SYNC_TOKEN is awaited after the first "#s" of a search, before "#s" is sent again
+# define IMU_SYNC_TIMEOUT_MAX 1600000 ///< [us] Longest time #IMU_SYNC_TOKEN is awaited (the timeout doubles after each unanswered "#s")
+# define IMU_SYNC_STARTUP_TIMEOUT 10000000 ///< [us] Time after the first "#s" after which the synchronization is given up at startup
+# define IMU_MAX_IMPLAUSIBLE_FRAMES 3 ///< Number of consecutive implausible frames after which the frame boundaries are considered lost
+# define IMU_PLAUSIBLE_ANGLE 3.2 ///< [rad] Largest plausible absolute value of psi, theta and phi (a little more than pi)
+# define IMU_PLAUSIBLE_ACCEL 1e4 ///< Largest plausible absolute value of the accelerations (raw Razor IMU units, far beyond the sensor range)
+/** @} */
+
+/**
+ * @name IMU time step bounds
+ * Time steps between frames used by the filtering (see IMU_frame_interval()), in IMU__READ_TIMESTEP periods.
+ * @{
+ */
+# define IMU_DT_MIN_PERIODS 0.5 ///< Shorter time steps mean that the frames arrived bunched up : IMU__READ_TIMESTEP is used instead
+# define IMU_DT_MAX_PERIODS 4 ///< Longer time steps (frames lost) are clamped to this
+/** @} */
+
+/**
+ * @name IMU frame time stamps
+ * Frames are stamped on the IMU__READ_TIMESTEP cadence of the Razor IMU rather than when they are read (see IMU_receive()).
+ * @{
+ */
+# define IMU_STAMP_GAIN 8 ///< The stamp moves by 1/#IMU_STAMP_GAIN of the difference between the reception and the cadence (follows the Razor IMU clock, smooths the reading jitter)
+# define IMU_STAMP_RESYNC_PERIODS 0.5 ///< Beyond this difference, in IMU__READ_TIMESTEP periods, the frame is stamped at its reception (frames lost, or stream restarted)
+/** @} */
+
+/**
+ * @name IMU parser results
+ * Values returned by IMU_parser_next()
+ * @{
+ */
+# define IMU_PARSER_FRAME 1 ///< A frame was decoded
+# define IMU_PARSER_NEED_DATA 0 ///< More bytes must be read into the parser
+# define IMU_PARSER_REQUEST_SYNC -1 ///< "#s" must be sent to the Razor IMU (the parser is looking for #IMU_SYNC_TOKEN)
+/** @} */
+
+/**
+ * @struct IMU_parser
+ * State of the decoding of the byte stream of the Razor IMU. The bytes are read directly into #buffer, at
+ * #length, and never more than those missing to complete the current frame (MAX_BUFFER-#length), so the buffer always
+ * starts at a frame boundary once synchronized and a short read simply leaves a partial frame for the next read.
+ */
+struct IMU_parser {
+	unsigned char buffer[MAX_BUFFER]; ///< Bytes received and not decoded yet
+	unsigned int length; ///< Number of bytes in #buffer
+	unsigned char synched; ///< 1 if #buffer starts at a frame boundary, 0 while looking for #IMU_SYNC_TOKEN
+	unsigned char sync_requested; ///< 1 if "#s" has been sent for the current search
+	unsigned int token_matched; ///< Number of characters of #IMU_SYNC_TOKEN matched so far
+	unsigned long long int request_time; ///< [us] Time at which "#s" was last sent (see IMU_receive())
+	unsigned long long int sync_timeout; ///< [us] Time #IMU_SYNC_TOKEN is awaited after the last "#s" (see #IMU_SYNC_TIMEOUT_MIN)
+	unsigned long long int startup_time; ///< [us] Time at which the first "#s" was sent
+	unsigned int implausible_run; ///< Number of consecutive implausible frames
+	unsigned long long int last_stamp; ///< [us] Time stamp of the last frame decoded (0 before the first, see IMU_receive())
+	unsigned long long int last_reception; ///< [us] Time at which the last frame decoded was received
+};
+
+/**
+ * @struct IMU_framing_statistics
+ * Framing errors of the Razor IMU stream, written by read_IMU_parallel() only and readable by any thread.
+ */
+struct IMU_framing_statistics {
+	atomic_ulong frames; ///< Number of frames decoded
+	atomic_ulong implausible; ///< Number of frames dropped because a value was out of the plausibility bounds (or not a number)
+	atomic_ulong losses; ///< Number of times the frame boundaries were lost (#IMU_MAX_IMPLAUSIBLE_FRAMES implausible frames in a row)
+	atomic_ulong sync_requests; ///< Number of "#s" sent
+	atomic_ulong discarded_bytes; ///< Number of bytes skipped while looking for #IMU_SYNC_TOKEN
+};
+
+extern struct IMU_framing_statistics IMU_framing; ///< Framing errors of the Razor IMU stream
 extern unsigned char IMU_TX[2]; ///< Buffer holding transmit message to IMU (call to send Euler angles NOW)
 int RAZOR_UART; ///< Holds Razor IMU connection file
 
@@ -27,29 +110,37 @@ struct termios old_razor_uart_options; ///< Old IMU UART connection options (tho
 extern unsigned long int CALIB__TIME; ///< Calibration time [us], i.e. microseconds
 
 /**
- * @name IMU reception group
- * variables holdin the raw values received from IMU
+ * @struct IMU_frame
+ * One decoded frame received from the Razor IMU, along with the time at which it was received.
  */
-/** @{ */
-float psi; ///< Yaw angle
-unsigned char yaw_bytes[4]; ///< Yaw angle bytes used for conversion to float
-float theta; ///< Pitch angle
-unsigned char pitch_bytes[4]; ///< Pitch angle bytes used for conversion to float
-float phi; ///< Roll angle
-unsigned char roll_bytes[4]; ///< Roll angle bytes used for conversion to float
-float accelX; ///< X-acceleration
-unsigned char accelX_bytes[4]; ///< X-acceleration angle bytes used for conversion to float
-float accelY; ///< Y-acceleration
-unsigned char accelY_bytes[4]; ///< Y-acceleration angle bytes used for conversion to float
-float accelZ; ///< Z-acceleration
-unsigned char accelZ_bytes[4]; ///< Z-acceleration angle bytes used for conversion to float
+struct IMU_frame {
+	unsigned long long int time; ///< Time stamp [us] since #GLOBAL__TIME_STARTPOINT of the frame, on the Razor IMU cadence (see IMU_receive())
+	float psi; ///< Yaw angle
+	float theta; ///< Pitch angle
+	float phi; ///< Roll angle
+	float accelX; ///< X-acceleration
+	float accelY; ///< Y-acceleration
+	float accelZ; ///< Z-acceleration
+};
+
+/**
+ * @name IMU frame queue
+ * Every frame decoded by read_IMU_parallel() is pushed into #IMU_ring, and the consumer (Calibrate_IMU(), then
+ * get_filtered_attitude_parallel()) pops all of them, so no sample is lost or read half-written.
+ * @{
+ */
+struct IMU_frame IMU_ring_buffer[IMU_RING_SIZE]; ///< Storage of #IMU_ring
+struct SPSC_ring IMU_ring; ///< Queue of received IMU frames, from read_IMU_parallel() to the filtering
+unsigned long long int IMU_last_frame_time; ///< Time stamp [us] of the last frame taken out of #IMU_ring (used to get the time step between frames)
+extern unsigned char IMU__FILTER_MODE; ///< When the filtering thread processes the queued frames (#IMU_FILTER_MODE_PERIODIC or #IMU_FILTER_MODE_EVENT)
+int IMU_frame_event; ///< eventfd signalled by read_IMU_parallel() after each push when #IMU__FILTER_MODE==#IMU_FILTER_MODE_EVENT
 /** @} */
 
 /**
  * @name Current accelerations
  * These are the accelerations saved into the filtering thread get_filtered_attitude_parallel()
- * when it does an iteration, hence they are equal to the most recent #accelX, #accelY and #accelZ that
- * have been read from the IMU. The filtering thread simply logs them into the #imu_log file.
+ * for each frame it processes, hence they are equal to the accelerations of the most recently filtered #IMU_frame.
+ * The filtering thread simply records them (see #IMU_record).
  */
 /** @{ */
 float accelX_save; ///< Saved X-acceleration
@@ -60,8 +151,7 @@ float accelZ_save; ///< Saved Z-acceleration
 /**
  * @name Current Euler angles group
  * These angles are the ones saved into the filtering thread get_filtered_attitude_parallel()
- * when it does an iteration, hence they are equal to the most recent #psi, #theta and #phi that
- * have been read from the IMU.
+ * for each frame it processes, hence they are equal to the angles of the most recently filtered #IMU_frame.
  */
 /** @{ */
 float psi_save; ///< Saved yaw angle
@@ -83,7 +173,8 @@ extern float phi_save_last;
 /**
  * @name Filtered Euler angles and angular rates
  * These are the filtered versions of the #psi_save, #theta_save and #phi_save signals and their numerical
- * derivatives (see Find_raw_Euler_angular_velocities()).
+ * derivatives (see Find_raw_Euler_angular_velocities()). Only the filtering thread may use them, other threads
+ * read the published #attitude_snapshot.
  */
 /** @{ */
 float psi_filt; ///< Filtered yaw
@@ -94,6 +185,30 @@ float phi_filt; ///< Filtered roll
 float phi_dot_filt; ///< Filtered roll rate
 /** @} */
 
+/**
+ * @struct Attitude_snapshot
+ * One consistent output of the filtering thread: the filtered Euler angles, their rates and the body rates computed
+ * from the same filter update. get_filtered_attitude_parallel() publishes one after every frame it filters (see
+ * Publish_attitude_snapshot()) and other threads (e.g. the control loop in main()) take a copy with
+ * Get_attitude_snapshot() instead of reading #psi_filt, #wx, etc. while they are being overwritten.
+ */
+struct Attitude_snapshot {
+	unsigned long int epoch; ///< Number of filter updates done when this snapshot was published (0 : no estimate yet)
+	unsigned long long int time; ///< Time stamp [us] of the IMU frame the estimate was computed from
+	float psi; ///< Filtered yaw
+	float psi_dot; ///< Filtered yaw rate
+	float theta; ///< Filtered pitch
+	float theta_dot; ///< Filtered pitch rate
+	float phi; ///< Filtered roll
+	float phi_dot; ///< Filtered roll rate
+	float wx; ///< X-body rate
+	float wy; ///< Y-body rate
+	float wz; ///< Z-body rate
+};
+
+struct Attitude_snapshot attitude_snapshot; ///< Latest published attitude estimate (only access through Publish_attitude_snapshot() and Get_attitude_snapshot())
+struct Seqlock attitude_snapshot_lock; ///< Sequence lock protecting #attitude_snapshot
+
 /**
  * @name Average Euler angles group
  * Average Euler angle values obtained during calibration (zeroing) period
@@ -131,12 +246,12 @@ char reply[30]; ///< User input string
 float temp1; ///< Temp variable used in min_of_set()
 float temp2; ///< Temp variable used in min_of_set()
 
-struct MATRIX R_MATRIX; ///< Matrix which zeroes the Euler angles for the calibrated orientation
-struct MATRIX DCM_MATRIX; ///< Direct Cosine Matrix
+struct MATRIX3x3 R_MATRIX; ///< Matrix which zeroes the Euler angles for the calibrated orientation
+struct MATRIX3x3 DCM_MATRIX; ///< Direct Cosine Matrix
 
 extern float dt;
 
-struct MATRIX EYE2; ///< [2x2] identity matrix, used in Kalman_filter()
+struct MATRIX2x2 EYE2; ///< [2x2] identity matrix, used in Kalman_filter()
 
 //%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%% FUNCTION DECLARATIONS %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 /** @cond INCLUDE_WITH_DOXYGEN */
@@ -144,18 +259,32 @@ void close_port(int fd);
 void open_serial_port(int *fd,char *directory);
 void get_old_attr(int fd, struct termios *old_options);
 void set_to_blocking(int fd);
+void set_to_nonblocking(int fd);
 void set_new_attr(int fd, struct termios *old_options, struct termios *new_options);
 void reset_old_attr_port(int fd, struct termios *old_options);
 float min_of_set(float now, float before);
 void Treat_reply(char *comparison_string);
 void construct_zeroed_DCM();
-void Find_raw_Euler_angular_velocities();
+unsigned long long int IMU_frame_interval(unsigned long long int time, unsigned long long int last_time);
+void Find_raw_Euler_angular_velocities(unsigned long long int sample_time);
 float TO_DEG(float angle);
 void zero_Euler_angles();
 void Calibrate_IMU();
-void Kalman_filter(struct MATRIX *x,struct MATRIX *P,float z,struct MATRIX Q,struct MATRIX R,float dt,struct MATRIX EYE2);
+void Kalman_filter(struct MATRIX2x1 *x,struct MATRIX2x2 *P,float z,const struct MATRIX2x2 *Q,const struct MATRIX1x1 *R,float dt,const struct MATRIX2x2 *EYE2);
+void Kalman_filter_cv(struct MATRIX2x1 *x,struct MATRIX2x2 *P,float z,const struct MATRIX2x2 *Q,const struct MATRIX1x1 *R,float dt);
+void IMU_parser_init(struct IMU_parser *parser);
+int IMU_parser_next(struct IMU_parser *parser, struct IMU_frame *frame);
+void IMU_configure_stream(void);
+void IMU_receive(struct IMU_parser *parser, unsigned long long int time);
+void IMU_reading_report(void);
+void IMU_set_synched(void);
+void IMU_wait_synched(void);
 void *read_IMU_parallel(void *args);
+unsigned long long int Filter_IMU_frame(const struct IMU_frame *frame, unsigned long int *epoch);
+unsigned int IMU_timing_self_test(void);
 void *get_filtered_attitude_parallel(void *args);
+void Publish_attitude_snapshot(const struct Attitude_snapshot *snapshot);
+void Get_attitude_snapshot(struct Attitude_snapshot *snapshot);
 /** @endcond */
 
 #endif /* IMU_HEADER_H_ */
@@ -0,0 +1,347 @@
+/**
+ * @file io_funcs.c
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief I/O reactor functions file
+ *
+ * This file contains the I/O reactor : a single thread, IO_reactor_parallel(), which waits with epoll on all the
+ * devices (the Razor IMU and MSP430 UARTs, a timerfd for the periodic SPI reading of the pressure sensors and the
+ * eventfd of the PWM commands) and calls the handler of each one that is ready. The decoded data is handed to its
+ * consumers through the same queues as in the one-thread-per-device mode (#IMU_ring, the flight recorder, #PWM_mailbox),
+ * so the consumers do not depend on #IO__MODE. Serving all the devices from one thread saves threads and context
+ * switches on the single-core Raspberry Pi, and the time spent handling each device is measured in one place (see
+ * #IO_source).
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <unistd.h>
+# include <errno.h>
+# include <termios.h>
+# include <sys/epoll.h>
+# include <sys/timerfd.h>
+# include <linux/spi/spidev.h>
+# include "io_header.h"
+# include "master_header.h"
+# include "imu_header.h"
+# include "msp430_header.h"
+# include "pressure_header.h"
+# include "timebase_header.h"
+
+struct IO_reactor_state IO_reactor; ///< The I/O reactor
+
+/**
+ * @fn static unsigned long long int monotonic_ns(void)
+ *
+ * This function returns the current time in [ns] on CLOCK_MONOTONIC, the clock of the timerfd sources.
+ */
+static unsigned long long int monotonic_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (unsigned long long int)now.tv_sec*1000000000ULL+(unsigned long long int)now.tv_nsec;
+}
+
+/**
+ * @fn void IO_reactor_init(void)
+ *
+ * This function creates the epoll instance of the reactor, before IO_reactor_parallel() is started and any source is
+ * added.
+ */
+void IO_reactor_init(void) {
+	memset(&IO_reactor,0,sizeof(IO_reactor));
+	if ((IO_reactor.epoll_fd=epoll_create1(EPOLL_CLOEXEC))<0) {
+		perror("Failed to create the I/O reactor epoll instance.");
+		exit(-2);
+	}
+	if (pthread_mutex_init(&IO_reactor.lock,NULL)!=0) {
+		perror("Failed to initialize the I/O reactor mutex.");
+		exit(-2);
+	}
+}
+
+/**
+ * @fn static void IO_register(struct IO_source *source, const char *name, int fd, void (*handle)(struct IO_source *source), void (*tick)(struct IO_source *source), void *context)
+ *
+ * This function registers an initialized source into the epoll instance and the source list of the reactor (see
+ * IO_reactor_add()).
+ */
+static void IO_register(struct IO_source *source, const char *name, int fd, void (*handle)(struct IO_source *source), void (*tick)(struct IO_source *source), void *context) {
+	struct epoll_event event;
+	int slot;
+
+	source->name=name;
+	source->fd=fd;
+	source->handle=handle;
+	source->tick=tick;
+	source->context=context;
+	memset(&event,0,sizeof(event));
+	event.events=EPOLLIN;
+	event.data.ptr=source;
+	pthread_mutex_lock(&IO_reactor.lock);
+	for (slot=0;slot<IO_REACTOR_MAX_SOURCES && IO_reactor.sources[slot]!=NULL;slot++);
+	if (slot==IO_REACTOR_MAX_SOURCES || epoll_ctl(IO_reactor.epoll_fd,EPOLL_CTL_ADD,fd,&event)<0) {
+		sprintf(ERROR_MESSAGE,"Failed to add the %s source to the I/O reactor (%s).\n",name,(slot==IO_REACTOR_MAX_SOURCES) ? "too many sources" : strerror(errno));
+		printf("%s",ERROR_MESSAGE);
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+		exit(-2);
+	}
+	IO_reactor.sources[slot]=source;
+	source->registered=1;
+	pthread_mutex_unlock(&IO_reactor.lock);
+}
+
+/**
+ * @fn void IO_reactor_add(struct IO_source *source, const char *name, int fd, void (*handle)(struct IO_source *source), void (*tick)(struct IO_source *source), void *context)
+ *
+ * This function registers a source into the reactor, which calls handle from now on each time fd is readable. It may
+ * be called while IO_reactor_parallel() runs. The device behind fd should be non-blocking, since the handler reads
+ * all that is available.
+ *
+ * @param source The source (must live until it is removed).
+ * @param name Name of the source, for the statistics.
+ * @param fd File descriptor to watch.
+ * @param handle Handler of the input.
+ * @param tick Handler called every #IO_REACTOR_TICK, or NULL.
+ * @param context State of the handlers.
+ */
+void IO_reactor_add(struct IO_source *source, const char *name, int fd, void (*handle)(struct IO_source *source), void (*tick)(struct IO_source *source), void *context) {
+	memset(source,0,sizeof(struct IO_source));
+	IO_register(source,name,fd,handle,tick,context);
+}
+
+/**
+ * @fn void IO_reactor_add_timer(struct IO_source *source, const char *name, unsigned long long int period, void (*handle)(struct IO_source *source), void *context)
+ *
+ * This function registers a periodic source : handle is called every period, starting one period from now. The
+ * expirations are absolute (first expiration + k*period), so the handling time does not accumulate into drift ; the
+ * periods missed because the reactor was busy are counted, and handled only once.
+ *
+ * @param source The source (must live until it is removed).
+ * @param name Name of the source, for the statistics.
+ * @param period [us] Period.
+ * @param handle Handler called every period.
+ * @param context State of the handler.
+ */
+void IO_reactor_add_timer(struct IO_source *source, const char *name, unsigned long long int period, void (*handle)(struct IO_source *source), void *context) {
+	struct itimerspec timer;
+	int fd;
+
+	if ((fd=timerfd_create(CLOCK_MONOTONIC,TFD_NONBLOCK|TFD_CLOEXEC))<0) {
+		perror("Failed to create an I/O reactor timer.");
+		exit(-2);
+	}
+	memset(source,0,sizeof(struct IO_source));
+	source->period=period*1000;
+	source->first_expiry=monotonic_ns()+source->period;
+	timer.it_value.tv_sec=source->first_expiry/1000000000ULL;
+	timer.it_value.tv_nsec=source->first_expiry%1000000000ULL;
+	timer.it_interval.tv_sec=source->period/1000000000ULL;
+	timer.it_interval.tv_nsec=source->period%1000000000ULL;
+	if (timerfd_settime(fd,TFD_TIMER_ABSTIME,&timer,NULL)<0) {
+		perror("Failed to start an I/O reactor timer.");
+		exit(-2);
+	}
+	IO_register(source,name,fd,handle,NULL,context);
+}
+
+/**
+ * @fn void IO_reactor_remove(struct IO_source *source)
+ *
+ * This function unregisters a source and prints its statistics (also writing them to the #error_log if a timer source
+ * missed periods). Once it returns, the handlers of the source are no longer called, so the caller owns the device
+ * again. The timerfd of a timer source is closed.
+ *
+ * @param source The source.
+ */
+void IO_reactor_remove(struct IO_source *source) {
+	char REPORT[300];
+	int slot;
+
+	pthread_mutex_lock(&IO_reactor.lock); // Waits for the dispatching in progress, if any
+	if (!source->registered) {
+		pthread_mutex_unlock(&IO_reactor.lock);
+		return;
+	}
+	epoll_ctl(IO_reactor.epoll_fd,EPOLL_CTL_DEL,source->fd,NULL);
+	for (slot=0;slot<IO_REACTOR_MAX_SOURCES;slot++) {
+		if (IO_reactor.sources[slot]==source) IO_reactor.sources[slot]=NULL;
+	}
+	source->registered=0;
+	pthread_mutex_unlock(&IO_reactor.lock);
+	if (source->period>0) close(source->fd);
+
+	if (source->period>0) {
+		sprintf(REPORT,"%s I/O: %lu periods of %llu [us] handled (%lu missed), lateness average %llu [us] maximum %llu [us], handling average %llu [us] maximum %llu [us]\n",
+			source->name,source->dispatches,source->period/1000,source->missed,(source->dispatches>0) ? source->lateness_sum/source->dispatches/1000 : 0,source->lateness_max/1000,
+			(source->dispatches>0) ? source->handling_sum/source->dispatches/1000 : 0,source->handling_max/1000);
+	} else {
+		sprintf(REPORT,"%s I/O: %lu events handled, handling average %llu [us] maximum %llu [us]\n",
+			source->name,source->dispatches,(source->dispatches>0) ? source->handling_sum/source->dispatches/1000 : 0,source->handling_max/1000);
+	}
+	printf("%s",REPORT);
+	if (source->missed>0) {
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,REPORT,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+	}
+}
+
+/**
+ * @fn static void IO_dispatch(struct IO_source *source)
+ *
+ * This function calls the handler of a ready source and measures it. For a timer source, the expirations are read
+ * first, and the lateness is that of the last expiration.
+ *
+ * @param source The source.
+ */
+static void IO_dispatch(struct IO_source *source) {
+	uint64_t expirations;
+	unsigned long long int start, lateness;
+
+	start=monotonic_ns();
+	if (source->period>0) {
+		if (read(source->fd,&expirations,sizeof(expirations))!=sizeof(expirations) || expirations==0) return; // Already read (spurious wake-up)
+		source->expirations+=expirations;
+		source->missed+=expirations-1;
+		lateness=start-(source->first_expiry+(source->expirations-1)*source->period);
+		source->lateness_sum+=lateness;
+		if (lateness>source->lateness_max) source->lateness_max=lateness;
+	}
+	source->handle(source);
+	source->dispatches++;
+	start=monotonic_ns()-start;
+	source->handling_sum+=start;
+	if (start>source->handling_max) source->handling_max=start;
+}
+
+/**
+ * @fn void *IO_reactor_parallel(void *args)
+ *
+ * This is the (p)thread serving all the devices when #IO__MODE is #IO_MODE_REACTOR. It sleeps in epoll_wait() until a
+ * source is ready (or for at most #IO_REACTOR_TICK), calls the handlers of the ready sources, and the tick handlers
+ * every #IO_REACTOR_TICK. The sources are added and removed by the main thread as the devices come and go during the
+ * flight (see IO_reactor_add() and IO_reactor_remove()).
+ *
+ * @param args A pointer to the input arguments (we have none for this thread)
+ */
+void *IO_reactor_parallel(void *args) {
+	struct epoll_event events[IO_REACTOR_MAX_SOURCES];
+	struct IO_source *source;
+	unsigned long long int last_tick=monotonic_ns(), now;
+	int ready, k;
+
+	Thread_set_realtime("I/O reactor",&IO__RT);
+	while (!IO_quit) {
+		if ((ready=epoll_wait(IO_reactor.epoll_fd,events,IO_REACTOR_MAX_SOURCES,IO_REACTOR_TICK))<0) {
+			if (errno==EINTR) continue;
+			perror("I/O reactor epoll_wait() failed.");
+			exit(-2);
+		}
+		pthread_mutex_lock(&IO_reactor.lock);
+		IO_reactor.wakeups++;
+		for (k=0;k<ready;k++) {
+			source=(struct IO_source *)events[k].data.ptr;
+			if (source->registered) IO_dispatch(source); // Not if it was removed since epoll_wait() returned
+		}
+		now=monotonic_ns();
+		if (now-last_tick>=IO_REACTOR_TICK*1000000ULL) {
+			last_tick=now;
+			for (k=0;k<IO_REACTOR_MAX_SOURCES;k++) {
+				source=IO_reactor.sources[k];
+				if (source!=NULL && source->tick!=NULL) source->tick(source);
+			}
+		}
+		pthread_mutex_unlock(&IO_reactor.lock);
+	}
+	printf("\nQuitting I/O reactor thread (%lu wake-ups)!\n",IO_reactor.wakeups);
+	close(IO_reactor.epoll_fd);
+	pthread_exit(NULL); // Quit the pthread
+}
+
+/**
+ * @fn void IO_pressure_handle(struct IO_source *source)
+ *
+ * This is the handler of the timer source reading the pressure sensors every Pressure_sample_period() (see
+ * Pressure_read_sensors()). The context is the #SPI_data of the sensors.
+ *
+ * @param source The source.
+ */
+void IO_pressure_handle(struct IO_source *source) {
+	Pressure_read_sensors((const struct SPI_data *)source->context);
+}
+
+/**
+ * @fn void IO_razor_handle(struct IO_source *source)
+ *
+ * This is the handler of #RAZOR_UART (made non-blocking) : it reads all the bytes available into the #IMU_parser of
+ * the context, never more than the rest of the current frame at once, and hands them to IMU_receive(). #IMU_SYNCHED is
+ * set once the frame boundaries have been found.
+ *
+ * @param source The source.
+ */
+void IO_razor_handle(struct IO_source *source) {
+	struct IMU_parser *parser=(struct IMU_parser *)source->context;
+	ssize_t received;
+
+	while ((received=read(source->fd,parser->buffer+parser->length,MAX_BUFFER-parser->length))>0) {
+		parser->length+=received;
+		IMU_receive(parser,time_since_start_us());
+	}
+	if (received<0 && errno!=EAGAIN && errno!=EINTR) {
+		perror("Unable to read from Razor IMU UART.\n");
+		exit(-2); // Exit with failure
+	}
+	if (parser->synched && !IMU_SYNCHED) IMU_set_synched(); // Notify others that synchronization has been done
+}
+
+/**
+ * @fn void IO_razor_tick(struct IO_source *source)
+ *
+ * This is the tick handler of #RAZOR_UART : it sends the first "#s" and, while the sync token is awaited, checks its
+ * timeout even if the Razor IMU is silent (see IMU_receive()).
+ *
+ * @param source The source.
+ */
+void IO_razor_tick(struct IO_source *source) {
+	struct IMU_parser *parser=(struct IMU_parser *)source->context;
+
+	if (!parser->synched) IMU_receive(parser,time_since_start_us());
+}
+
+/**
+ * @fn void IO_msp430_handle(struct IO_source *source)
+ *
+ * This is the handler of #MSP430_UART (made non-blocking) during the flight : it hands all the bytes available to
+ * MSP430_receive_telemetry().
+ *
+ * @param source The source.
+ */
+void IO_msp430_handle(struct IO_source *source) {
+	unsigned char bytes[4*MSP430_TELEMETRY_SIZE];
+	ssize_t received;
+
+	while ((received=read(source->fd,bytes,sizeof(bytes)))>0) {
+		MSP430_receive_telemetry(bytes,received,time_since_start_us());
+	}
+}
+
+/**
+ * @fn void IO_PWM_command_handle(struct IO_source *source)
+ *
+ * This is the handler of #PWM_command_event : it sends the latest PWM command posted by the control loop with
+ * MSP430_send_posted_PWM().
+ *
+ * @param source The source.
+ */
+void IO_PWM_command_handle(struct IO_source *source) {
+	uint64_t event_count;
+
+	if (read(source->fd,&event_count,sizeof(event_count))<0 && errno!=EAGAIN) { // Reset the event counter
+		perror("Failed to read the PWM command event.");
+	}
+	MSP430_send_posted_PWM();
+}
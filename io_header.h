@@ -0,0 +1,77 @@
+/**
+ * @file io_header.h
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief I/O reactor header file
+ *
+ * This is the header to io_funcs.c containing necessary definitions and
+ * initializations.
+ */
+
+#ifndef IO_HEADER_H_
+#define IO_HEADER_H_
+
+# include <pthread.h>
+# include "scheduler_header.h"
+
+# define IO_MODE_THREADS 0 ///< #IO__MODE value : each device is served by its own thread (read_IMU_parallel(), get_readings_SPI_parallel(), MSP430_write_PWM_parallel() and MSP430_read_telemetry_parallel())
+# define IO_MODE_REACTOR 1 ///< #IO__MODE value : all the devices are served by the single IO_reactor_parallel() thread (except the pressure sensors when they are read at a high rate, see get_readings_SPI_parallel())
+# define IO_REACTOR_MAX_SOURCES 8 ///< Largest number of sources registered at once
+# define IO_REACTOR_TICK 100 ///< [ms] Period of the tick handlers (see #IO_source), which is also the longest time the reactor sleeps before checking whether it must quit
+
+/**
+ * @struct IO_source
+ * A file descriptor served by IO_reactor_parallel() : a device, an eventfd, or a timerfd (see IO_reactor_add_timer()).
+ * The handlers are called by the reactor thread only, one at a time, so they own the device while it is registered.
+ * The statistics are written by the reactor thread and printed when the source is removed (see IO_reactor_remove()).
+ */
+struct IO_source {
+	const char *name; ///< Name used when reporting the statistics
+	int fd; ///< File descriptor watched for input
+	void (*handle)(struct IO_source *source); ///< Called when #fd is readable (for a timer, once per period, after the expirations were read)
+	void (*tick)(struct IO_source *source); ///< Called every #IO_REACTOR_TICK (may be NULL), e.g. for the timeouts of a device that may be silent
+	void *context; ///< State of the handlers
+	unsigned char registered; ///< 1 while the reactor serves the source
+	unsigned long long int period; ///< [ns] Period of a timer source, 0 for other sources
+	unsigned long long int first_expiry; ///< [ns] CLOCK_MONOTONIC time of the first expiration of a timer source
+	unsigned long long int expirations; ///< Number of expirations of a timer source so far
+	unsigned long int dispatches; ///< Number of calls to #handle
+	unsigned long int missed; ///< Number of periods of a timer source that were not handled because the reactor was late
+	unsigned long long int handling_sum; ///< [ns] Sum of the durations of the calls to #handle
+	unsigned long long int handling_max; ///< [ns] Longest call to #handle
+	unsigned long long int lateness_sum; ///< [ns] Sum of the delays between the expiration of a timer source and the call to #handle
+	unsigned long long int lateness_max; ///< [ns] Largest such delay
+};
+
+/**
+ * @struct IO_reactor_state
+ * The epoll instance of IO_reactor_parallel() and the sources registered into it. #lock is held by the reactor
+ * while it dispatches, so a source is never handled once IO_reactor_remove() has returned.
+ */
+struct IO_reactor_state {
+	int epoll_fd; ///< The epoll instance
+	pthread_mutex_t lock; ///< Protects #sources, held during the dispatching
+	struct IO_source *sources[IO_REACTOR_MAX_SOURCES]; ///< Registered sources (NULL for a free slot)
+	unsigned long int wakeups; ///< Number of times the reactor woke up (written by the reactor thread only)
+};
+
+extern struct IO_reactor_state IO_reactor; ///< The I/O reactor
+extern unsigned char IO__MODE; ///< How the devices are served (#IO_MODE_THREADS or #IO_MODE_REACTOR)
+extern unsigned char IO_quit; ///< ==0 by default, ==1 signals the I/O reactor thread (IO_reactor_parallel()) to exit.
+extern struct RT_config IO__RT; ///< I/O reactor thread (IO_reactor_parallel())
+
+/** @cond INCLUDE_WITH_DOXYGEN */
+void IO_reactor_init(void);
+void IO_reactor_add(struct IO_source *source, const char *name, int fd, void (*handle)(struct IO_source *source), void (*tick)(struct IO_source *source), void *context);
+void IO_reactor_add_timer(struct IO_source *source, const char *name, unsigned long long int period, void (*handle)(struct IO_source *source), void *context);
+void IO_reactor_remove(struct IO_source *source);
+void *IO_reactor_parallel(void *args);
+void IO_pressure_handle(struct IO_source *source);
+void IO_razor_handle(struct IO_source *source);
+void IO_razor_tick(struct IO_source *source);
+void IO_msp430_handle(struct IO_source *source);
+void IO_PWM_command_handle(struct IO_source *source);
+/** @endcond */
+
+#endif /* IO_HEADER_H_ */
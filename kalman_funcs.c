@@ -0,0 +1,238 @@
+/**
+ * @file kalman_funcs.c
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Kalman filter bank functions file.
+ *
+ * This file contains the batched version of Kalman_filter_cv() which advances all of the
+ * attitude filters (psi, psi_dot, theta, theta_dot, phi, phi_dot) at once. The filters are
+ * stored as a structure-of-arrays (see #Kalman_bank) and updated 4 channels at a time with
+ * NEON (ARM) or SSE (x86) vector instructions, whichever the compiler targets. If neither is
+ * available (e.g. the ARMv6 Raspberry Pi Model B+), a plain scalar loop is compiled instead.
+ */
+
+# include <math.h>
+# include <string.h>
+# include "kalman_header.h"
+# include "imu_header.h"
+# include "master_header.h"
+
+# if defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define KALMAN_BANK_VECTOR
+typedef float32x4_t vec4; ///< 4 packed floats
+# define VLOAD(p) vld1q_f32(p)
+# define VSTORE(p,a) vst1q_f32(p,a)
+# define VSET1(s) vdupq_n_f32(s)
+# define VADD(a,b) vaddq_f32(a,b)
+# define VSUB(a,b) vsubq_f32(a,b)
+# define VMUL(a,b) vmulq_f32(a,b)
+static inline vec4 VRECIP(vec4 a) { // No vector division on ARMv7 : estimate 1/a and refine with 2 Newton-Raphson steps
+	vec4 r = vrecpeq_f32(a);
+	r = vmulq_f32(vrecpsq_f32(a,r),r);
+	return vmulq_f32(vrecpsq_f32(a,r),r);
+}
+const char KALMAN_BANK_IMPLEMENTATION[] = "NEON";
+# elif defined(__SSE__)
+# include <xmmintrin.h>
+# define KALMAN_BANK_VECTOR
+typedef __m128 vec4; ///< 4 packed floats
+# define VLOAD(p) _mm_load_ps(p)
+# define VSTORE(p,a) _mm_store_ps(p,a)
+# define VSET1(s) _mm_set1_ps(s)
+# define VADD(a,b) _mm_add_ps(a,b)
+# define VSUB(a,b) _mm_sub_ps(a,b)
+# define VMUL(a,b) _mm_mul_ps(a,b)
+# define VRECIP(a) _mm_div_ps(_mm_set1_ps(1.0f),a)
+const char KALMAN_BANK_IMPLEMENTATION[] = "SSE";
+# else
+const char KALMAN_BANK_IMPLEMENTATION[] = "scalar";
+# endif
+
+/**
+ * @fn void Kalman_bank_init(struct Kalman_bank *bank)
+ *
+ * This function clears the filter bank. The padding lanes are given a unit covariance and observation noise so that
+ * they never divide by zero when updated along with the real channels.
+ *
+ * @param bank The filter bank.
+ */
+void Kalman_bank_init(struct Kalman_bank *bank) {
+	int ii;
+	memset(bank,0,sizeof(struct Kalman_bank));
+	for (ii=KALMAN_BANK_CHANNELS;ii<KALMAN_BANK_WIDTH;ii++) {
+		bank->p00[ii]=1; bank->p11[ii]=1; bank->r[ii]=1;
+	}
+}
+
+/**
+ * @fn void Kalman_bank_set_channel(struct Kalman_bank *bank,int channel,const struct MATRIX2x1 *x,const struct MATRIX2x2 *P,const struct MATRIX2x2 *Q,const struct MATRIX1x1 *R)
+ *
+ * This function loads the filter matrices of one signal (e.g. #x_psi, #P_psi, #Q_psi, #R_psi) into a lane of the filter bank.
+ *
+ * @param bank The filter bank.
+ * @param channel The channel (e.g. #KALMAN_PSI).
+ * @param x Initial state estimate.
+ * @param P Initial estimate covariance (symmetric).
+ * @param Q Covariance matrix of process noise (symmetric).
+ * @param R Covariance matrix of observation noise.
+ */
+void Kalman_bank_set_channel(struct Kalman_bank *bank,int channel,const struct MATRIX2x1 *x,const struct MATRIX2x2 *P,const struct MATRIX2x2 *Q,const struct MATRIX1x1 *R) {
+	bank->x0[channel]=x->matrix[0][0];
+	bank->x1[channel]=x->matrix[1][0];
+	bank->p00[channel]=P->matrix[0][0];
+	bank->p01[channel]=P->matrix[0][1];
+	bank->p11[channel]=P->matrix[1][1];
+	bank->q00[channel]=Q->matrix[0][0];
+	bank->q01[channel]=Q->matrix[0][1];
+	bank->q11[channel]=Q->matrix[1][1];
+	bank->r[channel]=R->matrix[0][0];
+}
+
+/**
+ * @fn void Kalman_bank_get_channel(const struct Kalman_bank *bank,int channel,struct MATRIX2x1 *x,struct MATRIX2x2 *P)
+ *
+ * This function reads back the current state estimate and covariance of one lane of the filter bank.
+ *
+ * @param bank The filter bank.
+ * @param channel The channel (e.g. #KALMAN_PSI).
+ * @param x The state estimate.
+ * @param P The estimate covariance.
+ */
+void Kalman_bank_get_channel(const struct Kalman_bank *bank,int channel,struct MATRIX2x1 *x,struct MATRIX2x2 *P) {
+	x->matrix[0][0]=bank->x0[channel];
+	x->matrix[1][0]=bank->x1[channel];
+	P->matrix[0][0]=bank->p00[channel];
+	P->matrix[0][1]=bank->p01[channel];
+	P->matrix[1][0]=bank->p01[channel];
+	P->matrix[1][1]=bank->p11[channel];
+}
+
+/**
+ * @fn void Kalman_bank_update(struct Kalman_bank *bank,const float *z,float dt)
+ *
+ * This function applies one step of Kalman_filter_cv() to every channel of the filter bank.
+ *
+ * @param bank The filter bank.
+ * @param z The #KALMAN_BANK_CHANNELS noisy signals, indexed by channel (e.g. z[#KALMAN_THETA] is #theta_save).
+ * @param dt The time step.
+ */
+void Kalman_bank_update(struct Kalman_bank *bank,const float *z,float dt) {
+	float z_pad[KALMAN_BANK_WIDTH] __attribute__((aligned(16)));
+	int ii;
+	memcpy(z_pad,z,KALMAN_BANK_CHANNELS*sizeof(float));
+	for (ii=KALMAN_BANK_CHANNELS;ii<KALMAN_BANK_WIDTH;ii++) {
+		z_pad[ii]=0;
+	}
+# ifdef KALMAN_BANK_VECTOR
+	vec4 DT = VSET1(dt);
+	vec4 x0, x1, p00, p01, p01_pred, p11, inn, S_inv, K0, K1;
+	for (ii=0;ii<KALMAN_BANK_WIDTH;ii+=4) {
+		// Prediction : x=A*x, P=A*P*A'+Q
+		x1 = VLOAD(&bank->x1[ii]);
+		x0 = VADD(VLOAD(&bank->x0[ii]),VMUL(DT,x1));
+		p11 = VLOAD(&bank->p11[ii]);
+		p01 = VLOAD(&bank->p01[ii]);
+		p01_pred = VADD(p01,VMUL(DT,p11));
+		p00 = VADD(VADD(VLOAD(&bank->p00[ii]),VMUL(DT,VADD(p01,p01_pred))),VLOAD(&bank->q00[ii]));
+		p01 = VADD(p01_pred,VLOAD(&bank->q01[ii]));
+		p11 = VADD(p11,VLOAD(&bank->q11[ii]));
+
+		// Update : inn=z-C*x, S=C*P*C'+R, K=P*C'*inv(S)
+		inn = VSUB(VLOAD(&z_pad[ii]),x0);
+		S_inv = VRECIP(VADD(p00,VLOAD(&bank->r[ii])));
+		K0 = VMUL(p00,S_inv);
+		K1 = VMUL(p01,S_inv);
+
+		VSTORE(&bank->x0[ii],VADD(x0,VMUL(K0,inn)));
+		VSTORE(&bank->x1[ii],VADD(x1,VMUL(K1,inn)));
+		VSTORE(&bank->p00[ii],VSUB(p00,VMUL(K0,p00)));
+		VSTORE(&bank->p11[ii],VSUB(p11,VMUL(K1,p01)));
+		VSTORE(&bank->p01[ii],VSUB(p01,VMUL(K0,p01)));
+	}
+# else
+	float x0, x1, p00, p01, p11, inn, S_inv, K0, K1;
+	for (ii=0;ii<KALMAN_BANK_CHANNELS;ii++) { // Same operations as Kalman_filter_cv()
+		x1 = bank->x1[ii];
+		x0 = bank->x0[ii]+dt*x1;
+		p11 = bank->p11[ii];
+		p01 = bank->p01[ii]+dt*p11;
+		p00 = bank->p00[ii]+dt*(bank->p01[ii]+p01)+bank->q00[ii];
+		p01 = p01+bank->q01[ii];
+		p11 = p11+bank->q11[ii];
+
+		inn = z_pad[ii]-x0;
+		S_inv = 1/(p00+bank->r[ii]);
+		K0 = p00*S_inv;
+		K1 = p01*S_inv;
+
+		bank->x0[ii] = x0+K0*inn;
+		bank->x1[ii] = x1+K1*inn;
+		bank->p00[ii] = p00-K0*p00;
+		bank->p01[ii] = p01-K0*p01;
+		bank->p11[ii] = p11-K1*p01;
+	}
+# endif
+}
+
+/**
+ * @fn float Kalman_bank_self_test(const struct Kalman_bank *bank)
+ *
+ * This function checks the filter bank against the reference matrix implementation Kalman_filter() and against the
+ * scalar closed form Kalman_filter_cv() it batches. A copy of the bank and, for each channel, two copies of its matrices
+ * are fed the same synthetic signal (a slow sine plus deterministic pseudo-noise, with a jittering time step) for a few
+ * seconds' worth of samples. The bank itself is not modified. Kalman_filter() uses #A_kalman, #C_kalman and #EYE2, so
+ * these must have been set up before calling this function.
+ *
+ * @param bank The filter bank, as set up for flight.
+ *
+ * @return The largest absolute difference between the state estimates of the bank, of Kalman_filter() and of
+ * Kalman_filter_cv(). It should stay below #KALMAN_BANK_TOLERANCE.
+ */
+float Kalman_bank_self_test(const struct Kalman_bank *bank) {
+	struct Kalman_bank test_bank = *bank;
+	struct MATRIX2x1 x[KALMAN_BANK_CHANNELS];
+	struct MATRIX2x2 P[KALMAN_BANK_CHANNELS];
+	struct MATRIX2x1 x_cv[KALMAN_BANK_CHANNELS];
+	struct MATRIX2x2 P_cv[KALMAN_BANK_CHANNELS];
+	struct MATRIX2x2 Q;
+	struct MATRIX1x1 R;
+	float z[KALMAN_BANK_CHANNELS];
+	float dt_test;
+	float error;
+	float max_error=0;
+	unsigned int seed=12345;
+	int ii; int kk;
+
+	for (ii=0;ii<KALMAN_BANK_CHANNELS;ii++) {
+		Kalman_bank_get_channel(bank,ii,&x[ii],&P[ii]);
+		x_cv[ii]=x[ii]; P_cv[ii]=P[ii];
+	}
+
+	for (kk=0;kk<500;kk++) {
+		dt_test = 0.02+0.0002*(kk%5);
+		for (ii=0;ii<KALMAN_BANK_CHANNELS;ii++) {
+			seed = seed*1103515245+12345; // Linear congruential pseudo-noise, identical on every platform
+			z[ii] = (ii+1)*0.1*sin(0.01*kk*(ii+1))+0.01*((float)((seed>>16)&0x7FFF)/32767.0-0.5);
+		}
+		Kalman_bank_update(&test_bank,z,dt_test);
+		for (ii=0;ii<KALMAN_BANK_CHANNELS;ii++) {
+			Q.matrix[0][0]=bank->q00[ii];	Q.matrix[0][1]=bank->q01[ii];
+			Q.matrix[1][0]=bank->q01[ii];	Q.matrix[1][1]=bank->q11[ii];
+			R.matrix[0][0]=bank->r[ii];
+			Kalman_filter(&x[ii],&P[ii],z[ii],&Q,&R,dt_test,&EYE2);
+			Kalman_filter_cv(&x_cv[ii],&P_cv[ii],z[ii],&Q,&R,dt_test);
+
+			error = fabs(test_bank.x0[ii]-x[ii].matrix[0][0]);
+			if (error>max_error) max_error=error;
+			error = fabs(test_bank.x1[ii]-x[ii].matrix[1][0]);
+			if (error>max_error) max_error=error;
+			error = fabs(x_cv[ii].matrix[0][0]-x[ii].matrix[0][0]);
+			if (error>max_error) max_error=error;
+			error = fabs(x_cv[ii].matrix[1][0]-x[ii].matrix[1][0]);
+			if (error>max_error) max_error=error;
+		}
+	}
+	return max_error;
+}
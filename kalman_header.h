@@ -0,0 +1,64 @@
+/**
+ * @file kalman_header.h
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Kalman filter bank header file.
+ *
+ * This is the header to kalman_funcs.c containing necessary definitions and
+ * initializations.
+ */
+
+#ifndef KALMAN_HEADER_H_
+#define KALMAN_HEADER_H_
+
+# include "la_header.h"
+
+# define KALMAN_BANK_CHANNELS 6 ///< Number of filtered signals (psi, psi_dot, theta, theta_dot, phi, phi_dot)
+# define KALMAN_BANK_WIDTH 8 ///< #KALMAN_BANK_CHANNELS rounded up to a whole number of 4-float vectors (the 2 extra lanes are padding)
+# define KALMAN_BANK_TOLERANCE 1e-4 ///< Maximum deviation allowed between the filter bank, Kalman_filter() and Kalman_filter_cv() in Kalman_bank_self_test()
+
+/**
+ * @name Filter bank channels
+ * Index of each filtered signal inside a #Kalman_bank.
+ * @{
+ */
+# define KALMAN_PSI 0 ///< Yaw angle channel
+# define KALMAN_PSIDOT 1 ///< Yaw rate channel
+# define KALMAN_THETA 2 ///< Pitch angle channel
+# define KALMAN_THETADOT 3 ///< Pitch rate channel
+# define KALMAN_PHI 4 ///< Roll angle channel
+# define KALMAN_PHIDOT 5 ///< Roll rate channel
+/** @} */
+
+/**
+ * @struct Kalman_bank
+ * Structure-of-arrays holding the state of all the constant-velocity Kalman filters (see Kalman_filter_cv()), one
+ * lane per channel. Since the covariance matrices are symmetric, only their upper triangle is stored. The arrays are
+ * 16-byte aligned so that Kalman_bank_update() can advance 4 channels at a time with NEON or SSE instructions.
+ */
+struct Kalman_bank {
+	float x0[KALMAN_BANK_WIDTH] __attribute__((aligned(16))); ///< First state (the filtered signal)
+	float x1[KALMAN_BANK_WIDTH] __attribute__((aligned(16))); ///< Second state (the filtered signal's rate)
+	float p00[KALMAN_BANK_WIDTH] __attribute__((aligned(16))); ///< Estimate covariance P[0][0]
+	float p01[KALMAN_BANK_WIDTH] __attribute__((aligned(16))); ///< Estimate covariance P[0][1]==P[1][0]
+	float p11[KALMAN_BANK_WIDTH] __attribute__((aligned(16))); ///< Estimate covariance P[1][1]
+	float q00[KALMAN_BANK_WIDTH] __attribute__((aligned(16))); ///< Process noise covariance Q[0][0]
+	float q01[KALMAN_BANK_WIDTH] __attribute__((aligned(16))); ///< Process noise covariance Q[0][1]==Q[1][0]
+	float q11[KALMAN_BANK_WIDTH] __attribute__((aligned(16))); ///< Process noise covariance Q[1][1]
+	float r[KALMAN_BANK_WIDTH] __attribute__((aligned(16))); ///< Observation noise covariance R
+};
+
+struct Kalman_bank attitude_filter; ///< The filter bank used by get_filtered_attitude_parallel()
+
+extern const char KALMAN_BANK_IMPLEMENTATION[]; ///< Which Kalman_bank_update() implementation was compiled in ("NEON", "SSE" or "scalar")
+
+/** @cond INCLUDE_WITH_DOXYGEN */
+void Kalman_bank_init(struct Kalman_bank *bank);
+void Kalman_bank_set_channel(struct Kalman_bank *bank,int channel,const struct MATRIX2x1 *x,const struct MATRIX2x2 *P,const struct MATRIX2x2 *Q,const struct MATRIX1x1 *R);
+void Kalman_bank_get_channel(const struct Kalman_bank *bank,int channel,struct MATRIX2x1 *x,struct MATRIX2x2 *P);
+void Kalman_bank_update(struct Kalman_bank *bank,const float *z,float dt);
+float Kalman_bank_self_test(const struct Kalman_bank *bank);
+/** @endcond */
+
+#endif /* KALMAN_HEADER_H_ */
@@ -6,8 +6,9 @@
  * @brief Lienar Algebra functions source file.
  *
  * This file contains necessary linear algebra functions such as matrix initialization,
- * multiplication, addition, subtraction, etc. These functions are used primarily in the Kalman_filter()
- * function (found in imu_funcs.c)
+ * multiplication, addition, subtraction, etc. The fixed-size versions (operating on #MATRIX2x2,
+ * #MATRIX2x1, etc.) are used in the Kalman_filter() function (found in imu_funcs.c) and in
+ * construct_zeroed_DCM(): they write their result into an output parameter and never touch the heap.
  */
 
 # include <stdint.h>
@@ -29,10 +30,10 @@ struct MATRIX initMatrix(size_t rows, size_t cols) {
 	struct MATRIX A;
 	A.rows = rows;
 	A.cols = cols;
-	A.matrix = (float**)malloc(A.cols*sizeof(float*));
+	A.matrix = (float**)malloc(A.rows*sizeof(float*));
 	int ii;
 	for (ii=0;ii<A.rows;ii++) {
-		A.matrix[ii] = (float*)malloc(A.rows*sizeof(float));
+		A.matrix[ii] = (float*)malloc(A.cols*sizeof(float));
 	}
 	return A;
 }
@@ -129,3 +130,234 @@ struct MATRIX transpose(struct MATRIX A) {
 	}
 	return A_T;
 }
+
+//%%%%%%%%%%%%%%%%%%%%%%%%%%% FIXED-SIZE MATRIX FUNCTIONS %%%%%%%%%%%%%%%%%%%%%%%%%%%
+// The products are first computed into a local matrix and then copied into the output, so the output
+// may be the same matrix as one of the inputs (e.g. mmultiply_3x3_3x3(&R,&DCM,&DCM) for DCM=R*DCM).
+
+/**
+ * @fn void mmultiply_2x2_2x2(const struct MATRIX2x2 *A, const struct MATRIX2x2 *B, struct MATRIX2x2 *C)
+ *
+ * This function computes C=A*B for [2x2] matrices.
+ *
+ * @param A The pre-multiplied matrix.
+ * @param B The post-multiplied matrix.
+ * @param C The result (may be A or B).
+ */
+void mmultiply_2x2_2x2(const struct MATRIX2x2 *A, const struct MATRIX2x2 *B, struct MATRIX2x2 *C) {
+	struct MATRIX2x2 T;
+	T.matrix[0][0] = A->matrix[0][0]*B->matrix[0][0]+A->matrix[0][1]*B->matrix[1][0];
+	T.matrix[0][1] = A->matrix[0][0]*B->matrix[0][1]+A->matrix[0][1]*B->matrix[1][1];
+	T.matrix[1][0] = A->matrix[1][0]*B->matrix[0][0]+A->matrix[1][1]*B->matrix[1][0];
+	T.matrix[1][1] = A->matrix[1][0]*B->matrix[0][1]+A->matrix[1][1]*B->matrix[1][1];
+	*C = T;
+}
+
+/**
+ * @fn void mmultiply_2x2_2x1(const struct MATRIX2x2 *A, const struct MATRIX2x1 *B, struct MATRIX2x1 *C)
+ *
+ * This function computes C=A*B for a [2x2] matrix A and a [2x1] matrix B.
+ *
+ * @param A The pre-multiplied matrix.
+ * @param B The post-multiplied matrix.
+ * @param C The result (may be B).
+ */
+void mmultiply_2x2_2x1(const struct MATRIX2x2 *A, const struct MATRIX2x1 *B, struct MATRIX2x1 *C) {
+	struct MATRIX2x1 T;
+	T.matrix[0][0] = A->matrix[0][0]*B->matrix[0][0]+A->matrix[0][1]*B->matrix[1][0];
+	T.matrix[1][0] = A->matrix[1][0]*B->matrix[0][0]+A->matrix[1][1]*B->matrix[1][0];
+	*C = T;
+}
+
+/**
+ * @fn void mmultiply_1x2_2x2(const struct MATRIX1x2 *A, const struct MATRIX2x2 *B, struct MATRIX1x2 *C)
+ *
+ * This function computes C=A*B for a [1x2] matrix A and a [2x2] matrix B.
+ *
+ * @param A The pre-multiplied matrix.
+ * @param B The post-multiplied matrix.
+ * @param C The result (may be A).
+ */
+void mmultiply_1x2_2x2(const struct MATRIX1x2 *A, const struct MATRIX2x2 *B, struct MATRIX1x2 *C) {
+	struct MATRIX1x2 T;
+	T.matrix[0][0] = A->matrix[0][0]*B->matrix[0][0]+A->matrix[0][1]*B->matrix[1][0];
+	T.matrix[0][1] = A->matrix[0][0]*B->matrix[0][1]+A->matrix[0][1]*B->matrix[1][1];
+	*C = T;
+}
+
+/**
+ * @fn void mmultiply_1x2_2x1(const struct MATRIX1x2 *A, const struct MATRIX2x1 *B, struct MATRIX1x1 *C)
+ *
+ * This function computes C=A*B for a [1x2] matrix A and a [2x1] matrix B (i.e. a dot product).
+ *
+ * @param A The pre-multiplied matrix.
+ * @param B The post-multiplied matrix.
+ * @param C The [1x1] result.
+ */
+void mmultiply_1x2_2x1(const struct MATRIX1x2 *A, const struct MATRIX2x1 *B, struct MATRIX1x1 *C) {
+	C->matrix[0][0] = A->matrix[0][0]*B->matrix[0][0]+A->matrix[0][1]*B->matrix[1][0];
+}
+
+/**
+ * @fn void mmultiply_2x1_1x1(const struct MATRIX2x1 *A, const struct MATRIX1x1 *B, struct MATRIX2x1 *C)
+ *
+ * This function computes C=A*B for a [2x1] matrix A and a [1x1] matrix B (i.e. a scaling of A).
+ *
+ * @param A The pre-multiplied matrix.
+ * @param B The post-multiplied matrix.
+ * @param C The result (may be A).
+ */
+void mmultiply_2x1_1x1(const struct MATRIX2x1 *A, const struct MATRIX1x1 *B, struct MATRIX2x1 *C) {
+	float b = B->matrix[0][0];
+	C->matrix[0][0] = A->matrix[0][0]*b;
+	C->matrix[1][0] = A->matrix[1][0]*b;
+}
+
+/**
+ * @fn void mmultiply_2x1_1x2(const struct MATRIX2x1 *A, const struct MATRIX1x2 *B, struct MATRIX2x2 *C)
+ *
+ * This function computes C=A*B for a [2x1] matrix A and a [1x2] matrix B (i.e. an outer product).
+ *
+ * @param A The pre-multiplied matrix.
+ * @param B The post-multiplied matrix.
+ * @param C The [2x2] result.
+ */
+void mmultiply_2x1_1x2(const struct MATRIX2x1 *A, const struct MATRIX1x2 *B, struct MATRIX2x2 *C) {
+	C->matrix[0][0] = A->matrix[0][0]*B->matrix[0][0];
+	C->matrix[0][1] = A->matrix[0][0]*B->matrix[0][1];
+	C->matrix[1][0] = A->matrix[1][0]*B->matrix[0][0];
+	C->matrix[1][1] = A->matrix[1][0]*B->matrix[0][1];
+}
+
+/**
+ * @fn void mmultiply_3x3_3x3(const struct MATRIX3x3 *A, const struct MATRIX3x3 *B, struct MATRIX3x3 *C)
+ *
+ * This function computes C=A*B for [3x3] matrices.
+ *
+ * @param A The pre-multiplied matrix.
+ * @param B The post-multiplied matrix.
+ * @param C The result (may be A or B).
+ */
+void mmultiply_3x3_3x3(const struct MATRIX3x3 *A, const struct MATRIX3x3 *B, struct MATRIX3x3 *C) {
+	struct MATRIX3x3 T;
+	int ii; int jj;
+	for (ii=0;ii<3;ii++) {
+		for (jj=0;jj<3;jj++) {
+			T.matrix[ii][jj] = A->matrix[ii][0]*B->matrix[0][jj]+A->matrix[ii][1]*B->matrix[1][jj]+A->matrix[ii][2]*B->matrix[2][jj];
+		}
+	}
+	*C = T;
+}
+
+/**
+ * @fn void madd_2x2(const struct MATRIX2x2 *A, const struct MATRIX2x2 *B, struct MATRIX2x2 *C)
+ *
+ * This function computes C=A+B for [2x2] matrices.
+ *
+ * @param A The first matrix.
+ * @param B The second matrix.
+ * @param C The result (may be A or B).
+ */
+void madd_2x2(const struct MATRIX2x2 *A, const struct MATRIX2x2 *B, struct MATRIX2x2 *C) {
+	C->matrix[0][0] = A->matrix[0][0]+B->matrix[0][0];
+	C->matrix[0][1] = A->matrix[0][1]+B->matrix[0][1];
+	C->matrix[1][0] = A->matrix[1][0]+B->matrix[1][0];
+	C->matrix[1][1] = A->matrix[1][1]+B->matrix[1][1];
+}
+
+/**
+ * @fn void madd_2x1(const struct MATRIX2x1 *A, const struct MATRIX2x1 *B, struct MATRIX2x1 *C)
+ *
+ * This function computes C=A+B for [2x1] matrices.
+ *
+ * @param A The first matrix.
+ * @param B The second matrix.
+ * @param C The result (may be A or B).
+ */
+void madd_2x1(const struct MATRIX2x1 *A, const struct MATRIX2x1 *B, struct MATRIX2x1 *C) {
+	C->matrix[0][0] = A->matrix[0][0]+B->matrix[0][0];
+	C->matrix[1][0] = A->matrix[1][0]+B->matrix[1][0];
+}
+
+/**
+ * @fn void madd_1x1(const struct MATRIX1x1 *A, const struct MATRIX1x1 *B, struct MATRIX1x1 *C)
+ *
+ * This function computes C=A+B for [1x1] matrices.
+ *
+ * @param A The first matrix.
+ * @param B The second matrix.
+ * @param C The result (may be A or B).
+ */
+void madd_1x1(const struct MATRIX1x1 *A, const struct MATRIX1x1 *B, struct MATRIX1x1 *C) {
+	C->matrix[0][0] = A->matrix[0][0]+B->matrix[0][0];
+}
+
+/**
+ * @fn void msubtract_2x2(const struct MATRIX2x2 *A, const struct MATRIX2x2 *B, struct MATRIX2x2 *C)
+ *
+ * This function computes C=A-B for [2x2] matrices.
+ *
+ * @param A The first matrix.
+ * @param B The second matrix.
+ * @param C The result (may be A or B).
+ */
+void msubtract_2x2(const struct MATRIX2x2 *A, const struct MATRIX2x2 *B, struct MATRIX2x2 *C) {
+	C->matrix[0][0] = A->matrix[0][0]-B->matrix[0][0];
+	C->matrix[0][1] = A->matrix[0][1]-B->matrix[0][1];
+	C->matrix[1][0] = A->matrix[1][0]-B->matrix[1][0];
+	C->matrix[1][1] = A->matrix[1][1]-B->matrix[1][1];
+}
+
+/**
+ * @fn void msubtract_1x1(const struct MATRIX1x1 *A, const struct MATRIX1x1 *B, struct MATRIX1x1 *C)
+ *
+ * This function computes C=A-B for [1x1] matrices.
+ *
+ * @param A The first matrix.
+ * @param B The second matrix.
+ * @param C The result (may be A or B).
+ */
+void msubtract_1x1(const struct MATRIX1x1 *A, const struct MATRIX1x1 *B, struct MATRIX1x1 *C) {
+	C->matrix[0][0] = A->matrix[0][0]-B->matrix[0][0];
+}
+
+/**
+ * @fn void transpose_2x2(const struct MATRIX2x2 *A, struct MATRIX2x2 *A_T)
+ *
+ * This function computes A_T=A' for a [2x2] matrix.
+ *
+ * @param A A matrix.
+ * @param A_T The transpose of A (may be A).
+ */
+void transpose_2x2(const struct MATRIX2x2 *A, struct MATRIX2x2 *A_T) {
+	float a01 = A->matrix[0][1];
+	A_T->matrix[0][0] = A->matrix[0][0];
+	A_T->matrix[0][1] = A->matrix[1][0];
+	A_T->matrix[1][0] = a01;
+	A_T->matrix[1][1] = A->matrix[1][1];
+}
+
+/**
+ * @fn void transpose_1x2(const struct MATRIX1x2 *A, struct MATRIX2x1 *A_T)
+ *
+ * This function computes A_T=A' for a [1x2] matrix.
+ *
+ * @param A A [1x2] matrix.
+ * @param A_T The [2x1] transpose of A.
+ */
+void transpose_1x2(const struct MATRIX1x2 *A, struct MATRIX2x1 *A_T) {
+	A_T->matrix[0][0] = A->matrix[0][0];
+	A_T->matrix[1][0] = A->matrix[0][1];
+}
+
+/**
+ * @fn void minverse_1x1_fixed(const struct MATRIX1x1 *A, struct MATRIX1x1 *B)
+ *
+ * This function inverses a 1 by 1 matrix, B=inv(A) (see minverse_1x1()).
+ *
+ * @param A [1x1] matrix.
+ * @param B The inverse of A (may be A).
+ */
+void minverse_1x1_fixed(const struct MATRIX1x1 *A, struct MATRIX1x1 *B) {
+	B->matrix[0][0]=1/(A->matrix[0][0]);
+}
@@ -12,6 +12,8 @@
 #ifndef LA_HEADER_H_
 #define LA_HEADER_H_
 
+# include <stddef.h>
+
 /**
  * @struct MATRIX
  * This is the structure for a Matrix.
@@ -22,6 +24,20 @@ struct MATRIX {
 	float **matrix; ///< The dynamic 2D array
 };
 
+/**
+ * @name Fixed-size matrices
+ * Stack-resident matrices with contiguous storage, used in the real-time paths (Kalman_filter() and
+ * construct_zeroed_DCM()) so that they run without any heap allocation. The element array is called
+ * "matrix" like in #MATRIX so that element access reads the same (e.g. x_psi.matrix[0][0]).
+ * @{
+ */
+struct MATRIX1x1 { float matrix[1][1]; }; ///< [1x1] matrix
+struct MATRIX1x2 { float matrix[1][2]; }; ///< [1x2] matrix
+struct MATRIX2x1 { float matrix[2][1]; }; ///< [2x1] matrix
+struct MATRIX2x2 { float matrix[2][2]; }; ///< [2x2] matrix
+struct MATRIX3x3 { float matrix[3][3]; }; ///< [3x3] matrix
+/** @} */
+
 /** @cond INCLUDE_WITH_DOXYGEN */
 struct MATRIX initMatrix(size_t rows, size_t cols);
 struct MATRIX mmultiply(struct MATRIX A, struct MATRIX B);
@@ -29,6 +45,22 @@ struct MATRIX minverse_1x1 (struct MATRIX A);
 struct MATRIX transpose(struct MATRIX A);
 struct MATRIX madd(struct MATRIX A,struct MATRIX B);
 struct MATRIX msubtract(struct MATRIX A,struct MATRIX B);
+
+void mmultiply_2x2_2x2(const struct MATRIX2x2 *A, const struct MATRIX2x2 *B, struct MATRIX2x2 *C);
+void mmultiply_2x2_2x1(const struct MATRIX2x2 *A, const struct MATRIX2x1 *B, struct MATRIX2x1 *C);
+void mmultiply_1x2_2x2(const struct MATRIX1x2 *A, const struct MATRIX2x2 *B, struct MATRIX1x2 *C);
+void mmultiply_1x2_2x1(const struct MATRIX1x2 *A, const struct MATRIX2x1 *B, struct MATRIX1x1 *C);
+void mmultiply_2x1_1x1(const struct MATRIX2x1 *A, const struct MATRIX1x1 *B, struct MATRIX2x1 *C);
+void mmultiply_2x1_1x2(const struct MATRIX2x1 *A, const struct MATRIX1x2 *B, struct MATRIX2x2 *C);
+void mmultiply_3x3_3x3(const struct MATRIX3x3 *A, const struct MATRIX3x3 *B, struct MATRIX3x3 *C);
+void madd_2x2(const struct MATRIX2x2 *A, const struct MATRIX2x2 *B, struct MATRIX2x2 *C);
+void madd_2x1(const struct MATRIX2x1 *A, const struct MATRIX2x1 *B, struct MATRIX2x1 *C);
+void madd_1x1(const struct MATRIX1x1 *A, const struct MATRIX1x1 *B, struct MATRIX1x1 *C);
+void msubtract_2x2(const struct MATRIX2x2 *A, const struct MATRIX2x2 *B, struct MATRIX2x2 *C);
+void msubtract_1x1(const struct MATRIX1x1 *A, const struct MATRIX1x1 *B, struct MATRIX1x1 *C);
+void transpose_2x2(const struct MATRIX2x2 *A, struct MATRIX2x2 *A_T);
+void transpose_1x2(const struct MATRIX1x2 *A, struct MATRIX2x1 *A_T);
+void minverse_1x1_fixed(const struct MATRIX1x1 *A, struct MATRIX1x1 *B);
 /** @endcond */
 
 #endif /* LA_HEADER_H_ */
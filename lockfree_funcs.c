@@ -0,0 +1,209 @@
+/**
+ * @file lockfree_funcs.c
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Lock-free inter-thread communication functions file.
+ *
+ * This file contains the data structures used to pass data between threads without
+ * locks, so that a thread reading a sensor is never held up by the thread consuming its
+ * data (and vice versa). They rely on C11 atomics for the memory ordering between the
+ * Raspberry Pi's threads.
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include "lockfree_header.h"
+
+/**
+ * @fn void SPSC_ring_init(struct SPSC_ring *ring, void *buffer, size_t element_size, unsigned int capacity)
+ *
+ * This function initializes an empty ring buffer over the caller-provided storage. Must be called before the
+ * producer and consumer threads are started.
+ *
+ * @param ring The ring buffer.
+ * @param buffer Storage for capacity elements (e.g. a global array of structs).
+ * @param element_size Size in bytes of one element.
+ * @param capacity Number of elements in buffer, must be a power of 2.
+ */
+void SPSC_ring_init(struct SPSC_ring *ring, void *buffer, size_t element_size, unsigned int capacity) {
+	if (capacity==0 || (capacity&(capacity-1))!=0) {
+		printf("CRITICAL ERROR: SPSC ring capacity (%u) must be a power of 2.\n",capacity);
+		exit(-2);
+	}
+	ring->buffer = (unsigned char *)buffer;
+	ring->element_size = element_size;
+	ring->capacity = capacity;
+	atomic_init(&ring->head,0);
+	atomic_init(&ring->tail,0);
+	atomic_init(&ring->dropped,0);
+}
+
+/**
+ * @fn int SPSC_ring_push(struct SPSC_ring *ring, const void *element)
+ *
+ * This function copies an element into the ring buffer. May only be called by the producer thread.
+ *
+ * @param ring The ring buffer.
+ * @param element The element to push.
+ *
+ * @return 0 if the element was pushed, -1 if the ring was full (the element is then dropped and counted in #dropped).
+ */
+int SPSC_ring_push(struct SPSC_ring *ring, const void *element) {
+	unsigned int head = atomic_load_explicit(&ring->head,memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&ring->tail,memory_order_acquire); // Make sure the consumer is done with the slot we reuse
+	if (head-tail>=ring->capacity) { // Full
+		atomic_fetch_add_explicit(&ring->dropped,1,memory_order_relaxed);
+		return -1;
+	}
+	memcpy(ring->buffer+(head&(ring->capacity-1))*ring->element_size,element,ring->element_size);
+	atomic_store_explicit(&ring->head,head+1,memory_order_release); // Publish the element
+	return 0;
+}
+
+/**
+ * @fn int SPSC_ring_pop(struct SPSC_ring *ring, void *element)
+ *
+ * This function copies the oldest element out of the ring buffer. May only be called by the consumer thread.
+ *
+ * @param ring The ring buffer.
+ * @param element Where to copy the element.
+ *
+ * @return 0 if an element was popped, -1 if the ring was empty.
+ */
+int SPSC_ring_pop(struct SPSC_ring *ring, void *element) {
+	unsigned int tail = atomic_load_explicit(&ring->tail,memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&ring->head,memory_order_acquire); // See the element contents written before head
+	if (head==tail) { // Empty
+		return -1;
+	}
+	memcpy(element,ring->buffer+(tail&(ring->capacity-1))*ring->element_size,ring->element_size);
+	atomic_store_explicit(&ring->tail,tail+1,memory_order_release); // Hand the slot back to the producer
+	return 0;
+}
+
+/**
+ * @fn unsigned int SPSC_ring_count(struct SPSC_ring *ring)
+ *
+ * This function returns how many elements are currently waiting in the ring buffer. The value is only a snapshot
+ * if the producer or consumer is running at the same time.
+ *
+ * @param ring The ring buffer.
+ */
+unsigned int SPSC_ring_count(struct SPSC_ring *ring) {
+	return atomic_load_explicit(&ring->head,memory_order_acquire)-atomic_load_explicit(&ring->tail,memory_order_acquire);
+}
+
+/**
+ * @fn void Seqlock_init(struct Seqlock *lock)
+ *
+ * This function initializes a sequence lock (no update in progress). Must be called before the writer and reader
+ * threads are started.
+ *
+ * @param lock The sequence lock.
+ */
+void Seqlock_init(struct Seqlock *lock) {
+	atomic_init(&lock->sequence,0);
+}
+
+/**
+ * @fn void Seqlock_write(struct Seqlock *lock, void *data, const void *source, size_t size)
+ *
+ * This function overwrites the data protected by the sequence lock. May only be called by the (single) writer thread.
+ *
+ * @param lock The sequence lock.
+ * @param data The protected data.
+ * @param source The new version of the data.
+ * @param size Size in bytes of the data.
+ */
+void Seqlock_write(struct Seqlock *lock, void *data, const void *source, size_t size) {
+	unsigned int sequence = atomic_load_explicit(&lock->sequence,memory_order_relaxed);
+	atomic_store_explicit(&lock->sequence,sequence+1,memory_order_relaxed); // Odd : update in progress
+	atomic_thread_fence(memory_order_release); // Readers must see the odd value before any of the new data
+	memcpy(data,source,size);
+	atomic_store_explicit(&lock->sequence,sequence+2,memory_order_release); // Even : publish the new data
+}
+
+/**
+ * @fn unsigned int Seqlock_read(struct Seqlock *lock, void *destination, const void *data, size_t size)
+ *
+ * This function copies out a consistent version of the data protected by the sequence lock. Any thread may call it.
+ *
+ * @param lock The sequence lock.
+ * @param destination Where to copy the data.
+ * @param data The protected data.
+ * @param size Size in bytes of the data.
+ *
+ * @return The number of times the copy had to be redone because the writer was updating the data (normally 0).
+ */
+unsigned int Seqlock_read(struct Seqlock *lock, void *destination, const void *data, size_t size) {
+	unsigned int retries = 0;
+	unsigned int before, after;
+	while (1) {
+		before = atomic_load_explicit(&lock->sequence,memory_order_acquire);
+		if ((before&1)==0) {
+			memcpy(destination,data,size);
+			atomic_thread_fence(memory_order_acquire); // The copy must be complete before the sequence is checked again
+			after = atomic_load_explicit(&lock->sequence,memory_order_relaxed);
+			if (before==after) return retries; // No update happened during the copy
+		}
+		retries++;
+	}
+}
+
+/**
+ * @fn void Mailbox_init(struct Mailbox *mailbox, void *buffer, size_t element_size)
+ *
+ * This function initializes an empty mailbox over the caller-provided storage. Must be called before the writer and
+ * reader threads are started.
+ *
+ * @param mailbox The mailbox.
+ * @param buffer Storage for 3 elements (e.g. a global array of 3 structs).
+ * @param element_size Size in bytes of one element.
+ */
+void Mailbox_init(struct Mailbox *mailbox, void *buffer, size_t element_size) {
+	mailbox->buffer = (unsigned char *)buffer;
+	mailbox->element_size = element_size;
+	mailbox->write_slot = 0;
+	mailbox->read_slot = 2;
+	atomic_init(&mailbox->latest,1); // Nothing posted yet
+	atomic_init(&mailbox->overwritten,0);
+}
+
+/**
+ * @fn void Mailbox_post(struct Mailbox *mailbox, const void *element)
+ *
+ * This function makes an element the latest one of the mailbox. May only be called by the writer thread. It never
+ * blocks : an element the reader has not taken yet is overwritten (and counted in #Mailbox.overwritten).
+ *
+ * @param mailbox The mailbox.
+ * @param element The element to post.
+ */
+void Mailbox_post(struct Mailbox *mailbox, const void *element) {
+	unsigned int previous;
+	memcpy(mailbox->buffer+mailbox->write_slot*mailbox->element_size,element,mailbox->element_size);
+	previous = atomic_exchange_explicit(&mailbox->latest,mailbox->write_slot|MAILBOX_FRESH,memory_order_acq_rel); // Publish the element, get back a free slot
+	if (previous&MAILBOX_FRESH) atomic_fetch_add_explicit(&mailbox->overwritten,1,memory_order_relaxed);
+	mailbox->write_slot = previous&~MAILBOX_FRESH;
+}
+
+/**
+ * @fn int Mailbox_take(struct Mailbox *mailbox, void *element)
+ *
+ * This function copies out the latest element of the mailbox if it has not been taken yet. May only be called by the
+ * reader thread. It never blocks.
+ *
+ * @param mailbox The mailbox.
+ * @param element Where to copy the element.
+ *
+ * @return 0 if an element was taken, -1 if nothing was posted since the previous call.
+ */
+int Mailbox_take(struct Mailbox *mailbox, void *element) {
+	if ((atomic_load_explicit(&mailbox->latest,memory_order_relaxed)&MAILBOX_FRESH)==0) { // Only the reader clears the flag
+		return -1;
+	}
+	mailbox->read_slot = atomic_exchange_explicit(&mailbox->latest,mailbox->read_slot,memory_order_acq_rel)&~MAILBOX_FRESH; // Give back the slot read last
+	memcpy(element,mailbox->buffer+mailbox->read_slot*mailbox->element_size,mailbox->element_size);
+	return 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file lockfree_header.h
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Lock-free inter-thread communication header file.
+ *
+ * This is the header to lockfree_funcs.c containing necessary definitions and
+ * initializations.
+ */
+
+#ifndef LOCKFREE_HEADER_H_
+#define LOCKFREE_HEADER_H_
+
+# include <stddef.h>
+# include <stdatomic.h>
+
+/**
+ * @struct SPSC_ring
+ * A single-producer/single-consumer ring buffer (FIFO) of fixed-size elements. Exactly one thread may push and exactly
+ * one (other) thread may pop; neither ever blocks or takes a lock. The element storage is provided by the caller (see
+ * SPSC_ring_init()), so the ring never allocates memory. #head and #tail are free-running counters, the slot used is
+ * the counter modulo #capacity (which must be a power of 2).
+ */
+struct SPSC_ring {
+	unsigned char *buffer; ///< Element storage, #capacity*#element_size bytes
+	size_t element_size; ///< Size in bytes of one element
+	unsigned int capacity; ///< Number of elements the ring can hold (power of 2)
+	atomic_uint head; ///< Number of elements pushed so far (written by the producer only)
+	atomic_uint tail; ///< Number of elements popped so far (written by the consumer only)
+	atomic_ulong dropped; ///< Number of elements that could not be pushed because the ring was full
+};
+
+/**
+ * @struct Seqlock
+ * A sequence lock protecting a block of data that one thread overwrites and any number of other threads read. The
+ * writer never waits; a reader copies the data and retries only if the writer was in the middle of an update, so it
+ * always ends up with one consistent version of the whole block (never a mix of two). #sequence is odd while an update
+ * is in progress and is incremented by 2 with every completed update.
+ */
+struct Seqlock {
+	atomic_uint sequence; ///< Update counter, odd while the writer is copying new data in
+};
+
+# define MAILBOX_FRESH 4 ///< Flag of #Mailbox.latest set while the latest element has not been taken by the reader
+
+/**
+ * @struct Mailbox
+ * A single-writer/single-reader mailbox holding the latest version of a block of data (a triple buffer). The writer
+ * always has a slot of its own to fill and swaps it with #latest in one atomic exchange, the reader swaps its own slot
+ * with #latest in the same way when a fresh element is there. Both are wait-free (no retry, no lock) and the reader
+ * always gets a whole element, the most recent one, while older elements it did not take are simply overwritten.
+ */
+struct Mailbox {
+	unsigned char *buffer; ///< Storage of the 3 slots, 3*#element_size bytes
+	size_t element_size; ///< Size in bytes of one element
+	unsigned int write_slot; ///< Slot the writer fills next (used by the writer only)
+	unsigned int read_slot; ///< Slot holding the element the reader took last (used by the reader only)
+	atomic_uint latest; ///< Slot holding the latest posted element, ORed with #MAILBOX_FRESH until the reader takes it
+	atomic_ulong overwritten; ///< Number of elements replaced by a newer one before the reader took them
+};
+
+/** @cond INCLUDE_WITH_DOXYGEN */
+void SPSC_ring_init(struct SPSC_ring *ring, void *buffer, size_t element_size, unsigned int capacity);
+int SPSC_ring_push(struct SPSC_ring *ring, const void *element);
+int SPSC_ring_pop(struct SPSC_ring *ring, void *element);
+unsigned int SPSC_ring_count(struct SPSC_ring *ring);
+void Seqlock_init(struct Seqlock *lock);
+void Seqlock_write(struct Seqlock *lock, void *data, const void *source, size_t size);
+unsigned int Seqlock_read(struct Seqlock *lock, void *destination, const void *data, size_t size);
+void Mailbox_init(struct Mailbox *mailbox, void *buffer, size_t element_size);
+void Mailbox_post(struct Mailbox *mailbox, const void *element);
+int Mailbox_take(struct Mailbox *mailbox, void *element);
+/** @endcond */
+
+#endif /* LOCKFREE_HEADER_H_ */
@@ -0,0 +1,344 @@
+/**
+ * @file log_decoder.c
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Flight record decoder (ground tool).
+ *
+ * This program converts the binary flight record written by the flight recorder (./logs/flight_record.bin, see
+ * recorder_header.h) back into the log files that the MATLAB scripts (e.g. result_analyzer.m) read. It runs on
+ * the ground computer, not on the rocket. Build it from this directory with :
+ *
+ * 		gcc -O2 -Wall -o log_decoder log_decoder.c
+ *
+ * and run it as :
+ *
+ * 		./log_decoder [-f matlab|csv|columns] flight_record.bin output_directory
+ *
+ * The output formats are :
+ * 	- matlab (default) : imu_log.txt, pressure_log.txt and control_log.txt, tab-separated with a header line, in exactly
+ * 	  the layout the flight software used to write them
+ * 	- csv : imu_log.csv, pressure_log.csv and control_log.csv, comma-separated with a header line, values printed with
+ * 	  full float precision
+ * 	- columns : one raw little-endian binary file per column, named <log>.<column>.<type> (e.g. imu_log.psi_filt.f32),
+ * 	  which MATLAB loads with fread(file,Inf,'float32') and numpy with numpy.fromfile(path,'<f4')
+ *
+ * The record file is read one block at a time and every record is written out as soon as it is decoded, so the memory
+ * used does not depend on the size of the flight record. Dropped records (gaps in the sequence numbers) and corrupt
+ * blocks are reported at the end.
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <stddef.h>
+# include <stdint.h>
+# include "../recorder_header.h"
+
+# define OUTPUT_MATLAB 0 ///< Tab-separated text logs, as formerly written by the flight software
+# define OUTPUT_CSV 1 ///< Comma-separated text logs
+# define OUTPUT_COLUMNS 2 ///< One raw binary file per column
+# define OUTPUT_BUFFER_SIZE (1<<20) ///< [bytes] stdio buffer of each text output file
+
+/**
+ * @name Field types
+ * Types of the record fields (see #Field)
+ * @{
+ */
+# define FIELD_U8 0
+# define FIELD_U16 1
+# define FIELD_U32 2
+# define FIELD_U64 3
+# define FIELD_F32 4
+# define FIELD_I8 5
+/** @} */
+
+const char *FIELD_EXTENSION[] = {"u8","u16","u32","u64","f32","i8"}; ///< File extension of a column of each field type (columns output)
+const size_t FIELD_SIZE[] = {1,2,4,8,4,1}; ///< Size in bytes of each field type
+
+/**
+ * @struct Field
+ * One column of a log : a field of a record.
+ */
+struct Field {
+	const char *name; ///< Column name (as in the header line of the text logs)
+	unsigned char type; ///< Field type (#FIELD_U8, ...)
+	size_t offset; ///< Offset of the field in the record
+};
+
+# define IMU_FIELD(name,type) {#name,type,offsetof(struct IMU_record,name)}
+# define PRESSURE_FIELD(name,type) {#name,type,offsetof(struct Pressure_record,name)}
+# define CONTROL_FIELD(name,type) {#name,type,offsetof(struct Control_record,name)}
+
+/**
+ * @name Log layouts
+ * Columns of each log, in the order in which the flight software used to write them.
+ * @{
+ */
+const struct Field IMU_FIELDS[] = {
+	IMU_FIELD(time_imu_glob,FIELD_U64), IMU_FIELD(dt,FIELD_F32),
+	IMU_FIELD(psi_save,FIELD_F32), IMU_FIELD(theta_save,FIELD_F32), IMU_FIELD(phi_save,FIELD_F32),
+	IMU_FIELD(psi_dot,FIELD_F32), IMU_FIELD(theta_dot,FIELD_F32), IMU_FIELD(phi_dot,FIELD_F32),
+	IMU_FIELD(psi_filt,FIELD_F32), IMU_FIELD(theta_filt,FIELD_F32), IMU_FIELD(phi_filt,FIELD_F32),
+	IMU_FIELD(psi_dot_filt,FIELD_F32), IMU_FIELD(theta_dot_filt,FIELD_F32), IMU_FIELD(phi_dot_filt,FIELD_F32),
+	IMU_FIELD(wx,FIELD_F32), IMU_FIELD(wy,FIELD_F32), IMU_FIELD(wz,FIELD_F32),
+	IMU_FIELD(accelX_save,FIELD_F32), IMU_FIELD(accelY_save,FIELD_F32), IMU_FIELD(accelZ_save,FIELD_F32),
+	IMU_FIELD(latency,FIELD_U32)
+};
+const struct Field PRESSURE_FIELDS[] = {
+	PRESSURE_FIELD(time_pressure_glob,FIELD_U64),
+	PRESSURE_FIELD(radial_status,FIELD_U8), PRESSURE_FIELD(radial_pressure,FIELD_F32), PRESSURE_FIELD(radial_temperature,FIELD_F32),
+	PRESSURE_FIELD(axial_status,FIELD_U8), PRESSURE_FIELD(axial_pressure,FIELD_F32), PRESSURE_FIELD(axial_temperature,FIELD_F32)
+};
+const struct Field CONTROL_FIELDS[] = {
+	CONTROL_FIELD(time_control_glob,FIELD_U64), CONTROL_FIELD(control_time,FIELD_U32),
+	CONTROL_FIELD(Fpitch,FIELD_F32), CONTROL_FIELD(Fyaw,FIELD_F32), CONTROL_FIELD(Mroll,FIELD_F32),
+	CONTROL_FIELD(R1,FIELD_F32), CONTROL_FIELD(R2,FIELD_F32), CONTROL_FIELD(R3,FIELD_F32), CONTROL_FIELD(R4,FIELD_F32),
+	CONTROL_FIELD(PWM1,FIELD_U16), CONTROL_FIELD(PWM2,FIELD_U16), CONTROL_FIELD(PWM3,FIELD_U16), CONTROL_FIELD(PWM4,FIELD_U16),
+	CONTROL_FIELD(attitude_epoch,FIELD_U32), CONTROL_FIELD(attitude_time,FIELD_U64), CONTROL_FIELD(allocation_status,FIELD_I8),
+	CONTROL_FIELD(simplex_pivots,FIELD_U8)
+};
+/** @} */
+
+/**
+ * @struct Log_output
+ * A log being decoded : the records of one type and where they are written.
+ */
+struct Log_output {
+	const char *name; ///< Log name (output files are named after it)
+	uint16_t type; ///< Record type (#RECORD_IMU, ...)
+	uint16_t size; ///< Record size
+	const struct Field *fields; ///< Columns
+	unsigned int field_count; ///< Number of columns
+	FILE *file; ///< Output file (text formats)
+	FILE **columns; ///< One output file per column (columns format)
+	unsigned long int records; ///< Number of records decoded
+	unsigned long int dropped; ///< Number of records missing from the sequence
+	uint32_t next_sequence; ///< Sequence number expected for the next record
+};
+
+struct Log_output LOGS[] = {
+	{"imu_log",RECORD_IMU,sizeof(struct IMU_record),IMU_FIELDS,sizeof(IMU_FIELDS)/sizeof(struct Field),NULL,NULL,0,0,0},
+	{"pressure_log",RECORD_PRESSURE,sizeof(struct Pressure_record),PRESSURE_FIELDS,sizeof(PRESSURE_FIELDS)/sizeof(struct Field),NULL,NULL,0,0,0},
+	{"control_log",RECORD_CONTROL,sizeof(struct Control_record),CONTROL_FIELDS,sizeof(CONTROL_FIELDS)/sizeof(struct Field),NULL,NULL,0,0,0}
+};
+# define LOG_COUNT (sizeof(LOGS)/sizeof(struct Log_output))
+
+int output_format=OUTPUT_MATLAB; ///< Selected output format (#OUTPUT_MATLAB, ...)
+
+/**
+ * @fn FILE *open_output(const char *directory, const char *name, const char *extension)
+ *
+ * This function creates the output file directory/name.extension, or exits if that fails.
+ *
+ * @param directory Output directory.
+ * @param name File name.
+ * @param extension File extension.
+ */
+FILE *open_output(const char *directory, const char *name, const char *extension) {
+	char path[1024];
+	FILE *file;
+	snprintf(path,sizeof(path),"%s/%s.%s",directory,name,extension);
+	if ((file=fopen(path,"w"))==NULL) {
+		perror(path);
+		exit(-2);
+	}
+	return file;
+}
+
+/**
+ * @fn void open_log(struct Log_output *log, const char *directory)
+ *
+ * This function creates the output file(s) of a log in the selected #output_format and writes the header line of
+ * the text formats.
+ *
+ * @param log The log.
+ * @param directory Output directory.
+ */
+void open_log(struct Log_output *log, const char *directory) {
+	unsigned int i;
+	char column_name[256];
+	if (output_format==OUTPUT_COLUMNS) {
+		if ((log->columns=malloc(log->field_count*sizeof(FILE *)))==NULL) {
+			perror("Failed to allocate column files");
+			exit(-2);
+		}
+		for (i=0;i<log->field_count;i++) {
+			snprintf(column_name,sizeof(column_name),"%s.%s",log->name,log->fields[i].name);
+			log->columns[i]=open_output(directory,column_name,FIELD_EXTENSION[log->fields[i].type]);
+		}
+		return;
+	}
+	log->file=open_output(directory,log->name,output_format==OUTPUT_CSV ? "csv" : "txt");
+	setvbuf(log->file,NULL,_IOFBF,OUTPUT_BUFFER_SIZE);
+	for (i=0;i<log->field_count;i++) {
+		if (output_format==OUTPUT_CSV) {
+			fprintf(log->file,i==0 ? "%s" : ",%s",log->fields[i].name);
+		} else {
+			fprintf(log->file,i==0 ? "%s" : " \t %s",log->fields[i].name);
+		}
+	}
+	fputc('\n',log->file);
+}
+
+/**
+ * @fn void close_log(struct Log_output *log)
+ *
+ * This function closes the output file(s) of a log.
+ *
+ * @param log The log.
+ */
+void close_log(struct Log_output *log) {
+	unsigned int i;
+	if (output_format==OUTPUT_COLUMNS) {
+		for (i=0;i<log->field_count;i++) fclose(log->columns[i]);
+		free(log->columns);
+	} else {
+		fclose(log->file);
+	}
+}
+
+/**
+ * @fn void write_record(struct Log_output *log, const unsigned char *record)
+ *
+ * This function writes one record as one line (text formats) or as one value appended to each column file.
+ *
+ * @param log The log of the record type.
+ * @param record The record, as read from the file.
+ */
+void write_record(struct Log_output *log, const unsigned char *record) {
+	unsigned int i;
+	const struct Field *field;
+	uint8_t u8; int8_t i8; uint16_t u16; uint32_t u32; uint64_t u64; float f32;
+	char separator = output_format==OUTPUT_CSV ? ',' : '\t';
+
+	for (i=0;i<log->field_count;i++) {
+		field=&log->fields[i];
+		if (output_format==OUTPUT_COLUMNS) {
+			fwrite(record+field->offset,FIELD_SIZE[field->type],1,log->columns[i]);
+			continue;
+		}
+		if (i>0) fputc(separator,log->file);
+		switch (field->type) { // memcpy() since packed records are not aligned
+			case FIELD_U8: memcpy(&u8,record+field->offset,1); fprintf(log->file,"%u",(unsigned int)u8); break;
+			case FIELD_U16: memcpy(&u16,record+field->offset,2); fprintf(log->file,"%u",(unsigned int)u16); break;
+			case FIELD_U32: memcpy(&u32,record+field->offset,4); fprintf(log->file,"%lu",(unsigned long int)u32); break;
+			case FIELD_U64: memcpy(&u64,record+field->offset,8); fprintf(log->file,"%llu",(unsigned long long int)u64); break;
+			case FIELD_F32: memcpy(&f32,record+field->offset,4); fprintf(log->file,output_format==OUTPUT_CSV ? "%.9g" : "%.5f",f32); break;
+			case FIELD_I8: memcpy(&i8,record+field->offset,1); fprintf(log->file,"%d",(int)i8); break;
+		}
+	}
+	if (output_format!=OUTPUT_COLUMNS) fputc('\n',log->file);
+}
+
+/**
+ * @fn unsigned long int decode_block(const unsigned char *block, size_t length, size_t start, unsigned long int block_number)
+ *
+ * This function decodes the records of one block (see the file layout in recorder_header.h).
+ *
+ * @param block The block.
+ * @param length Number of bytes of the block actually read (less than the block size if the file was cut short).
+ * @param start Offset of the first record in the block.
+ * @param block_number Index of the block in the file (for error messages).
+ *
+ * @return 1 if the block contained a corrupt record (the rest of the block is then skipped), 0 otherwise.
+ */
+unsigned long int decode_block(const unsigned char *block, size_t length, size_t start, unsigned long int block_number) {
+	size_t offset=start;
+	struct Record_header header;
+	unsigned int i;
+	struct Log_output *log;
+
+	while (offset+sizeof(struct Record_header)<=length) {
+		memcpy(&header,block+offset,sizeof(header));
+		if (header.type==RECORD_PADDING) break; // Rest of the block is unused
+		log=NULL;
+		for (i=0;i<LOG_COUNT;i++) {
+			if (LOGS[i].type==header.type) log=&LOGS[i];
+		}
+		if (log==NULL || header.size!=log->size) {
+			fprintf(stderr,"Block %lu, offset %lu: corrupt record (type %u, size %u), skipping the rest of the block.\n",block_number,(unsigned long int)offset,header.type,header.size);
+			return 1;
+		}
+		if (offset+header.size>length) break; // File cut short in the middle of a record
+		if (log->records>0 && header.sequence!=log->next_sequence) {
+			log->dropped += header.sequence-log->next_sequence;
+		} else if (log->records==0) {
+			log->dropped += header.sequence; // Records dropped before the first one was written
+		}
+		log->next_sequence=header.sequence+1;
+		log->records++;
+		write_record(log,block+offset);
+		offset += header.size;
+	}
+	return 0;
+}
+
+/**
+ * @fn int main(int argc, char *argv[])
+ *
+ * This is the main function of the decoder : it checks the file header, then decodes the flight record block by block.
+ */
+int main(int argc, char *argv[]) {
+	const char *input_path, *output_directory;
+	FILE *input;
+	struct Record_file_header file_header;
+	unsigned char *block;
+	size_t length, start;
+	unsigned long int block_number=0, corrupt_blocks=0;
+	unsigned int i;
+	int argi=1;
+
+	if (argc==5 && strcmp(argv[1],"-f")==0) {
+		if (strcmp(argv[2],"matlab")==0) output_format=OUTPUT_MATLAB;
+		else if (strcmp(argv[2],"csv")==0) output_format=OUTPUT_CSV;
+		else if (strcmp(argv[2],"columns")==0) output_format=OUTPUT_COLUMNS;
+		else argc=0; // Unknown format : print usage
+		argi=3;
+	}
+	if (argc-argi!=2) {
+		fprintf(stderr,"Usage: %s [-f matlab|csv|columns] flight_record.bin output_directory\n",argv[0]);
+		return -1;
+	}
+	input_path=argv[argi];
+	output_directory=argv[argi+1];
+
+	if ((input=fopen(input_path,"rb"))==NULL) {
+		perror(input_path);
+		return -2;
+	}
+	if (fread(&file_header,sizeof(file_header),1,input)!=1 || memcmp(file_header.magic,RECORD_FILE_MAGIC,sizeof(file_header.magic))!=0) {
+		fprintf(stderr,"%s is not a flight record file.\n",input_path);
+		return -2;
+	}
+	if (file_header.version!=RECORD_FILE_VERSION) {
+		fprintf(stderr,"%s has record layout version %u, this decoder reads version %u.\n",input_path,file_header.version,RECORD_FILE_VERSION);
+		return -2;
+	}
+	if (file_header.block_size<sizeof(file_header) || (block=malloc(file_header.block_size))==NULL) {
+		fprintf(stderr,"Invalid block size %u.\n",file_header.block_size);
+		return -2;
+	}
+	rewind(input);
+
+	for (i=0;i<LOG_COUNT;i++) open_log(&LOGS[i],output_directory);
+
+	start=sizeof(file_header); // The first block starts with the file header
+	while ((length=fread(block,1,file_header.block_size,input))>0) {
+		corrupt_blocks += decode_block(block,length,start,block_number);
+		start=0;
+		block_number++;
+	}
+	if (ferror(input)) {
+		perror(input_path);
+	}
+	fclose(input);
+	free(block);
+
+	for (i=0;i<LOG_COUNT;i++) {
+		close_log(&LOGS[i]);
+		printf("%s: %lu records, %lu dropped in flight\n",LOGS[i].name,LOGS[i].records,LOGS[i].dropped);
+	}
+	if (corrupt_blocks>0) printf("%lu corrupt blocks (partially) skipped\n",corrupt_blocks);
+	return 0;
+}
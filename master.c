@@ -18,20 +18,28 @@
 # include <termios.h> // For UART serial communication
 # include <linux/spi/spidev.h> // For SPI communication
 # include <signal.h> // Catch Ctrl-C
-# include <sys/time.h> // For the (gettimeofday) function used to get millisecond time
 # include <math.h> // For sin(), cos(), etc. functions
 # include <string.h> // For string functions like (strlen)
 # include <pthread.h> // Multi-threading (code parallelization)
+# include <sys/eventfd.h> // For waking up the filtering thread when an IMU frame arrives, and the MSP430 writing thread when a PWM command is posted
 
 # include "control_header.h"
 # include "master_header.h"
 # include "imu_header.h"
 # include "la_header.h"
+# include "kalman_header.h"
 # include "msp430_header.h"
 # include "simplex_header.h"
 # include "rpi_gpio_header.h"
 # include "spycam_header.h"
 # include "pressure_header.h"
+# include "scheduler_header.h"
+# include "timebase_header.h"
+# include "recorder_header.h"
+# include "allocation_header.h"
+# include "valve_header.h"
+# include "io_header.h"
+# include "decimator_header.h"
 
 
 // *********************************************************************
@@ -43,11 +51,28 @@ unsigned long long int ACTIVE__CONTROL_TIME=7000000; ///< Time [us] during which
 unsigned long long int DESCENT__TIME=300000000; ///< Time [us] for rocket descent with parachute (i.e. between parachutes opening and a soft touchdown) // TODO : change this with Xavier!
 unsigned long long int CONTROL__TIME_STEP=20000; ///< =1/(control loop frequency [MHz]), the time interval between applying control, in [us]
 unsigned long long int SPI__READ_TIMESTEP=20000; // Timestep [us] at which pressure/temperature is read from SPI sensor
+unsigned char SPI__TRANSFER_MODE=SPI_TRANSFER_BATCHED; // Read each pressure sensor in one 4-byte SPI transfer without delays (SPI_TRANSFER_BYTEWISE : 4 1-byte transfers with 100 [us] delays)
+unsigned int SPI__DECIMATION=20; // Pressure/temperature is read SPI__DECIMATION times per SPI__READ_TIMESTEP and low-pass filtered down to one reading per SPI__READ_TIMESTEP (1 : a single unfiltered reading)
+unsigned char SPI__DECIMATOR=DECIMATOR_FIR; // Anti-aliasing filter of the decimation (DECIMATOR_CIC : cheaper, but attenuates the passband more)
 unsigned long long int IMU__READ_TIMESTEP=20000; // Timestep [us] at which filtered rocket attitude is obtained
 unsigned long int CALIB__TIME = 5000000; // 5000000 [us]==5 [second] calibration time
+struct RT_config IMU_READER__RT={80,-1}; // Highest priority : the Razor UART stream must be read out as soon as it arrives
+struct RT_config CONTROL__RT={75,-1}; // Real-time priority of the control loop, not pinned to a CPU
+struct RT_config IMU_FILTER__RT={70,-1}; // Real-time priority of the IMU filtering thread, not pinned to a CPU
+struct RT_config SPI__RT={60,-1}; // Pressure data is only logged, so lowest real-time priority
+struct RT_config MSP430_WRITER__RT={77,-1}; // Above the control loop, so that a posted PWM command goes out at once
+struct RT_config MSP430_READER__RT={0,-1}; // Not real-time : the MSP430 telemetry is only used for link statistics
+struct RT_config IO__RT={80,-1}; // Same as the IMU reading thread, whose job it takes over (with those of the SPI and MSP430 threads) when IO__MODE==IO_MODE_REACTOR
+struct RT_config RECORDER__RT={0,-1}; // Not real-time : writing to the SD card must only use the CPU time left by the other threads
+unsigned long long int RECORDER__WRITE_TIMESTEP=50000; // Timestep [us] at which the flight recorder collects the queued records
+unsigned long long int RECORDER__FSYNC_TIMESTEP=1000000; // At most 1 [s] of flight data is lost if the power is cut
+unsigned char IMU__FILTER_MODE=IMU_FILTER_MODE_EVENT; // Filter each IMU frame as soon as it is received (IMU_FILTER_MODE_PERIODIC : every IMU__READ_TIMESTEP)
+unsigned char IO__MODE=IO_MODE_REACTOR; // Serve the Razor IMU, the pressure sensors and the MSP430 from a single epoll thread (IO_MODE_THREADS : one thread per device)
 
 unsigned char SPI_quit=0; // By default don't quit reading the pressure sensor!
 unsigned char IMU_quit=0; // By default don't quit reading the pressure sensor!
+unsigned char MSP430_quit=0; // By default don't quit writing to and reading from the MSP430!
+unsigned char IO_quit=0; // By default don't quit serving the devices!
 
 unsigned int PWM1=0; // PWM value for the R1 valve
 unsigned int PWM2=0; // PWM value for the R2 valve
@@ -58,6 +83,8 @@ double R2=0; // Valve R2 thrust
 double R3=0; // Valve R3 thrust
 double R4=0; // Valve R4 thrust
 
+char VALVE__CALIBRATION_FILE[]="./valve_calibration.txt"; // Calibrated curve of each valve ([R1] to [R4] sections of "PWM thrust" lines), the built-in PWM_valve_charac/R_valve_charac curve is used for all valves if it does not exist
+
 double d=0.005; // [m] offset distance of RCS valves from centerline (for roll control)
 double Fpitch=0; // Pitch force (parallel to body -Z axis, so as to produce positive pitch rate when Fpitch>0 (right hand rule))
 double Fyaw=0; // Yaw force (parallel to body +Y axis, so as to produce positive yaw rate when Fyaw>0 (right hand rule))
@@ -68,6 +95,8 @@ int M1=0; // No (<=) type inequality constraints
 int M2=0; // No (>=) type inequality constraints
 int M3=3; // 3 (=) type constraints (for Fpitch, Fyaw, Mroll)
 int M=3; // Total number of constraints (M=M1+M2+M3)
+unsigned char ALLOCATION__MODE=ALLOCATION_BOUNDED; // Distribute the control demand over the valves analytically, within VALVE__MAX_THRUST (ALLOCATION_TABLE : same with the roll angle cosine/sine from a table, ALLOCATION_CLOSED_FORM : unbounded, ALLOCATION_SIMPLEX : with the Simplex method)
+unsigned char ALLOCATION__PRIORITY=ALLOCATION_PRIORITY_PITCH_YAW; // When the valves saturate, keep the pitch/yaw force and give up roll moment first (ALLOCATION_PRIORITY_ROLL : the opposite)
 
 /**
  * @name Control algorithm input variables
@@ -82,6 +111,7 @@ float theta_cont=0; ///< Pitch angle
 float thetadot_cont=0; ///< Pitch rate
 float phi_cont=0; ///< Roll angle
 float wx_cont=0; ///< X-body rate
+struct Attitude_snapshot attitude_cont; ///< Attitude estimate which the above 6 variables were taken from (see Get_attitude_snapshot())
 /** @} */
 
 /**
@@ -99,9 +129,6 @@ float wx_ref=0; ///< Roll rate reference [(rad)/s]
 char flight_type=0; ///< =1 for active control flight, =0 for passive flight (i.e. only data logging)
 
 FILE *error_log=NULL;
-FILE *pressure_log=NULL;
-FILE *imu_log=NULL;
-FILE *control_log=NULL;
 
 struct bcm2835_peripheral gpio = {GPIO_BASE}; ///< Our access register to the Raspberry Pi's GPIOs
 unsigned char launch_detect_gpio=12; ///< Number of GPIO (i.e. GPIO<num>) to which the launch umbillical cable is connected and hence which detects the launch
@@ -117,7 +144,7 @@ unsigned char launch_detect_gpio=12; ///< Number of GPIO (i.e. GPIO<num>) to whi
  * data logging. It accepts no input parameters.
  */
 int main(void) {
-	gettimeofday(&GLOBAL__TIME_STARTPOINT, NULL); // Get starting point for timing just before beginning the calibration
+	Timebase_init(); // Get starting point for timing just before beginning the calibration
 
 	//############################ DATA LOGGING SETUP START ############################
 	if (pthread_mutex_init(&error_log_write_lock, NULL) != 0) { // Initialize the mutex lock protecting from writing into error file simultaneously by more than 1 thread
@@ -125,17 +152,23 @@ int main(void) {
 		exit(-2);
 	}
 
+	Boot_phase_start("Log files");
 	printf("Opening log files... ");
 
 	open_error_file(&error_log,"./logs/error_log.txt","w");
-	open_file(&pressure_log,"./logs/pressure_log.txt","w",error_log);
-	open_file(&imu_log,"./logs/imu_log.txt","w",error_log);
-	open_file(&control_log,"./logs/control_log.txt","w",error_log);
+	Recorder_init("./logs/flight_record.bin"); // IMU, pressure and control data (see the log decoder)
 
 	printf("opened.\n");
+
+	pthread_t Recorder_thread;
+	if (pthread_create(&Recorder_thread,NULL,Recorder_write_parallel,NULL)) {
+		perror("Failed to create flight recorder thread.");
+		exit(-2);
+	}
 	//############################ DATA LOGGING SETUP END ##############################
 
 	//############################ CAMERA RECORDING SETUP START ##############################
+	Boot_phase_start("Camera start");
 	stopVideo();
 	printf("Starting spy camera recording... ");
 	startVideo("flight_recording.h264", "");
@@ -144,6 +177,7 @@ int main(void) {
 	//############################ CAMERA RECORDING SETUP END ################################
 
 	//############################ GPIO SETUP START #################################
+	Boot_phase_start("GPIO setup");
 	if(map_peripheral(&gpio) == -1) {
 		printf("Failed to map the physical GPIO registers into the virtual memory space.\n");
 		stopVideo();
@@ -156,6 +190,7 @@ int main(void) {
 	// Here we open the SPI connection to the Honeywell HSC (differential) pressure sensors
 	// Radial sensor captures pressure on side of nose cone
 	// Axial sensor capture pressure right at tip of nose cone, looking into the head wind
+	Boot_phase_start("SPI connect");
 
 	SPI_config.mode=0;
 	SPI_config.bits=8;
@@ -170,18 +205,21 @@ int main(void) {
 	SPI_config.radial_sensor_fd=0;
 	SPI_config.axial_sensor_fd=0;
 
-	int ii;
-	for (ii=0;ii<SPI_config.buffer_length;ii++) {
-		data[ii]=0; // Reset the value in data buffer to zero ==> send whatever (MOSI line not connected to sensor anyway), receive back the sensor reading
-
-		memset(transfer+ii,0,sizeof(struct spi_ioc_transfer)); // Reset transfer struct to NULL, otherwise does not work!
-		transfer[ii].tx_buf = (unsigned long)(data+ii);	// Buffer for SENDING data (MOSI)
-		transfer[ii].rx_buf = (unsigned long)(data+ii); //  Buffer for RECEIVING data (MISO)
-		transfer[ii].len = sizeof(*(data+i)); // Length of buffer, i.e. size in bytes of data[i] (NB: data[i]==*(data+i) in pointer arithmetic)
-		transfer[ii].speed_hz = SPI_config.max_speed; // Speed in [Hz]
-		transfer[ii].bits_per_word = SPI_config.bits; // Bits per transmission ("per word")
-		transfer[ii].delay_usecs = 100; // Delay in [us]
-		transfer[ii].cs_change = 0;
+	Pressure_transfer_setup(&SPI_config); // SPI transfers of SPI__TRANSFER_MODE
+	Pressure_decimation_setup(&SPI_config); // Filtering of the readings down to one per SPI__READ_TIMESTEP
+	unsigned char decimator_type;
+	for (decimator_type=DECIMATOR_FIR;decimator_type<=DECIMATOR_CIC;decimator_type++) {
+		double decimator_error=Decimator_self_test(decimator_type);
+		printf("Pressure decimator (%s) self-test: max deviation of the DC and step responses = %g ",(decimator_type==DECIMATOR_FIR) ? "FIR" : "CIC",decimator_error);
+		if (decimator_error>DECIMATOR_SELF_TEST_TOLERANCE) {
+			printf("(FAILED).\n");
+			sprintf(ERROR_MESSAGE,"Pressure decimator (%s) self-test failed: max deviation %g > %g\n",(decimator_type==DECIMATOR_FIR) ? "FIR" : "CIC",decimator_error,DECIMATOR_SELF_TEST_TOLERANCE);
+			pthread_mutex_lock(&error_log_write_lock);
+			write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+			pthread_mutex_unlock(&error_log_write_lock);
+		} else {
+			printf("(OK).\n");
+		}
 	}
 
 	printf("Connecting to Honeywell sensors... ");
@@ -195,38 +233,92 @@ int main(void) {
 	printf(MESSAGE);
 
 	// Now temporarily read sensor values to make sure that everything is OK with sensor readings before flight
+	Boot_phase_end();
 	printf("Type [TEST] to view pressure sensor readings: ");
 	Treat_reply("TEST");
 
-	pthread_t SPI_pressure_thread;
-
-	if (pthread_create(&SPI_pressure_thread,NULL,get_readings_SPI_parallel,(void *) &SPI_config)) { // (void *) &SPI_config means cast a pointer to a (struct SPI_data) to a pointer to a (void), which is the only thing a pthread can accept
+	pthread_t SPI_pressure_thread, IO_thread;
+	struct IO_source pressure_source, razor_source, msp430_source, PWM_command_source; // Devices served by IO_thread (IO_MODE_REACTOR only)
+	// High-rate (decimated) pressure reading stays in its own low priority thread, out of the reactor which runs above the control loop
+	unsigned char pressure_in_reactor=(IO__MODE==IO_MODE_REACTOR && SPI__DECIMATION==1);
+
+	if (IO__MODE==IO_MODE_REACTOR) {
+		IO_reactor_init();
+		if (pthread_create(&IO_thread,NULL,IO_reactor_parallel,NULL)) {
+			perror("Failed to create I/O reactor thread.");
+			stopVideo();
+			exit(-2);
+		}
+	}
+	if (pressure_in_reactor) {
+		IO_reactor_add_timer(&pressure_source,"SPI pressure reading",Pressure_sample_period(),IO_pressure_handle,&SPI_config);
+	} else if (pthread_create(&SPI_pressure_thread,NULL,get_readings_SPI_parallel,(void *) &SPI_config)) { // (void *) &SPI_config means cast a pointer to a (struct SPI_data) to a pointer to a (void), which is the only thing a pthread can accept
 		perror("Failed to create SPI pressure sensor thread.");
 		stopVideo();
 		exit(-2);
 	}
 
-	gettimeofday(&before_loop, NULL); // Get starting point for timing just before beginning the calibration
-	gettimeofday(&before_control, NULL);
+	struct Periodic_task display_task; // Cadence of the loops displaying the sensor values before flight
+	float radial_spread, axial_spread; // Spread of the raw pressures filtered into each displayed one
+	Periodic_task_start(&display_task,"Pressure display",SPI__READ_TIMESTEP); // Get starting point for timing just before beginning the calibration
 	do {
-		check_time(&now_loop,before_loop,elapsed_loop,&time_loop);
-
-		passive_wait(&now_control,&before_control,&elapsed_control,&time_control,SPI__READ_TIMESTEP);
+		Periodic_task_wait(&display_task);
 
-		printf("radial_status: %u\t radial p: %.4f \t radial T: %.4f \t axial_status: %u \t axial p: %.4f \t axial T: %.4f\n",radial_status,radial_pressure,radial_temperature,axial_status,axial_pressure,axial_temperature);
-	} while(time_loop<=CALIB__TIME); // Show pressure values until CALIB__TIME elapses (don't define separate time variable for conciseness)
+		Pressure_history_spread(&SPI_config,SPI__DECIMATION,&radial_spread,&axial_spread);
+		printf("radial_status: %u\t radial p: %.4f (raw spread %.4f) \t radial T: %.4f \t axial_status: %u \t axial p: %.4f (raw spread %.4f) \t axial T: %.4f\n",radial_status,radial_pressure,radial_spread,radial_temperature,axial_status,axial_pressure,axial_spread,axial_temperature);
+	} while(display_task.elapsed<=CALIB__TIME); // Show pressure values until CALIB__TIME elapses (don't define separate time variable for conciseness)
 
 	printf("\nIs this OK? Type [Calibrate] to continue: ");
 	Treat_reply("Calibrate");
 	//############################ PRESSURE SENSOR SETUP END #################################
 
 	//############################ CONTROL SETUP START ############################
+	Boot_phase_start("Control and valve setup");
+	// Valve curves (thrust -> PWM), all parsed, checked and tabulated now so that the control loop only looks them up
+	int valve, valve_status=Valve_calibration_load(valve_curves,VALVE__CALIBRATION_FILE);
+	if (valve_status==VALVE_CURVE_NO_FILE) {
+		printf("No valve calibration file %s, using the built-in valve curve for all valves.\n",VALVE__CALIBRATION_FILE);
+		for (valve=0;valve<VALVE_COUNT && valve_status!=VALVE_CURVE_INVALID;valve++) {
+			valve_status=Valve_curve_init(&valve_curves[valve],PWM_valve_charac,R_valve_charac,VALVE_CHARAC_RESOLUTION);
+		}
+	}
+	if (valve_status!=VALVE_CURVE_OK) {
+		printf("Invalid valve calibration: %s",ERROR_MESSAGE);
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+		exit(-2);
+	}
+	for (valve=0;valve<VALVE_COUNT;valve++) {
+		unsigned int valve_error=Valve_curve_self_test(&valve_curves[valve]);
+		printf("Valve R%d curve (%u points, %.3f [N] max) self-test: max deviation from a linear search = %u [PWM] ",valve+1,valve_curves[valve].points,valve_curves[valve].thrust[valve_curves[valve].points-1],valve_error);
+		if (valve_error>VALVE_CURVE_SELF_TEST_TOLERANCE) {
+			printf("(FAILED).\n");
+			sprintf(ERROR_MESSAGE,"Valve R%d curve self-test failed: max deviation %u > %d [PWM]\n",valve+1,valve_error,VALVE_CURVE_SELF_TEST_TOLERANCE);
+			pthread_mutex_lock(&error_log_write_lock);
+			write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+			pthread_mutex_unlock(&error_log_write_lock);
+		} else {
+			printf("(OK).\n");
+		}
+	}
+	// The allocation, the roll loop saturation and the thrust clips all assume that every valve reaches VALVE__MAX_THRUST
+	double valve_max_thrust=Valve_curves_max_thrust(valve_curves);
+	if (valve_max_thrust<VALVE__MAX_THRUST) {
+		sprintf(ERROR_MESSAGE,"The weakest calibrated valve tops out at %.3f [N] < VALVE__MAX_THRUST=%.3f [N], which is lowered to it.\n",valve_max_thrust,VALVE__MAX_THRUST);
+		printf("%s",ERROR_MESSAGE);
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+		VALVE__MAX_THRUST=valve_max_thrust;
+	}
+
 	printf("Setting up control coefficients... ");
 
 	// The below coefficients were developed through MATLAB/Simulink control loop design. They are hard-coded here.
 	Fpitch_loop_control_setup();
 	Fyaw_loop_control_setup();
-	Mroll_loop_control_setup();
+	Mroll_loop_control_setup(); // Saturated with VALVE__MAX_THRUST, so after the valve curves
 
 	printf("setup.\n");
 	//############################ CONTROL SETUP END ##############################
@@ -237,6 +329,7 @@ int main(void) {
 	// Maybe the steps below also work for UART connections to other devices
 	// Main idea : order step 1. ---> step 4. _M_A_T_T_E_R_S_ !!!
 	// 1. Define UART options that we want for the Razor IMU
+	Boot_phase_start("Razor IMU setup");
 	memset(&new_razor_uart_options,0,sizeof(new_razor_uart_options));
 	new_razor_uart_options.c_iflag = 0;
 	new_razor_uart_options.c_oflag = 0;
@@ -255,25 +348,41 @@ int main(void) {
 	set_to_blocking(RAZOR_UART);
 	set_new_attr(RAZOR_UART,&old_razor_uart_options,&new_razor_uart_options);
 
-	R_MATRIX=initMatrix(3,3);
-	DCM_MATRIX=initMatrix(3,3);
+	SPSC_ring_init(&IMU_ring,IMU_ring_buffer,sizeof(struct IMU_frame),IMU_RING_SIZE); // Queue through which the IMU frames are passed on
+	Seqlock_init(&attitude_snapshot_lock); // Protects the filtered attitude handed from the filtering thread to the control loop
+	if (IMU__FILTER_MODE==IMU_FILTER_MODE_EVENT) {
+		if ((IMU_frame_event=eventfd(0,EFD_NONBLOCK))<0) { // Lets the IMU reading thread wake up the filtering thread
+			perror("Failed to create IMU frame event.");
+			stopVideo();
+			exit(-2);
+		}
+	}
 
 	// Begin IMU reading thread
 	pthread_t IMU_thread;
-	if (pthread_create(&IMU_thread,NULL,read_IMU_parallel,NULL)) {
+	struct IMU_parser razor_parser; // Decoding state of the Razor IMU stream (IO_MODE_REACTOR only, read_IMU_parallel() has its own)
+	if (IO__MODE==IO_MODE_REACTOR) {
+		IMU_configure_stream();
+		set_to_nonblocking(RAZOR_UART);
+		IMU_parser_init(&razor_parser);
+		IO_reactor_add(&razor_source,"Razor IMU",RAZOR_UART,IO_razor_handle,IO_razor_tick,&razor_parser); // The first tick requests the sync token
+	} else if (pthread_create(&IMU_thread,NULL,read_IMU_parallel,NULL)) {
 		perror("Failed to create IMU reading thread.");
 		stopVideo();
 		exit(-2);
 	}
-	// From now on, raw IMU data is available for access from all threads!
+	// From now on, raw IMU frames arrive in IMU_ring!
 
-	while (!IMU_SYNCHED) {} // Wait for sync from IMU
+	Boot_phase_start("IMU sync");
+	IMU_wait_synched(); // Wait for sync from IMU
+	Boot_phase_start("IMU calibration");
 	usleep(IMU__READ_TIMESTEP); // Wait to be sure that now reading IMU data properly (not 0,0,0 angles...)
 
 	Calibrate_IMU(); // Calibrate IMU
 	construct_zeroed_DCM();
 	zero_Euler_angles();
 	psi_save_last=psi_save; theta_save_last=theta_save; phi_save_last=phi_save;
+	Boot_phase_end();
 
 	printf("\n\nFinished calibrating. The zeroed angles are now:\n\n");
 	sprintf(MESSAGE,"Yaw (psi) = %.4f\nPitch (theta) = %.4f\nRoll (phi) = %.4f\n\n",TO_DEG(psi_save),TO_DEG(theta_save),TO_DEG(phi_save));
@@ -284,21 +393,14 @@ int main(void) {
 
 	//############################ SIGNAL FILTERING SETUP START ############################
 	// Here we begin filtering the IMU euler angles and rates using the Kalman filter
+	Boot_phase_start("Filter setup");
 	/////////////////////////////// PSI FILTER SETUP ///////////////////////////////
-	P_psi=initMatrix(2,2); // Initial covariance matrix of the psi estimate
-	P_psidot=initMatrix(2,2);
-	x_psi=initMatrix(2,1);
-	x_psidot=initMatrix(2,1);
-	Q_psi=initMatrix(2,2); // State error covariance matrix for psi,psi_dot
-	Q_psidot=initMatrix(2,2);
-	R_psi=initMatrix(1,1); // Output covariance matrix for psi,psi_dot
-	R_psidot=initMatrix(1,1);
-
+	// The filter matrices are fixed-size (see la_header.h), so nothing needs to be allocated here
 	P_psi.matrix[0][0] = 1;		P_psi.matrix[0][1] = 0;
-	P_psi.matrix[0][1] = 0;		P_psi.matrix[1][1] = 1;
+	P_psi.matrix[1][0] = 0;		P_psi.matrix[1][1] = 1;
 
 	P_psidot.matrix[0][0] = 1;		P_psidot.matrix[0][1] = 0;
-	P_psidot.matrix[0][1] = 0;		P_psidot.matrix[1][1] = 1;
+	P_psidot.matrix[1][0] = 0;		P_psidot.matrix[1][1] = 1;
 
 	x_psi.matrix[0][0] = 0;
 	x_psi.matrix[1][0] = 0;
@@ -307,10 +409,10 @@ int main(void) {
 	x_psidot.matrix[1][0] = 0;
 
 	Q_psi.matrix[0][0] = 0.01;	Q_psi.matrix[0][1] = 0;
-	Q_psi.matrix[0][1] = 0;		Q_psi.matrix[1][1] = 100;
+	Q_psi.matrix[1][0] = 0;		Q_psi.matrix[1][1] = 100;
 
 	Q_psidot.matrix[0][0] = 200;	Q_psidot.matrix[0][1] = 0;
-	Q_psidot.matrix[0][1] = 0;		Q_psidot.matrix[1][1] = 200;
+	Q_psidot.matrix[1][0] = 0;		Q_psidot.matrix[1][1] = 200;
 
 	R_psi.matrix[0][0] = 10;
 	R_psidot.matrix[0][0] = 5000;
@@ -337,32 +439,94 @@ int main(void) {
 	R_phidot=R_psidot;
 
 	// Define the [2x2] identity matrix
-	EYE2=initMatrix(2,2);
 	EYE2.matrix[0][0]=1;	EYE2.matrix[0][1]=0;
 	EYE2.matrix[1][0]=0;	EYE2.matrix[1][1]=1;
 
-	//--------------- Allocate space for other matrices used in Kalman filtering -----------
-	A_kalman=initMatrix(2,2);
-	C_kalman=initMatrix(1,2);
-	z_temp = initMatrix(1,1);
-	inn = initMatrix(1,1);
-	S = initMatrix(1,1);
-	K = initMatrix(2,1);
-
-	A_kalman.matrix[0][0]=1;
+	//--------------- Define the discrete-time model used in Kalman filtering -----------
+	A_kalman.matrix[0][0]=1;	A_kalman.matrix[0][1]=0; // A_kalman.matrix[0][1] is set to dt at each Kalman_filter() call
 	A_kalman.matrix[1][0]=0;
 	A_kalman.matrix[1][1]=1;
 
 	C_kalman.matrix[0][0]=1;	C_kalman.matrix[0][1]=0;
 	//---------------------------------------------------------------------------------------
 
+	//--------------- Load the filters into the filter bank and check it -----------
+	Kalman_bank_init(&attitude_filter);
+	Kalman_bank_set_channel(&attitude_filter,KALMAN_PSI,&x_psi,&P_psi,&Q_psi,&R_psi);
+	Kalman_bank_set_channel(&attitude_filter,KALMAN_PSIDOT,&x_psidot,&P_psidot,&Q_psidot,&R_psidot);
+	Kalman_bank_set_channel(&attitude_filter,KALMAN_THETA,&x_theta,&P_theta,&Q_theta,&R_theta);
+	Kalman_bank_set_channel(&attitude_filter,KALMAN_THETADOT,&x_thetadot,&P_thetadot,&Q_thetadot,&R_thetadot);
+	Kalman_bank_set_channel(&attitude_filter,KALMAN_PHI,&x_phi,&P_phi,&Q_phi,&R_phi);
+	Kalman_bank_set_channel(&attitude_filter,KALMAN_PHIDOT,&x_phidot,&P_phidot,&Q_phidot,&R_phidot);
+
+	float bank_error=Kalman_bank_self_test(&attitude_filter);
+	printf("Kalman filter bank (%s) self-test: max deviation from Kalman_filter() and Kalman_filter_cv() = %g ",KALMAN_BANK_IMPLEMENTATION,bank_error);
+	if (bank_error>KALMAN_BANK_TOLERANCE) {
+		printf("(FAILED).\n");
+		sprintf(ERROR_MESSAGE,"Kalman filter bank (%s) self-test failed: max deviation %g > %g\n",KALMAN_BANK_IMPLEMENTATION,bank_error,KALMAN_BANK_TOLERANCE);
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+	} else {
+		printf("(OK).\n");
+	}
+	unsigned int timing_failures=IMU_timing_self_test();
+	printf("IMU time step self-test (bunched, out of order and lost frames): %u failed filter updates ",timing_failures);
+	if (timing_failures>0) {
+		printf("(FAILED).\n");
+		sprintf(ERROR_MESSAGE,"IMU time step self-test failed: %u filter updates out of bounds or not finite\n",timing_failures);
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+	} else {
+		printf("(OK).\n");
+	}
+	Allocation_table_init(); // Roll angle cosine/sine table of the ALLOCATION_TABLE mode
+	Simplex_context_init(&allocation_simplex); // No previous basis yet for the ALLOCATION_SIMPLEX mode
+	double allocation_error=Allocation_self_test();
+	printf("Closed-form thrust allocation self-test: max deviation from the Simplex solution = %g [N] ",allocation_error);
+	if (allocation_error>ALLOCATION_SELF_TEST_TOLERANCE) {
+		printf("(FAILED).\n");
+		sprintf(ERROR_MESSAGE,"Closed-form thrust allocation self-test failed: max deviation %g > %g [N]\n",allocation_error,ALLOCATION_SELF_TEST_TOLERANCE);
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+	} else {
+		printf("(OK).\n");
+	}
+	allocation_error=Allocation_bounded_self_test();
+	printf("Bounded thrust allocation self-test: max bound violation or deviation = %g [N] ",allocation_error);
+	if (allocation_error>ALLOCATION_SELF_TEST_TOLERANCE) {
+		printf("(FAILED).\n");
+		sprintf(ERROR_MESSAGE,"Bounded thrust allocation self-test failed: max bound violation or deviation %g > %g [N]\n",allocation_error,ALLOCATION_SELF_TEST_TOLERANCE);
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+	} else {
+		printf("(OK).\n");
+	}
+	allocation_error=Allocation_table_self_test();
+	printf("Table thrust allocation accuracy (%d roll angles): max deviation from the exact solution = %g [N] ",ALLOCATION_TABLE_SIZE,allocation_error);
+	if (allocation_error>ALLOCATION_TABLE_TOLERANCE) {
+		printf("(FAILED).\n");
+		sprintf(ERROR_MESSAGE,"Table thrust allocation accuracy check failed: max deviation %g > %g [N]\n",allocation_error,ALLOCATION_TABLE_TOLERANCE);
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+	} else {
+		printf("(OK).\n");
+	}
+	//---------------------------------------------------------------------------------------
+
 	// Now spend 5 seconds filtering the signals
 	// Then we are sure that {psi,psi_dot,theta,theta_dot,phi,phi_dot} signals are well filtered and all *_last variables are
 	// available such that we can ready ourselves for passing into the main control loop upon launch detection
+	Boot_phase_start("Filter warmup");
 	printf("Beginning Kalman filtering in 1 second.\n"); fflush(stdout);
 	usleep(1000000);
 
 	//----------- Create filtering thread
+	pthread_t MSP430_writer_thread, MSP430_reader_thread; // Started with the MSP430 (active flight only)
 	pthread_t Filt_thread;
 	if (pthread_create(&Filt_thread,NULL,get_filtered_attitude_parallel,NULL)) {
 		perror("Failed to create filtering thread.");
@@ -370,17 +534,16 @@ int main(void) {
 		exit(-2);
 	}
 
-	gettimeofday(&before_loop, NULL);
-	gettimeofday(&before_control, NULL);
+	Periodic_task_start(&display_task,"Filtered attitude display",IMU__READ_TIMESTEP);
 	do {
-		check_time(&now_loop,before_loop,elapsed_loop,&time_loop);
-
-		passive_wait(&now_control,&before_control,&elapsed_control,&time_control,IMU__READ_TIMESTEP);
+		Periodic_task_wait(&display_task);
 
-		printf("dt: %.4f \t psi_filt: %.2f \t psi_dot_filt: %.2f \t theta_filt: %.2f \t theta_dot_filt: %.2f \t phi_filt: %.2f \t phi_dot_filt: %.2f\n",dt,psi_filt,psi_dot_filt,theta_filt,theta_dot_filt,phi_filt,phi_dot_filt);
-	} while(time_loop<=CALIB__TIME);
+		Get_attitude_snapshot(&attitude_cont);
+		printf("epoch: %lu \t psi_filt: %.2f \t psi_dot_filt: %.2f \t theta_filt: %.2f \t theta_dot_filt: %.2f \t phi_filt: %.2f \t phi_dot_filt: %.2f\n",attitude_cont.epoch,attitude_cont.psi,attitude_cont.psi_dot,attitude_cont.theta,attitude_cont.theta_dot,attitude_cont.phi,attitude_cont.phi_dot);
+	} while(display_task.elapsed<=CALIB__TIME);
 
 	printf("\n\nFinished filtering.\n");
+	Boot_profile_report();
 	printf("Is this OK? Type [Continue] to continue: ");
 	Treat_reply("Continue");
 	//############################ SIGNAL FILTERING SETUP END ############################
@@ -417,15 +580,43 @@ int main(void) {
 
 			// Just in case MSP430 has not reset (is not at start of program), we attempt to reset it even before saying "hi"
 			printf("Resetting MSP430G2553 microcontroller..."); fflush(stdout);
-			MSP430_UART_write("@e!");
+			if (MSP430_UART_write("@e!")>0) printf(" (not all bytes confirmed)"); // Best effort : the start handshake below is checked
 			usleep(500000); // Wait to make sure MSP430 has had time to back to start of program and begin waiting for a start handshake ("@s!")
 			printf(" reset.\n");
 
 			// Now start the MSP430
 			printf("Saying Hi to MSP430G2553 slave microcontroller (sending \"@s!\")... "); fflush(stdout);
-			MSP430_UART_write("@s!"); // Write the agreed-upon message (@s!) which the MSP430 code understands as
+			int unconfirmed=MSP430_UART_write("@s!"); // Write the agreed-upon message (@s!) which the MSP430 code understands as
 									  // "Raspberry Pi master is telling me to turn on my interrupts, play my warning message and enter my main while(1) loop"
+			if (unconfirmed>0) { // The MSP430 did not answer : an active flight would have no valves
+				printf("FAILED.\n");
+				sprintf(ERROR_MESSAGE,"MSP430 did not confirm %d of the 3 bytes of the start handshake (\"@s!\")\n",unconfirmed);
+				pthread_mutex_lock(&error_log_write_lock);
+				write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+				pthread_mutex_unlock(&error_log_write_lock);
+				exit(-2);
+			}
 			printf("sent.\n");
+			// From now on, the control loop only posts PWM commands : a thread sends them as frames and another one collects the telemetry acknowledging them
+			Mailbox_init(&PWM_mailbox,PWM_mailbox_buffer,sizeof(struct PWM_command));
+			if ((PWM_command_event=eventfd(0,EFD_NONBLOCK))<0) { // Lets the control loop wake up the writing thread
+				perror("Failed to create PWM command event.");
+				exit(-2);
+			}
+			if (IO__MODE==IO_MODE_REACTOR) {
+				set_to_nonblocking(MSP430_UART);
+				IO_reactor_add(&msp430_source,"MSP430 telemetry",MSP430_UART,IO_msp430_handle,NULL,NULL);
+				IO_reactor_add(&PWM_command_source,"MSP430 PWM commands",PWM_command_event,IO_PWM_command_handle,NULL,NULL);
+			} else {
+				if (pthread_create(&MSP430_writer_thread,NULL,MSP430_write_PWM_parallel,NULL)) {
+					perror("Failed to create MSP430 writing thread.");
+					exit(-2);
+				}
+				if (pthread_create(&MSP430_reader_thread,NULL,MSP430_read_telemetry_parallel,NULL)) {
+					perror("Failed to create MSP430 telemetry reading thread.");
+					exit(-2);
+				}
+			}
 			usleep(10000000); // Wait 10 seconds while MSP430 plays the warning sound that it has been activated (that "@s!" start program instruction has been received)
 			//############################ MSP430 SETUP END ############################
 
@@ -453,23 +644,23 @@ int main(void) {
 		printf("\nENGINE BURNOUT! Activating control loop.\n\n");
 
 		//############################ CONTROL LOOP START ############################
-		char CONTROL_MESSAGE[200];
-		write_to_file_custom(control_log,"time_control_glob \t control_time \t Fpitch \t Fyaw \t Mroll \t R1 \t R2 \t R3 \t R4 \t PWM1 \t PWM2 \t PWM3 \t PWM4\n",error_log);
+		struct Control_record control_record; // Flight recorder record
 
-		gettimeofday(&before_control, NULL);
-		gettimeofday(&before_loop, NULL);
+		struct Periodic_task control_task;
+		Thread_set_realtime("control",&CONTROL__RT);
+		Periodic_task_start(&control_task,"Control",CONTROL__TIME_STEP);
 		do { // Active control with RCS (Reaction Control System)
-			check_time(&now_control_glob,GLOBAL__TIME_STARTPOINT,elapsed_control_glob,&time_control_glob);
-			check_time(&now_loop,before_loop,elapsed_loop,&time_loop);
+			Periodic_task_wait(&control_task);
 
-			passive_wait(&now_control,&before_control,&elapsed_control,&time_control,CONTROL__TIME_STEP);
+			control_record.time_control_glob=time_since_start_us(); // Time [us] since #GLOBAL__TIME_STARTPOINT at which the control iteration starts
 
-			psi_cont=psi_filt;
-			psidot_cont=psi_dot_filt;
-			theta_cont=theta_filt;
-			thetadot_cont=theta_dot_filt;
-			phi_cont=phi_filt;
-			wx_cont=wx;
+			Get_attitude_snapshot(&attitude_cont); // All 6 values below come from the same filter update
+			psi_cont=attitude_cont.psi;
+			psidot_cont=attitude_cont.psi_dot;
+			theta_cont=attitude_cont.theta;
+			thetadot_cont=attitude_cont.theta_dot;
+			phi_cont=attitude_cont.phi;
+			wx_cont=attitude_cont.wx;
 
 			/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 			 *%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%% APPLY CONTROL LAW %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
@@ -484,24 +675,10 @@ int main(void) {
 			Mroll = Mroll_loop.K*(wx_cont-wx_ref); // P controller
 
 			/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
-			 *%%%%%%%%%%%%%%%%%%%%%%%%%%% SIMPLEX OPTIMAL THRUST ALLOCATOR %%%%%%%%%%%%%%%%%%%%%%%%%%
+			 *%%%%%%%%%%%%%%%%%%%%%%%%%%%%%% OPTIMAL THRUST ALLOCATOR %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 			 *%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
-			// Create Simplex parameter matrix
-			A[1][1]=0; A[1][2]=-1; A[1][3]=-1; A[1][4]=-1; A[1][5]=-1; // Cost function (negative since we want to minimize), A[1][1] is
-																	   // constant term which is zero for cost function
-			// Fpitch equality constraint
-			if (Fpitch>=0) { A[2][1]=Fpitch; A[2][2]=cos(phi_cont); A[2][3]=-sin(phi_cont); A[2][4]=-cos(phi_cont); A[2][5]=sin(phi_cont); }
-			else { A[2][1]=-Fpitch; A[2][2]=-cos(phi_cont); A[2][3]=sin(phi_cont); A[2][4]=cos(phi_cont); A[2][5]=-sin(phi_cont); }
-			// Fyaw equality constraint
-			if (Fyaw>=0) { A[3][1]=Fyaw; A[3][2]=sin(phi_cont); A[3][3]=cos(phi_cont); A[3][4]=-sin(phi_cont); A[3][5]=-cos(phi_cont); }
-			else { A[3][1]=-Fyaw; A[3][2]=-sin(phi_cont); A[3][3]=-cos(phi_cont); A[3][4]=sin(phi_cont); A[3][5]=cos(phi_cont); }
-			// Mroll equality constraint
-			if (Mroll>=0) { A[4][1]=Mroll; A[4][2]=d; A[4][3]=-d; A[4][4]=d; A[4][5]=-d; }
-			else { A[4][1]=-Mroll; A[4][2]=-d; A[4][3]=d; A[4][4]=-d; A[4][5]=d; }
-
-			simplx(A,M,N,M1,M2,M3,&ICASE,IZROV,IPOSV); // Solve linear optimization problem using the Simplex method
-			get_simplex_solution(ICASE,IPOSV,A,M,N,&R1,&R2,&R3,&R4); // Push simplex optimal result into the R1, R2, R3, R4 valve thrust variables
-			// Saturate valve thrusts to VALVE__MAX_THRUST
+			control_record.allocation_status=Allocate_thrust(Fpitch,Fyaw,Mroll,phi_cont,&R1,&R2,&R3,&R4); // Least total thrust R1, R2, R3, R4 producing Fpitch, Fyaw, Mroll
+			// Saturate valve thrusts to VALVE__MAX_THRUST (only the unbounded allocation modes exceed it)
 			if (R1>=VALVE__MAX_THRUST) R1=VALVE__MAX_THRUST;
 			if (R2>=VALVE__MAX_THRUST) R2=VALVE__MAX_THRUST;
 			if (R3>=VALVE__MAX_THRUST) R3=VALVE__MAX_THRUST;
@@ -513,18 +690,38 @@ int main(void) {
 			// First, convert thrust values to PWM (PWM values 0-1023, i.e. 10-bit PWM)
 			search_PWM(R1,R2,R3,R4,&PWM1,&PWM2,&PWM3,&PWM4);
 
-			// Send PWM values to MSP430
-			MSP430_UART_write_PWM(PWM1,PWM2,PWM3,PWM4);
+			// Hand PWM values to the MSP430 writing thread (never blocks)
+			MSP430_post_PWM(PWM1,PWM2,PWM3,PWM4);
 
 			/*%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 			 *%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%% LOG DATA %%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%
 			 *%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%%*/
 
-			sprintf(CONTROL_MESSAGE,"%llu\t%llu\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%.5f\t%u\t%u\t%u\t%u\n",time_control_glob,time_control,Fpitch,Fyaw,Mroll,R1,R2,R3,R4,PWM1,PWM2,PWM3,PWM4);
-			write_to_file_custom(control_log,CONTROL_MESSAGE,error_log);
-			printf("control_time: %llu R1: %.3f R2: %.3f R3: %.3f R4: %.3f PWM1: %u PWM2: %u PWM3: %u PWM4: %u\n",time_control,R1,R2,R3,R4,PWM1,PWM2,PWM3,PWM4);
-		} while(time_loop<=ACTIVE__CONTROL_TIME);
-		MSP430_UART_write_PWM(0,0,0,0); // Send a final transmission to MSP430 microcontroller with 0 PWM values to close the valves
+			control_record.control_time=control_task.last_step;
+			control_record.Fpitch=Fpitch; control_record.Fyaw=Fyaw; control_record.Mroll=Mroll;
+			control_record.R1=R1; control_record.R2=R2; control_record.R3=R3; control_record.R4=R4;
+			control_record.PWM1=PWM1; control_record.PWM2=PWM2; control_record.PWM3=PWM3; control_record.PWM4=PWM4;
+			control_record.attitude_epoch=attitude_cont.epoch; control_record.attitude_time=attitude_cont.time;
+			control_record.simplex_pivots=(ALLOCATION__MODE==ALLOCATION_SIMPLEX) ? allocation_simplex.statistics.last_pivots : 0;
+			Recorder_push(&control_record_stream,&control_record);
+		} while(control_task.elapsed<=ACTIVE__CONTROL_TIME);
+		Periodic_task_report(&control_task);
+		Simplex_report("Control loop",&allocation_simplex);
+		MSP430_post_PWM(0,0,0,0); // Send a final transmission to MSP430 microcontroller with 0 PWM values to close the valves
+		usleep(10000); // Leave the MSP430 time to send the telemetry of the last frames
+		if (IO__MODE==IO_MODE_REACTOR) {
+			IO_reactor_remove(&PWM_command_source);
+			MSP430_send_posted_PWM(); // The final command, if the reactor has not sent it yet
+			IO_reactor_remove(&msp430_source);
+			set_to_blocking(MSP430_UART); // For the "@e!" handshake
+		} else {
+			MSP430_quit=1; // The writing thread still sends the final command if it has not yet
+			pthread_join(MSP430_writer_thread,NULL);
+			pthread_join(MSP430_reader_thread,NULL);
+		}
+		close(PWM_command_event);
+		tcflush(MSP430_UART,TCIFLUSH); // Drop the unread telemetry, which MSP430_UART_write() would take for replies
+		MSP430_link_report();
 		//############################ CONTROL LOOP END ############################
 		printf("\nFINISHED CONTROL LOOP! Data that follows is for rocket descent with parachute (unpowered).\n\n");
 
@@ -543,14 +740,34 @@ int main(void) {
 	if (flight_type==1) MSP430_UART_write("@e!"); // Command MSP430 to do a software reset if this was an active control flight
 
 	//----------- Quit SPI pressure data reading thread -----------
-	SPI_quit=1;
-	pthread_join(SPI_pressure_thread,NULL);
+	if (pressure_in_reactor) {
+		IO_reactor_remove(&pressure_source);
+		Pressure_report();
+	} else {
+		SPI_quit=1;
+		pthread_join(SPI_pressure_thread,NULL);
+	}
 	//-------------------------------------------------------------
 	//--------------- Quit IMU data reading and filtering threads ----------------
+	if (IO__MODE==IO_MODE_REACTOR) {
+		IO_reactor_remove(&razor_source);
+		IMU_reading_report();
+	}
 	IMU_quit=1;
-	pthread_join(IMU_thread,NULL);
+	if (IO__MODE==IO_MODE_THREADS) pthread_join(IMU_thread,NULL);
 	pthread_join(Filt_thread,NULL);
+	if (IMU__FILTER_MODE==IMU_FILTER_MODE_EVENT) close(IMU_frame_event);
 	//----------------------------------------------------------------------------
+	//----------- Quit I/O reactor thread (all its sources have been removed) -----------
+	if (IO__MODE==IO_MODE_REACTOR) {
+		IO_quit=1;
+		pthread_join(IO_thread,NULL);
+	}
+	//-----------------------------------------------------------------------------------
+	//----------- Quit flight recorder thread (after all the threads producing records) -----------
+	Recorder_quit=1;
+	pthread_join(Recorder_thread,NULL);
+	//---------------------------------------------------------------------------------------------
 
 	pthread_mutex_destroy(&error_log_write_lock); // All other threads closed now, so destroy error log mutex
 
@@ -559,9 +776,6 @@ int main(void) {
 	stopVideo(); // End the Raspberry Pi Spy Camera recording
 
 	fclose(error_log);
-	fclose(imu_log);
-	fclose(pressure_log);
-	fclose(control_log);
 
 	reset_old_attr_port(RAZOR_UART,&old_razor_uart_options);
 	close_port(RAZOR_UART);
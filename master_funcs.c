@@ -8,10 +8,9 @@
  * This file contains some of the primary, "every-day" functions used by the GNC
  * algorithm to achieve its tasks. The file is called "master_funcs" because the
  * functions here are general in that they tend to appear everywhere in the code
- * to perform routine tasks like file I/O, waiting, etc.
+ * to perform routine tasks like file I/O, etc.
  */
 
-# include <sys/time.h>
 # include <stdio.h>
 # include <string.h>
 # include <stdlib.h>
@@ -19,10 +18,12 @@
 # include <unistd.h>
 # include "master_header.h"
 # include "spycam_header.h"
+# include "valve_header.h"
 
 /**
  * @name Thrust curve group
  * These variables have been collected in experimental open-loop tests to determine what thrust value the valves output for a given PWM (in #PWM_valve_charac).
+ * They are the valve curve of all the valves when there is no #VALVE__CALIBRATION_FILE.
  * @{
  */
 unsigned int PWM_valve_charac[VALVE_CHARAC_RESOLUTION] = {310,420,520,620,720,820,920,1020}; ///< PWM value of characteristic thrust curve
@@ -53,28 +54,6 @@ void write_to_file_custom(FILE *file_ptr, char *string,FILE *error_log) {
 	}
 }
 
-/**
- * @fn void check_time(struct timeval *now, struct timeval before, struct timeval elapsed, unsigned long long int *time)
- *
- * This function the value pointed to by time with the time that has passed between *now and the last time
- * gettimeofday(&before,NULL) was called.
- *
- * @param now The current time (struct timeval).
- * @param before The previous time (struct timeval).
- * @param elapsed The time elapsed between now and before (struct timeval).
- * @param time The time in [us] that elapsed between now and before.
- */
-void check_time(struct timeval *now, struct timeval before, struct timeval elapsed, unsigned long long int *time) {
-	gettimeofday(now, NULL);
-	if (before.tv_usec > (*now).tv_usec) { // Account for overflow on the .tv_usec timer
-		(*now).tv_usec += 1000000;
-		(*now).tv_sec--;
-	}
-	elapsed.tv_usec = (*now).tv_usec - before.tv_usec; // microsecond difference
-	elapsed.tv_sec = (*now).tv_sec - before.tv_sec; // second difference
-	*time = elapsed.tv_sec*1000000 + elapsed.tv_usec; // Microsecond precision elapsed time since (first)
-}
-
 /**
  * @fn void open_file(FILE **log, char *path, char *setting,FILE *error_log)
  *
@@ -118,34 +97,12 @@ void open_error_file(FILE **error_log,char *path, char *setting) {
 	}
 }
 
-/**
- * @fn void passive_wait(struct timeval *now,struct timeval *before,struct timeval *elapsed,unsigned long long int *time,unsigned long long int TIME__STEP)
- *
- * This function does a passive (instead of a busy) wait.
- *
- * @param now The time now (struct timeval).
- * @param before The time before (struct timeval).
- * @param elapsed The time elapsed (struct timeval).
- * @param time The time in [us] between now and before.
- * @param TIME__STEP The time we want to iterate at within the loop from which passive_wait() was called.
- */
-void passive_wait(struct timeval *now,struct timeval *before,struct timeval *elapsed,unsigned long long int *time,unsigned long long int TIME__STEP) {
-	check_time(now,*before,elapsed_control,time);
-
-	if (TIME__STEP>*time) {
-		usleep(TIME__STEP-*time);
-	}
-
-	check_time(now,*before,elapsed_control,time);
-	*before=*now;
-}
-
 /**
  * @fn void search_PWM(double R1_thrust,double R2_thrust,double R3_thrust,double R4_thrust,unsigned int *pwm1,unsigned int *pwm2,unsigned int *pwm3,unsigned int *pwm4)
  *
  * This function, given a wanted thrust, assigns the required PWM to produce that
- * thrust given the PWM_valve_charac[] and R_valve_charac[] arrays which assigns the correct
- * PWM for a given thrust level. Typical thrust curves can be seen on the first
+ * thrust given the calibrated valve curves (#valve_curves, by default made from the PWM_valve_charac[] and
+ * R_valve_charac[] arrays) which assign the correct PWM for a given thrust level. Typical thrust curves can be seen on the first
  * figure at page 2 of datasheet found <a href="http://www.parker.com/literature/Literature%20Files/Precision%20Fluidics%20Division/UpdatedFiles/VSO%20Data%20Sheet_1_19_11.pdf">here</a>.
  * However, we manually measured the thrust level for a given PWM using a balance. The data was collected into a spreadsheet
  * and the following graph was produced:
@@ -156,6 +113,8 @@ void passive_wait(struct timeval *now,struct timeval *before,struct timeval *ela
  * sensors to close the loop on valve control. This is suboptimal, of course, due to valves heating up, cooling down,
  * hysteresis, etc. that would slightly make the thrust curve change during flight.
  *
+ * A thrust of 0 closes the valve (PWM 0) and a thrust beyond the curve opens it fully (see Valve_thrust_to_PWM()).
+ *
  * @param R1_thrust The thrust we want the valve R1 to output.
  * @param R2_thrust The thrust we want the valve R2 to output.
  * @param R3_thrust The thrust we want the valve R3 to output.
@@ -166,45 +125,8 @@ void passive_wait(struct timeval *now,struct timeval *before,struct timeval *ela
  * @param pwm4 The pointer to the PWM4 value (for valve R4).
  */
 void search_PWM(double R1_thrust,double R2_thrust,double R3_thrust,double R4_thrust,unsigned int *pwm1,unsigned int *pwm2,unsigned int *pwm3,unsigned int *pwm4) {
-	if (R1_thrust!=0) {
-		linear_search(R1_thrust,pwm1);
-	} else {
-		*pwm1 = 0;
-	}
-
-	if (R2_thrust!=0) {
-		linear_search(R2_thrust,pwm2);
-	} else {
-		*pwm2=0;
-	}
-
-	if (R3_thrust!=0) {
-		linear_search(R3_thrust,pwm3);
-	} else {
-		*pwm3=0;
-	}
-
-	if (R4_thrust!=0) {
-		linear_search(R4_thrust,pwm4);
-	} else {
-		*pwm4=0;
-	}
-}
-
-/**
- * @fn void linear_search(double thrust, unsigned int *pwm)
- * Interpolates discrete thrust curve to give a PWM that produces a given valve thrust.
- *
- * @param thrust Desired valve thrust, in [N].
- * @param pwm Pointer to the memory block holding the pwm value which we'd like to assign.
- */
-void linear_search(double thrust, unsigned int *pwm) {
-	int zz;
-	for (zz=1;zz<VALVE_CHARAC_RESOLUTION;zz++) {
-		if (R_valve_charac[zz-1]<=thrust && R_valve_charac[zz]>=thrust) {
-			// Interpolate the necessary PWM4 for the given thrust R4
-			*pwm = PWM_valve_charac[zz-1]+(unsigned int)(((double)(PWM_valve_charac[zz]-PWM_valve_charac[zz-1]))/(R_valve_charac[zz]-R_valve_charac[zz-1])*(thrust-R_valve_charac[zz-1]));
-			break;
-		}
-	}
+	double thrust[VALVE_COUNT] = {R1_thrust,R2_thrust,R3_thrust,R4_thrust};
+	unsigned int pwm[VALVE_COUNT];
+	Valve_thrusts_to_PWM(valve_curves,thrust,pwm);
+	*pwm1=pwm[0]; *pwm2=pwm[1]; *pwm3=pwm[2]; *pwm4=pwm[3];
 }
@@ -13,6 +13,12 @@
  *
  * This file contains the code for the MSP430 slave microcontroller which, once setup, is configured to receive PWM
  * values for the R1, R2, R3 and R4 valves of the FAR rocket and output them as PWM signals to the actual, physical valves.
+ *
+ * The PWM values are streamed by the Raspberry Pi in 10-byte frames (sync byte, protocol version, sequence number, 5
+ * bytes of PWM values, CRC-16) which are not echoed : every TELEMETRY_INTERVAL valid frames, a 13-byte telemetry frame
+ * (sync byte, protocol version, sequence number of the last valid frame, number of valid frames, the 5 bytes of the PWM
+ * values applied, number of PWM timeouts, number of rejected frames, CRC-16) is sent back instead. Only the "@s!"/"@e!"
+ * handshake bytes are echoed with '!'. See msp430_header.h on the Raspberry Pi side, which must use the same values.
  */
 
 
@@ -39,6 +45,14 @@
 # define BUZZER_ON (P2OUT|=(1<<Buzzer))
 # define BUZZER_OFF (P2OUT&=~(1<<Buzzer))
 # define BUZZER_TOGGLE (P2OUT^=(1<<Buzzer))
+# define PROTOCOL_VERSION 2 // Version of the frames, frames of other versions are rejected
+# define FRAME_SYNC 0xA5 // First byte of a PWM frame
+# define FRAME_SIZE 10 // Sync, version, sequence number, 5 bytes of PWM values, CRC-16 (most significant byte first) of the 8 previous bytes
+# define TELEMETRY_SYNC 0x5A // First byte of a telemetry frame
+# define TELEMETRY_SIZE 13 // Sync, version, sequence number of the last valid frame, number of valid frames, 5 bytes of applied PWM values, number of PWM timeouts, number of rejected frames, CRC-16 of the 11 previous bytes
+# define TELEMETRY_INTERVAL 4 // Number of valid frames per telemetry frame
+# define PWM_TIMEOUT 1172 // Number of PWM periods (~0.15 [s]) without a valid frame after which the valves are closed
+# define FRAME_IDLE_TIMEOUT 4 // Number of PWM periods (128 [us] each, i.e. ~6 bytes at 115200 baud) without a byte after which an incomplete frame is dropped
 
 const unsigned int timer_offset=0xFC00; // Time at which timer A starts ==> counter on 8 bits only (255 values)
 /* TECHNICAL NOTE:
@@ -55,11 +69,19 @@ unsigned int R4_PWM=0; // R4 valve PWM value
 unsigned int PWMA_decode;
 unsigned int PWMB_decode;
 unsigned int PWMC_decode;
-unsigned char PWM__BUFFER[5]; // Buffer for loading in the PWM values send from Raspberry Pi over UART
+unsigned char PWM__BUFFER[2][FRAME_SIZE-1]; // Buffers for loading in the frames (after their sync byte) sent from Raspberry Pi over UART : one is received into while the other is checked
+unsigned char pwm_rx_buffer=0; // Index of the PWM__BUFFER received into by the UART RX interrupt, the other one holding the last complete frame
 unsigned char pwm_ii=0; // Counter for PWM buffer recording, initialized to zero
 unsigned char pwm_receiving=0; // Boolean indicating if we are in state (1) of receiving PWM values or in state (0) of not receving PWM signals
-unsigned char pwm_convert_now=0; // Boolean indicating (1) I received PWM values, convert them or (0) do not convert anything yet
-unsigned long int pwm_timeout_counter=0; // If this value reaches 1172 (~0.15 [s] have passed), reset PWMs to 0
+unsigned char pwm_convert_now=0; // Boolean indicating (1) I received PWM values, convert them or (0) do not convert anything yet (cleared once the frame has been checked, see assign_PWM())
+unsigned char frame_idle_ticks=0; // Number of PWM periods since the last byte of the frame being received
+unsigned char frames_valid=0; // Number of valid frames received (modulo 256)
+unsigned char frames_rejected=0; // Number of frames rejected because of a wrong CRC or version, of a timeout, or because the previous frame was still being checked (modulo 256)
+unsigned char last_sequence=0; // Sequence number of the last valid frame
+unsigned char telemetry_pending=0; // Boolean indicating (1) a telemetry frame must be sent
+unsigned char pwm_timeouts=0; // Number of times the valves were closed because no valid frame came in time (modulo 256)
+unsigned char pwm_timed_out=1; // Boolean indicating (1) the valves are closed because no valid frame came in time (1 until the first frame, so the wait for it is not counted in pwm_timeouts)
+unsigned long int pwm_timeout_counter=0; // If this value reaches PWM_TIMEOUT (~0.15 [s] have passed), reset PWMs to 0
 unsigned long int wait_counter=0;
 const unsigned char toggle_cycle[2]={11,15}; // Sets number of clock cycles corresponding to one buzzer on/off cycle
 							         // Effect : lower toggle_cycle increases PFM frequency for the piezo buzzer
@@ -90,6 +112,38 @@ void UART_quick_reply() {
 	UCA0TXBUF='!'; // Send character (byte) from reply message
 }
 
+unsigned int crc16(unsigned int crc, const unsigned char *data, unsigned char size) {
+	// Continues the CRC-16 (CCITT polynomial x^16+x^12+x^5+1) crc over data. Starting from crc=0xFFFF, it is the same as
+	// MSP430_crc16() on the Raspberry Pi
+	unsigned char bit;
+	while (size--) {
+		crc^=(unsigned int)(*data++)<<8;
+		for (bit=0;bit<8;bit++) crc=(crc&0x8000) ? ((crc<<1)^0x1021) : (crc<<1);
+	}
+	return crc&0xFFFF; // No-op with the 16-bit int of the MSP430
+}
+
+void UART_send_telemetry() {
+	// Sends the telemetry acknowledging the last TELEMETRY_INTERVAL valid frames. Called from the main loop, so the UART
+	// RX interrupt keeps receiving the next frame while the 13 bytes go out.
+	unsigned char telemetry[TELEMETRY_SIZE], k;
+	unsigned int crc;
+	telemetry[0]=TELEMETRY_SYNC; telemetry[1]=PROTOCOL_VERSION; telemetry[2]=last_sequence; telemetry[3]=frames_valid;
+	telemetry[4]=R1_PWM>>2; // PWM values applied, packed as in the PWM frames (see assign_PWM())
+	telemetry[5]=((R1_PWM&0b11)<<6)|(R2_PWM>>4);
+	telemetry[6]=((R2_PWM&0b1111)<<4)|(R3_PWM>>6);
+	telemetry[7]=((R3_PWM&0b111111)<<2)|(R4_PWM>>8);
+	telemetry[8]=R4_PWM&0xFF;
+	telemetry[9]=pwm_timeouts; telemetry[10]=frames_rejected;
+	crc=crc16(0xFFFF,telemetry,TELEMETRY_SIZE-2);
+	telemetry[11]=crc>>8; telemetry[12]=crc&0xFF;
+	for (k=0;k<TELEMETRY_SIZE;k++) {
+		while (!(IFG2&UCA0TXIFG)); // USCI_A0 TX buffer ready?
+		UCA0TXBUF=telemetry[k];
+	}
+	telemetry_pending=0;
+}
+
 void Buzzer_PFM(unsigned int *buzzer_cycle_counter, const unsigned char toggle_cycle, const unsigned char volume) {
 	if (*buzzer_cycle_counter==toggle_cycle) {
 		*buzzer_cycle_counter=0; // Reset buzzer cycle counter
@@ -144,19 +198,35 @@ void Buzzer_warning() {
 }
 
 void assign_PWM() {
-	// This function assigns PWM values received over UART as 5 bytes (storing 40 bits, i.e. 4 PWM values 10 bits each)
-	// into 4 distinct 10-bit PWM values that are used for the valve PWM with the timer interrupts
+	// This function checks the frame received over UART and assigns its PWM values, received as 5 bytes (storing 40
+	// bits, i.e. 4 PWM values 10 bits each), into 4 distinct 10-bit PWM values that are used for the valve PWM with the
+	// timer interrupts
 
 	// Bit field conversion below: see Doxygen/latex/refman.pdf Figure 6.2 to see how the PWM values are decoded from the
-	// 5 bytes that are received (note that in that figure PWM_TX_packet[0] was used to identify that PWM values are about
-	// to be received and therefore is not stored anywhere, so we have PWM__BUFFER[0]==PWM_TX_packet[1]).
+	// 5 bytes that are received (note that the sync byte of the frame is not stored anywhere, and is followed by the
+	// version and sequence number, so we have frame[0]==PWM_TX_packet[1] and frame[2] is the first byte of the figure).
+	// The UART RX interrupt keeps receiving into the other buffer meanwhile, and hands over no new frame until
+	// pwm_convert_now is cleared.
+	const unsigned char sync=FRAME_SYNC;
+	const unsigned char *frame=PWM__BUFFER[pwm_rx_buffer^1]; // The last complete frame
+	unsigned int crc=crc16(crc16(0xFFFF,&sync,1),frame,FRAME_SIZE-3); // CRC of the sync byte, version, sequence number and PWM bytes
+	if (frame[0]!=PROTOCOL_VERSION || (crc>>8)!=frame[FRAME_SIZE-3] || (crc&0xFF)!=frame[FRAME_SIZE-2]) {
+		frames_rejected++; // Corrupted frame (or unknown version), keep the previous PWM values
+		pwm_convert_now=0; // The frame has been handled
+		return;
+	}
 
-	R1_PWM = (PWM__BUFFER[0]<<2)|((PWM__BUFFER[1]&0b11000000)>>6);
-	R2_PWM = ((PWM__BUFFER[1]&0b00111111)<<4)|((PWM__BUFFER[2]&0b11110000)>>4);
-	R3_PWM = ((PWM__BUFFER[2]&0b00001111)<<6)|((PWM__BUFFER[3]&0b11111100)>>2);
-	R4_PWM = ((PWM__BUFFER[3]&0b00000011)<<8)|PWM__BUFFER[4];
+	R1_PWM = (frame[2]<<2)|((frame[3]&0b11000000)>>6);
+	R2_PWM = ((frame[3]&0b00111111)<<4)|((frame[4]&0b11110000)>>4);
+	R3_PWM = ((frame[4]&0b00001111)<<6)|((frame[5]&0b11111100)>>2);
+	R4_PWM = ((frame[5]&0b00000011)<<8)|frame[6];
 
-	pwm_convert_now=0; // PWM values have been converted
+	pwm_timeout_counter=0; // As valid PWM values have been received from the Raspberry Pi, reset the timeout counter for PWM
+	pwm_timed_out=0;
+	last_sequence=frame[1];
+	frames_valid++;
+	if (frames_valid%TELEMETRY_INTERVAL==0) telemetry_pending=1; // Report every TELEMETRY_INTERVAL valid frames
+	pwm_convert_now=0; // The frame has been handled
 }
 
 int main(void) {
@@ -216,14 +286,20 @@ int main(void) {
 
 	pwm_timeout_counter=0; // Reset the PWM timeout counter prior to entering the main loop
 	while(1) {
-		if (pwm_timeout_counter>=1172) { // If no PWM has been received for ~0.15 [s]
+		if (pwm_timeout_counter>=PWM_TIMEOUT) { // If no PWM has been received for ~0.15 [s]
 			// Then reset PWM values to zero ==> this is a safety agains the program on RPi failing before closing the MSP430 connection, leaving
 			// the valves open at some arbitrary position and hence draining the CO2 cartridge!
 			R1_PWM=0; R2_PWM=0; R3_PWM=0; R4_PWM=0;
+			if (!pwm_timed_out) { // Count each timeout once (reported in the telemetry)
+				pwm_timed_out=1;
+				pwm_timeouts++;
+			}
 		}
 		if (pwm_convert_now) { // If PWM values need to be translated into what MSP430 understands...
-			pwm_timeout_counter=0; // As PWM values have been received from the Raspberry Pi, reset the timeout counter for PWM
-			assign_PWM(); // ... Then assign the PWM values! These will then be taken into account at the next cycle of the PWM timer!
+			assign_PWM(); // ... Then check the frame and assign the PWM values! These will then be taken into account at the next cycle of the PWM timer!
+		}
+		if (telemetry_pending) { // Every TELEMETRY_INTERVAL valid frames...
+			UART_send_telemetry(); // ... tell the Raspberry Pi which frames arrived and what is applied
 		}
 		if (strcmp(RX_HANDSHAKE_BUFFER,"@e!")==0) { // Means the Raspberry Pi request the MSP430 microcontroller to stop or that no PWM has been received for 0.2 seconds
 			memset(RX_HANDSHAKE_BUFFER,0,3); // Clear the handshake buffer
@@ -252,6 +328,10 @@ __interrupt void Timer0_A1(void) {
 			break;
 		case 10: // TA0 overflow routine
 			wait_counter++; pwm_timeout_counter++; buzzer_envelope_counter++; buzzer_cycle_counter++;
+			if (pwm_receiving && ++frame_idle_ticks>=FRAME_IDLE_TIMEOUT) { // The rest of the frame never came (lost byte) : drop it and wait for the next sync byte
+				pwm_receiving=0;
+				frames_rejected++;
+			}
 			TA0R=timer_offset; // Offset TA0R register value to count on 10 remaining bits only (giving 1024 value resolution)
 			TA0CCR1=timer_offset+R2_PWM; // Set R2 valve PWM interrupt
 			if (R2_PWM) R2_ON; // Only turn on R2 if its PWM is non-zero
@@ -287,40 +367,47 @@ __interrupt void Timer1_A1(void) {
 /**************************************************************
  **************** USCI MODULE (for UART) **********************
  **************************************************************/
-// Echo back RXed character, confirm TX buffer is ready first
+// Receive handshakes (echoing each of their bytes) and PWM frames (not echoed)
 #pragma vector=USCIAB0RX_VECTOR
 __interrupt void USCI0RX_ISR(void)
 {
-	if (UCA0RXBUF==0x40 && !pwm_receiving && !handshaking) { // ASCII '@' character has been received
+	unsigned char byte=UCA0RXBUF; // Read once (reading clears the RX interrupt flag)
+
+	if (byte==0x40 && !pwm_receiving && !handshaking) { // ASCII '@' character has been received
 		// Start of a handshake with Raspberry pi
 		handshaking=1; // Take note that a handshake is happening
-		RX_HANDSHAKE_BUFFER[handshake_ii]=UCA0RXBUF;
+		RX_HANDSHAKE_BUFFER[handshake_ii]=byte;
 		P1OUT^=(1<<0); // Switch LED state
 		handshake_ii++;
+		UART_quick_reply(); // Let Raspberry Pi know that the byte has been read by sending '!' character back tot he Raspberry Pi
 	} else if (handshaking) {
 		// Record more of the handshake message
-		RX_HANDSHAKE_BUFFER[handshake_ii]=UCA0RXBUF;
+		RX_HANDSHAKE_BUFFER[handshake_ii]=byte;
 		handshake_ii++;
 		if (handshake_ii==3) { // I decided that the handshakes are 3 bytes long : "@s!" for "MSP430 START" and "@e!" for "MSP430 END"
 							   // Which means when handshake_ii==3 (FOURTH byte), we finish the handshake
 			handshake_ii=0; // Reset handshake counter
 			handshaking=0; // Handshaking done
 		}
-	}
-
-	if (UCA0RXBUF==0x23 && !pwm_receiving && !handshaking) { // ASCII '#' character has been received
-		// This means the Raspberry pi is about to send a a new set of 4 valve PWMs
+		UART_quick_reply(); // Let Raspberry Pi know that the byte has been read by sending '!' character back tot he Raspberry Pi
+	} else if (byte==FRAME_SYNC && !pwm_receiving) {
+		// This means the Raspberry pi is sending a new frame of 4 valve PWMs
 		pwm_receiving=1; // We put ourselves into the move "receving PWM values from Raspberry Pi"
 		pwm_ii=0; // Reset PWM buffer element counter
+		frame_idle_ticks=0;
 	} else if (pwm_receiving) {
-		PWM__BUFFER[pwm_ii]=UCA0RXBUF; // Record received value
+		PWM__BUFFER[pwm_rx_buffer][pwm_ii]=byte; // Record received value
 		pwm_ii++; // Increment counter
-		if (pwm_ii>=5) { // If maximum buffer size reached for PWM__BUFFER
+		frame_idle_ticks=0;
+		if (pwm_ii>=FRAME_SIZE-1) { // If the whole frame has been received
 			pwm_ii=0; // Reset counter
 			pwm_receiving=0; // Finished receiving PWM values
-			pwm_convert_now=1; // Request to convert received 5 bytes into 4 10-bit PWM values
+			if (pwm_convert_now) { // The previous frame is still being checked in the other buffer : drop this one
+				frames_rejected++;
+			} else {
+				pwm_rx_buffer^=1; // Hand the frame over to assign_PWM(), receive the next one into the other buffer
+				pwm_convert_now=1; // Request to check the frame and convert received 5 bytes into 4 10-bit PWM values
+			}
 		}
 	}
-
-	UART_quick_reply(); // Let Raspberry Pi know that the byte has been read by sending '!' character back tot he Raspberry Pi
 }
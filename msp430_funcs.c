@@ -20,50 +20,133 @@
 # include <string.h> /* memset */
 # include <unistd.h> /* close */
 # include <sys/time.h>
+# include <errno.h>
+# include <poll.h>
 # include "msp430_header.h"
 # include "master_header.h"
+# include "timebase_header.h"
+
+struct MSP430_link_statistics MSP430_link; ///< Health of the PWM link to the MSP430
+struct Mailbox PWM_mailbox; ///< Latest PWM command of the control loop, taken by MSP430_send_posted_PWM()
+struct PWM_command PWM_mailbox_buffer[3]; ///< Storage of #PWM_mailbox
+int PWM_command_event; ///< eventfd signalled by MSP430_post_PWM() after each post, waited on by the owner of the writing side of #MSP430_UART
+
+/**
+ * @struct MSP430_frame_record
+ * What MSP430_receive_telemetry() needs to know about a sent PWM frame, kept per sequence number.
+ */
+struct MSP430_frame_record {
+	atomic_ullong time; ///< [us] time since #GLOBAL__TIME_STARTPOINT at which the frame was written
+	atomic_ullong PWM; ///< PWM values of the frame, 10 bits each (R1 in the lowest bits)
+};
+static struct MSP430_frame_record MSP430_frames[256]; ///< Last frame sent with each sequence number
 
 /**
- * @fn void MSP430_UART_receive()
- *
- * This function receives a single byte (over UART) from the MSP430. When this byte is received (it's a BLOCKING read),
- * we know that the MSP430 has successfuly processed the byte we previously sent it and hence is ready to receive
- * another byte.
- *
- * Note : MSP430 sends the byte '!', but note that we do not actually check that the byte equals '!' (0x21)
- * because:
- * 		- The connections has been tested to never fail during numerous pre-tests
- * 		- Even if the byte is not '!' due to signal noise, what can we do? The communication speed is optimised for
- * 		  speed and not robustness with many failsafes - thus we have no way of resending the MSP430 the previous byte
- * 		  in the case that we do not receive '!'
- * 		- As in the above point, we optimised the code for speed, so checking for equality to '!' is an additional time spent.
+ * @struct MSP430_telemetry_state
+ * Decoding state of the telemetry stream of the MSP430 (see MSP430_receive_telemetry()).
  */
-void MSP430_UART_receive() {
-	if ((read(MSP430_UART,MSP430_RX,1))<0) { // Instruction waits for a byte to be received back from MSP430
+struct MSP430_telemetry_state {
+	unsigned char frame[MSP430_TELEMETRY_SIZE]; ///< Telemetry frame being received
+	unsigned int received; ///< Number of bytes of #frame received so far
+	unsigned char last_sequence; ///< Sequence number of the frame acknowledged by the previous telemetry frame
+	unsigned char last_valid; ///< Number of valid frames (modulo 256) reported by the previous telemetry frame
+};
+static struct MSP430_telemetry_state MSP430_telemetry={{0},0,0xFF,0}; ///< Sequence number before the first frame, no valid frame yet
+
+/**
+ * @fn int MSP430_UART_receive()
+ *
+ * This function receives a single byte (over UART) from the MSP430. When this byte is received (it's a BLOCKING read,
+ * which times out after VTIME), we know that the MSP430 has successfuly processed the handshake byte we previously
+ * sent it and hence is ready to receive another byte.
+ *
+ * @return The byte received ('!' from the MSP430), or -1 if none came.
+ */
+int MSP430_UART_receive() {
+	int received;
+	if ((received=read(MSP430_UART,MSP430_RX,1))<0) { // Instruction waits for a byte to be received back from MSP430
 		perror("Unable to read from MSP430 UART.\n");
 		exit(-2); // Exit with failure
 	}
+	return (received==1) ? (unsigned char)MSP430_RX[0] : -1;
 }
 
 /**
- * @fn void MSP430_UART_write(char MSP430_TX[3])
+ * @fn int MSP430_UART_write(char MSP430_TX[3])
  *
  * This function sends the MSP430 a 3 character string which is:
  * 		- "@s!" : arm the MSP430 for PWM generation
  * 		- "@e!" : stop PWM transmission and do a software reset, which puts the MSP430 into a state where
  * 				  it again waits for "@s!"
  *
+ * Each byte is confirmed by the MSP430 with a '!' before the next one is sent. It must not be used while
+ * the telemetry is collected (see #IO__MODE), since both read the replies of the MSP430.
+ *
  * @param MSP430_TX Contains the 3-byte (3-character) string to send to the MSP430
+ *
+ * @return The number of bytes the MSP430 did not confirm (0 if the handshake went through).
  */
-void MSP430_UART_write(char MSP430_TX[3]) {
-	int counter=0;
+int MSP430_UART_write(char MSP430_TX[3]) {
+	int counter=0, unconfirmed=0;
 	do {
 		if((write(MSP430_UART,&MSP430_TX[counter],1))<0) { // Send MSP430 a byte of the 3-byte command
 			perror("Failed to write to the MSP430 UART.\n");
 		}
-		MSP430_UART_receive(); // Wait for MSP430 to send back "I received the byte that you sent me"
+		if (MSP430_UART_receive()!='!') unconfirmed++; // Wait for MSP430 to send back "I received the byte that you sent me"
 		counter++;
 	} while(counter<3);
+	return unconfirmed;
+}
+
+/**
+ * @fn unsigned int MSP430_crc16(const unsigned char *data, unsigned int size)
+ *
+ * This function computes the CRC-16 (CCITT polynomial x^16+x^12+x^5+1, initial value 0xFFFF) protecting the PWM and
+ * telemetry frames. The MSP430 code computes the same.
+ *
+ * @param data The bytes to protect.
+ * @param size Number of bytes.
+ *
+ * @return The CRC-16 of data.
+ */
+unsigned int MSP430_crc16(const unsigned char *data, unsigned int size) {
+	unsigned int crc=0xFFFF, k, bit;
+	for (k=0;k<size;k++) {
+		crc^=(unsigned int)data[k]<<8;
+		for (bit=0;bit<8;bit++) crc=(crc&0x8000) ? ((crc<<1)^0x1021)&0xFFFF : (crc<<1)&0xFFFF;
+	}
+	return crc;
+}
+
+/**
+ * @fn void MSP430_pack_PWM(const unsigned int *PWM, unsigned char *bytes)
+ *
+ * This function packs the 4 10-bit PWM values into 5 bytes, as in the figure of MSP430_UART_write_PWM().
+ *
+ * @param PWM The PWM values of the R1, R2, R3, R4 valves.
+ * @param bytes The 5 bytes.
+ */
+void MSP430_pack_PWM(const unsigned int *PWM, unsigned char *bytes) {
+	bytes[0] = ((PWM[0]&0b1111111100)>>2);
+	bytes[1] = ((PWM[0]&0b0000000011)<<6)|((PWM[1]&0b1111110000)>>4);
+	bytes[2] = ((PWM[1]&0b00001111)<<4)|((PWM[2]&0b1111000000)>>6);
+	bytes[3] = ((PWM[2]&0b0000111111)<<2)|((PWM[3]&0b1100000000)>>8);
+	bytes[4] = (PWM[3]&0b0011111111);
+}
+
+/**
+ * @fn void MSP430_unpack_PWM(const unsigned char *bytes, unsigned int *PWM)
+ *
+ * This function unpacks the 4 10-bit PWM values from 5 bytes (see MSP430_pack_PWM()).
+ *
+ * @param bytes The 5 bytes.
+ * @param PWM The PWM values of the R1, R2, R3, R4 valves.
+ */
+void MSP430_unpack_PWM(const unsigned char *bytes, unsigned int *PWM) {
+	PWM[0] = (bytes[0]<<2)|((bytes[1]&0b11000000)>>6);
+	PWM[1] = ((bytes[1]&0b00111111)<<4)|((bytes[2]&0b11110000)>>4);
+	PWM[2] = ((bytes[2]&0b00001111)<<6)|((bytes[3]&0b11111100)>>2);
+	PWM[3] = ((bytes[3]&0b00000011)<<8)|bytes[4];
 }
 
 /**
@@ -74,25 +157,220 @@ void MSP430_UART_write(char MSP430_TX[3]) {
  *
  * @image latex "MSP430_comm.png" "6 byte packet send by Raspberry Pi to MSP430 to update PWM values" width=15cm
  *
- * In the above image you can see how the 4 10-bit PWM values are distributed across the 6 bytes that are sent to the MSP430.
- * The first byte tells the MSP430 that the following 5 bytes contain PWM values. Once received, the MSP430 decodes these according
- * to the above figure (combining appropriate bits into 10-byte numbers) and assigns them to "unsigned int" type PWM variables that
- * are then output on its 4 pins using timer interrupts (hardware PWM, much more precise than software PWM).
+ * In the above image you can see how the 4 10-bit PWM values are distributed across 5 bytes (see MSP430_pack_PWM()).
+ * The frame starts with #MSP430_FRAME_SYNC (instead of '#' in the figure), #MSP430_PROTOCOL_VERSION and the sequence
+ * number of the frame, and ends with the CRC-16 of all that (see #MSP430_FRAME_SIZE). It is written in a single write()
+ * and the function does not wait for any reply : the MSP430 checks the frame, decodes the PWM values (combining
+ * appropriate bits into 10-bit numbers) and assigns them to "unsigned int" type PWM variables that are then output on
+ * its 4 pins using timer interrupts (hardware PWM, much more precise than software PWM). Every
+ * #MSP430_TELEMETRY_INTERVAL valid frames, it sends back a telemetry frame, which MSP430_receive_telemetry()
+ * matches with the frame it acknowledges (hence the write time and PWM values kept for each sequence number). During
+ * the flight, only MSP430_send_posted_PWM() calls it : the control loop posts its commands with MSP430_post_PWM() and
+ * never touches the UART.
  */
 void MSP430_UART_write_PWM(unsigned int PWM1, unsigned int PWM2,unsigned int PWM3,unsigned int PWM4) {
-	PWM_TX_packet[0] = '#'; // Tells MSP430 that "the following 5 bytes contain PWM values"
-	PWM_TX_packet[1] = ((PWM1&0b1111111100)>>2);
-	PWM_TX_packet[2] = ((PWM1&0b0000000011)<<6)|((PWM2&0b1111110000)>>4);
-	PWM_TX_packet[3] = ((PWM2&0b00001111)<<4)|((PWM3&0b1111000000)>>6);
-	PWM_TX_packet[4] = ((PWM3&0b0000111111)<<2)|((PWM4&0b1100000000)>>8);
-	PWM_TX_packet[5] = (PWM4&0b0011111111);
-
-	int counter=0;
+	unsigned long int frames_sent=atomic_load_explicit(&MSP430_link.frames_sent,memory_order_relaxed);
+	unsigned char sequence=(unsigned char)frames_sent;
+	unsigned int PWM[4]={PWM1,PWM2,PWM3,PWM4}, crc;
+
+	PWM_TX_packet[0] = MSP430_FRAME_SYNC; // Tells MSP430 that "a PWM frame starts"
+	PWM_TX_packet[1] = MSP430_PROTOCOL_VERSION;
+	PWM_TX_packet[2] = sequence;
+	MSP430_pack_PWM(PWM,&PWM_TX_packet[3]);
+	crc = MSP430_crc16(PWM_TX_packet,MSP430_FRAME_SIZE-2);
+	PWM_TX_packet[8] = crc>>8;
+	PWM_TX_packet[9] = crc&0xFF;
+
+	atomic_store_explicit(&MSP430_frames[sequence].PWM,PWM1|(PWM2<<10)|(PWM3<<20)|((unsigned long long int)PWM4<<30),memory_order_relaxed);
+	atomic_store_explicit(&MSP430_frames[sequence].time,time_since_start_us(),memory_order_relaxed);
+	atomic_store_explicit(&MSP430_link.frames_sent,frames_sent+1,memory_order_release); // Counted before it can be acknowledged
+	if (write(MSP430_UART,PWM_TX_packet,MSP430_FRAME_SIZE)!=MSP430_FRAME_SIZE) { // Send the whole frame at once
+		atomic_fetch_add_explicit(&MSP430_link.write_errors,1,memory_order_relaxed);
+	}
+}
+
+/**
+ * @fn void MSP430_post_PWM(unsigned int PWM1, unsigned int PWM2,unsigned int PWM3,unsigned int PWM4)
+ *
+ * This function hands new PWM values to MSP430_send_posted_PWM(), which sends them to the MSP430. It never blocks,
+ * so the timing of the control loop does not depend on the UART. If the previous command has not been sent yet, it is
+ * replaced (only the latest PWM values matter).
+ *
+ * @param PWM1 PWM value of the R1 valve.
+ * @param PWM2 PWM value of the R2 valve.
+ * @param PWM3 PWM value of the R3 valve.
+ * @param PWM4 PWM value of the R4 valve.
+ */
+void MSP430_post_PWM(unsigned int PWM1, unsigned int PWM2,unsigned int PWM3,unsigned int PWM4) {
+	struct PWM_command command={{PWM1,PWM2,PWM3,PWM4},0};
+	uint64_t command_signal=1; // Value added to #PWM_command_event for each post
+	command.time=time_since_start_us();
+	Mailbox_post(&PWM_mailbox,&command);
+	if (write(PWM_command_event,&command_signal,sizeof(command_signal))<0 && errno!=EAGAIN) { // Wake up the owner of the writing side of the UART
+		perror("Failed to signal the PWM command event.");
+	}
+}
+
+/**
+ * @fn void MSP430_send_posted_PWM(void)
+ *
+ * This function sends the latest command posted with MSP430_post_PWM(), if it has not been sent yet, with
+ * MSP430_UART_write_PWM(). The delay between the posting of the command and the end of the write() of its frame is
+ * accumulated in #MSP430_link. Only the owner of the writing side of #MSP430_UART may call it.
+ */
+void MSP430_send_posted_PWM(void) {
+	struct PWM_command command;
+	unsigned long long int latency;
+
+	if (Mailbox_take(&PWM_mailbox,&command)!=0) return;
+	MSP430_UART_write_PWM(command.PWM[0],command.PWM[1],command.PWM[2],command.PWM[3]);
+	latency=time_since_start_us()-command.time;
+	MSP430_link.latency_sum+=latency;
+	if (latency>MSP430_link.latency_max) MSP430_link.latency_max=latency;
+}
+
+/**
+ * @fn void *MSP430_write_PWM_parallel(void *args)
+ *
+ * This (p)thread owns the writing side of #MSP430_UART during the flight when #IO__MODE is #IO_MODE_THREADS. It sleeps
+ * on #PWM_command_event and, each time the control loop has posted a command with MSP430_post_PWM(), sends the latest
+ * one to the MSP430 with MSP430_send_posted_PWM(). It thus runs at the cadence of the commands, and a slow UART delays
+ * the frames (the commands superseded meanwhile are counted in #PWM_mailbox) but never the control loop. A command
+ * posted just before #MSP430_quit is still sent (e.g. the final closing of the valves).
+ *
+ * @param args A pointer to the input arguments (we have none for this thread)
+ */
+void *MSP430_write_PWM_parallel(void *args) {
+	struct pollfd command_event = {PWM_command_event, POLLIN, 0};
+	uint64_t event_count;
+	int quitting;
+
+	Thread_set_realtime("MSP430 writing",&MSP430_WRITER__RT);
 	do {
-		if((write(MSP430_UART,&PWM_TX_packet[counter],1))<0) { // Send MSP430 a byte
-			perror("Failed to write to the MSP430 UART.\n");
+		quitting=MSP430_quit; // Read before taking the command, so that a command posted before quitting is not missed
+		// Sleep until a command has been posted (time out now and then to check MSP430_quit)
+		if (!quitting && poll(&command_event,1,MSP430_COMMAND_EVENT_TIMEOUT)>0) {
+			if (read(PWM_command_event,&event_count,sizeof(event_count))<0 && errno!=EAGAIN) { // Reset the event counter
+				perror("Failed to read the PWM command event.");
+			}
 		}
-		MSP430_UART_receive(); // Wait for MSP430 to send back "I received the byte that you sent me"
-		counter++;
-	} while(counter<6);
+		MSP430_send_posted_PWM();
+	} while (!quitting);
+	return NULL;
+}
+
+/**
+ * @fn void MSP430_receive_telemetry(const unsigned char *bytes, unsigned int count, unsigned long long int time)
+ *
+ * This function decodes the bytes received from the MSP430 during the flight : the telemetry frames by which it
+ * acknowledges the PWM frames sent by MSP430_UART_write_PWM(). It scans the bytes for #MSP430_TELEMETRY_SYNC, checks the
+ * version and CRC of the frame (resynchronizing on the next sync byte if they are wrong) and updates #MSP430_link :
+ * 		- the frames sent up to the acknowledged one, minus those the MSP430 counted as valid, were dropped
+ * 		- the round-trip time runs from the write() of the acknowledged frame to the reception of the telemetry
+ * 		- the PWM values the MSP430 applies should be those of the acknowledged frame
+ *
+ * A frame may be split over several calls. Only the owner of the reading side of #MSP430_UART may call it.
+ *
+ * @param bytes The bytes received.
+ * @param count Number of bytes.
+ * @param time [us] Time since #GLOBAL__TIME_STARTPOINT at which they were received.
+ */
+void MSP430_receive_telemetry(const unsigned char *bytes, unsigned int count, unsigned long long int time) {
+	struct MSP430_telemetry_state *state=&MSP430_telemetry;
+	unsigned char *telemetry=state->frame;
+	unsigned int applied[4], k, n;
+	unsigned long int acknowledged, unacknowledged;
+	unsigned long long int RTT, sent_PWM;
+
+	for (n=0;n<count;n++) {
+		if (state->received==0 && bytes[n]!=MSP430_TELEMETRY_SYNC) continue; // Not in a telemetry frame, look for its start
+		telemetry[state->received++]=bytes[n];
+		if (state->received<MSP430_TELEMETRY_SIZE) continue;
+		state->received=0;
+		if (telemetry[1]!=MSP430_PROTOCOL_VERSION || MSP430_crc16(telemetry,MSP430_TELEMETRY_SIZE-2)!=(((unsigned int)telemetry[11]<<8)|telemetry[12])) {
+			atomic_fetch_add_explicit(&MSP430_link.bad_telemetry,1,memory_order_relaxed);
+			continue;
+		}
+
+		// Frames sent and frames received valid since the previous telemetry frame
+		acknowledged=atomic_load_explicit(&MSP430_link.frames_acknowledged,memory_order_relaxed)+(unsigned char)(telemetry[2]-state->last_sequence);
+		atomic_store_explicit(&MSP430_link.frames_acknowledged,acknowledged,memory_order_relaxed);
+		atomic_fetch_add_explicit(&MSP430_link.frames_received,(unsigned char)(telemetry[3]-state->last_valid),memory_order_relaxed);
+		state->last_sequence=telemetry[2];
+		state->last_valid=telemetry[3];
+		unacknowledged=atomic_load_explicit(&MSP430_link.frames_sent,memory_order_acquire)-acknowledged;
+		if (unacknowledged>atomic_load_explicit(&MSP430_link.max_unacknowledged,memory_order_relaxed)) {
+			atomic_store_explicit(&MSP430_link.max_unacknowledged,unacknowledged,memory_order_relaxed);
+		}
+
+		// State of the MSP430
+		MSP430_unpack_PWM(&telemetry[4],applied);
+		for (k=0;k<4;k++) atomic_store_explicit(&MSP430_link.applied_PWM[k],applied[k],memory_order_relaxed);
+		atomic_store_explicit(&MSP430_link.timeouts,telemetry[9],memory_order_relaxed);
+		atomic_store_explicit(&MSP430_link.rejected,telemetry[10],memory_order_relaxed);
+		sent_PWM=atomic_load_explicit(&MSP430_frames[state->last_sequence].PWM,memory_order_relaxed);
+		if (sent_PWM!=(applied[0]|(applied[1]<<10)|(applied[2]<<20)|((unsigned long long int)applied[3]<<30))) {
+			atomic_fetch_add_explicit(&MSP430_link.PWM_mismatches,1,memory_order_relaxed);
+		}
+
+		// Round-trip time of the acknowledged frame
+		RTT=time-atomic_load_explicit(&MSP430_frames[state->last_sequence].time,memory_order_relaxed);
+		atomic_store_explicit(&MSP430_link.RTT_last,RTT,memory_order_relaxed);
+		atomic_fetch_add_explicit(&MSP430_link.RTT_sum,RTT,memory_order_relaxed);
+		if (RTT>atomic_load_explicit(&MSP430_link.RTT_max,memory_order_relaxed)) {
+			atomic_store_explicit(&MSP430_link.RTT_max,RTT,memory_order_relaxed);
+		}
+		atomic_fetch_add_explicit(&MSP430_link.telemetry,1,memory_order_relaxed);
+	}
+}
+
+/**
+ * @fn void *MSP430_read_telemetry_parallel(void *args)
+ *
+ * This is a (p)thread which collects the telemetry of the MSP430 with MSP430_receive_telemetry() when #IO__MODE is
+ * #IO_MODE_THREADS, so that the control loop never waits for the MSP430. It must not run while MSP430_UART_write() is
+ * used, since both read the replies of the MSP430. The UART reads time out (VTIME), so the thread notices #MSP430_quit
+ * even when the MSP430 is silent.
+ *
+ * @param args A pointer to the input arguments (we have none for this thread)
+ */
+void *MSP430_read_telemetry_parallel(void *args) {
+	unsigned char byte;
+
+	Thread_set_realtime("MSP430 telemetry reading",&MSP430_READER__RT);
+	while (!MSP430_quit) {
+		if (read(MSP430_UART,&byte,1)!=1) continue; // Timeout (or interrupted), check whether to quit
+		MSP430_receive_telemetry(&byte,1,time_since_start_us());
+	}
+	return NULL;
+}
+
+/**
+ * @fn void MSP430_link_report(void)
+ *
+ * This function prints the statistics of the PWM link to the MSP430 once its threads have quit, and also
+ * writes them to the #error_log if frames were lost (not written, dropped, or never acknowledged) or if the MSP430 timed
+ * out.
+ */
+void MSP430_link_report(void) {
+	unsigned long int sent=atomic_load(&MSP430_link.frames_sent);
+	unsigned long int acknowledged=atomic_load(&MSP430_link.frames_acknowledged);
+	unsigned long int dropped=acknowledged-atomic_load(&MSP430_link.frames_received);
+	unsigned long int telemetry=atomic_load(&MSP430_link.telemetry);
+	char message[700];
+	unsigned long int missing=(sent>acknowledged+MSP430_TELEMETRY_INTERVAL) ? sent-acknowledged-MSP430_TELEMETRY_INTERVAL : 0; // The last frames may not be acknowledged yet
+
+	snprintf(message,sizeof(message),"MSP430 link: %lu frames sent (%lu write errors, %lu commands superseded before being sent), command-to-write latency average %llu [us] maximum %llu [us], "
+			"%lu acknowledged (%lu dropped, %u rejected by the MSP430) by %lu telemetry frames (%lu bad), round-trip time average %llu [us] maximum %llu [us], "
+			"at most %lu frames unacknowledged, %u MSP430 timeouts, %lu applied PWM mismatches\n",
+			sent,atomic_load(&MSP430_link.write_errors),atomic_load(&PWM_mailbox.overwritten),(sent>0) ? MSP430_link.latency_sum/sent : 0,MSP430_link.latency_max,
+			acknowledged,dropped,atomic_load(&MSP430_link.rejected),telemetry,atomic_load(&MSP430_link.bad_telemetry),
+			(telemetry>0) ? atomic_load(&MSP430_link.RTT_sum)/telemetry : 0,atomic_load(&MSP430_link.RTT_max),
+			atomic_load(&MSP430_link.max_unacknowledged),atomic_load(&MSP430_link.timeouts),atomic_load(&MSP430_link.PWM_mismatches));
+	printf("%s",message);
+	if (missing>0 || dropped>0 || atomic_load(&MSP430_link.write_errors)>0 || atomic_load(&MSP430_link.timeouts)>0) {
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,message,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+	}
 }
@@ -12,20 +12,92 @@
 #ifndef MSP430_HEADER_H_
 #define MSP430_HEADER_H_
 
+# include <stdatomic.h>
+# include <pthread.h>
+# include "scheduler_header.h"
+# include "lockfree_header.h"
+
 # define MSP430_MAX_BUFFER 1 ///< Buffer size for receving messages from MSP430 (just '!' so 1 byte buffer is used)
+# define MSP430_COMMAND_EVENT_TIMEOUT 100 ///< [ms] Longest time MSP430_write_PWM_parallel() sleeps on #PWM_command_event before checking whether it must quit
+
+/**
+ * @name PWM link protocol
+ * The PWM values are streamed to the MSP430 in frames written at once, which the MSP430 does not echo. Every
+ * #MSP430_TELEMETRY_INTERVAL valid frames, it replies with a telemetry frame instead (see MSP430_UART_write_PWM() and
+ * MSP430_receive_telemetry()). Both frames carry the protocol version and end with the CRC-16 (CCITT, most
+ * significant byte first) of all their previous bytes. The same values are defined in the MSP430 code.
+ * @{
+ */
+# define MSP430_PROTOCOL_VERSION 2 ///< Version of the frames (version 1 was the echoed '#' packet without CRC)
+# define MSP430_FRAME_SYNC 0xA5 ///< First byte of a PWM frame
+# define MSP430_FRAME_SIZE 10 ///< PWM frame : sync, version, sequence number, 5 bytes of PWM values, CRC-16
+# define MSP430_TELEMETRY_SYNC 0x5A ///< First byte of a telemetry frame
+# define MSP430_TELEMETRY_SIZE 13 ///< Telemetry frame : sync, version, sequence number of the last valid frame, number of valid frames, 5 bytes of applied PWM values, number of PWM timeouts, number of rejected frames (counts modulo 256), CRC-16
+# define MSP430_TELEMETRY_INTERVAL 4 ///< Number of valid frames per telemetry frame
+/** @} */
+
+/**
+ * @struct MSP430_link_statistics
+ * Health of the PWM link to the MSP430 (see MSP430_link_report()). The frame counters are written by
+ * MSP430_send_posted_PWM() only and the telemetry counters by MSP430_receive_telemetry() only (both called by the
+ * MSP430 threads or by IO_reactor_parallel(), see #IO__MODE) ; any thread may read them during the flight.
+ */
+struct MSP430_link_statistics {
+	atomic_ulong frames_sent; ///< Number of PWM frames written
+	atomic_ulong write_errors; ///< Number of PWM frames that could not be written entirely
+	atomic_ulong telemetry; ///< Number of valid telemetry frames received
+	atomic_ulong bad_telemetry; ///< Number of telemetry frames with a wrong CRC or version
+	atomic_ulong frames_acknowledged; ///< Number of frames sent up to the last one the MSP430 reported as valid
+	atomic_ulong frames_received; ///< Number of them the MSP430 actually received valid (the others were dropped)
+	atomic_ulong max_unacknowledged; ///< Largest number of frames sent but not yet acknowledged when a telemetry frame arrived
+	atomic_ulong PWM_mismatches; ///< Number of telemetry frames whose applied PWM values differ from those of the frame they acknowledge (e.g. after a timeout)
+	atomic_uint rejected; ///< Number of frames the MSP430 rejected (bad CRC, version, incomplete, or complete before the previous one was checked), modulo 256
+	atomic_uint timeouts; ///< Number of times the MSP430 closed the valves because no valid frame came for ~0.15 [s], modulo 256
+	atomic_uint applied_PWM[4]; ///< PWM values the MSP430 applied when it sent the last telemetry frame
+	atomic_ullong RTT_last; ///< [us] Round-trip time from the write() of a frame to the reception of the telemetry acknowledging it
+	atomic_ullong RTT_sum; ///< [us] Sum of the round-trip times
+	atomic_ullong RTT_max; ///< [us] Largest round-trip time
+	unsigned long long int latency_sum; ///< [us] Sum of the delays between the posting of a command and the end of the write() of its frame (written by MSP430_send_posted_PWM() only)
+	unsigned long long int latency_max; ///< [us] Largest such delay (written by MSP430_send_posted_PWM() only)
+};
+
+/**
+ * @struct PWM_command
+ * PWM values computed by the control loop, passed to MSP430_send_posted_PWM() through #PWM_mailbox.
+ */
+struct PWM_command {
+	unsigned int PWM[4]; ///< PWM values of the R1, R2, R3, R4 valves
+	unsigned long long int time; ///< [us] time since #GLOBAL__TIME_STARTPOINT at which the command was posted
+};
 
 char MSP430_RX[MSP430_MAX_BUFFER]; ///< Buffer holding received values via UART from Razor IMU
 int MSP430_UART; ///< Holds Razor IMU connection file
 char MSP430_reply_string; ///< String holding the MSP430 reply
-unsigned char PWM_TX_packet[6]; ///< Packet of 1 byte for "#" and 5 bytes containing the 4 PWM values, to send to MSP430
+unsigned char PWM_TX_packet[MSP430_FRAME_SIZE]; ///< PWM frame sent to the MSP430 (see #MSP430_FRAME_SIZE)
+extern struct MSP430_link_statistics MSP430_link; ///< Health of the PWM link to the MSP430
+extern unsigned char MSP430_quit; ///< ==0 by default, ==1 signals the MSP430 threads (MSP430_write_PWM_parallel() and MSP430_read_telemetry_parallel()) to exit.
+extern struct RT_config MSP430_WRITER__RT; ///< MSP430 PWM writing thread (MSP430_write_PWM_parallel())
+extern struct RT_config MSP430_READER__RT; ///< MSP430 telemetry reading thread (MSP430_read_telemetry_parallel())
+extern struct Mailbox PWM_mailbox; ///< Latest PWM command of the control loop, taken by MSP430_send_posted_PWM()
+extern struct PWM_command PWM_mailbox_buffer[3]; ///< Storage of #PWM_mailbox
+extern int PWM_command_event; ///< eventfd signalled by MSP430_post_PWM() after each post, waited on by the owner of the writing side of #MSP430_UART
 
 struct termios new_msp430_uart_options; ///< The new options we set for communicating the the MSP430 UART after opening it.
 struct termios old_msp430_uart_options; ///< The old options we save after opening the MSP430 UART connection; we restitute them before closing the connection at the end of the program.
 
 /** @cond INCLUDE_WITH_DOXYGEN */
-void MSP430_UART_receive();
-void MSP430_UART_write(char MSP430_TX[3]);
+int MSP430_UART_receive();
+int MSP430_UART_write(char MSP430_TX[3]);
 void MSP430_UART_write_PWM(unsigned int PWM1, unsigned int PWM2,unsigned int PWM3,unsigned int PWM4);
+unsigned int MSP430_crc16(const unsigned char *data, unsigned int size);
+void MSP430_pack_PWM(const unsigned int *PWM, unsigned char *bytes);
+void MSP430_unpack_PWM(const unsigned char *bytes, unsigned int *PWM);
+void MSP430_post_PWM(unsigned int PWM1, unsigned int PWM2,unsigned int PWM3,unsigned int PWM4);
+void MSP430_send_posted_PWM(void);
+void *MSP430_write_PWM_parallel(void *args);
+void MSP430_receive_telemetry(const unsigned char *bytes, unsigned int count, unsigned long long int time);
+void *MSP430_read_telemetry_parallel(void *args);
+void MSP430_link_report(void);
 /** @endcond */
 
 #endif /* MSP430_HEADER_H_ */
@@ -21,10 +21,22 @@
 # include <pthread.h>
 # include "pressure_header.h"
 # include "master_header.h"
+# include "scheduler_header.h"
+# include "timebase_header.h"
+# include "recorder_header.h"
+# include "decimator_header.h"
 
 const char RADIAL_SENSOR[] = "/dev/spidev0.0"; ///< File path for the radial pressure sensor SPI connection
 const char AXIAL_SENSOR[] = "/dev/spidev0.1"; ///< File path for the axial pressure sensor SPI connection
 
+struct SPI_bus_statistics SPI_bus; ///< Timing of the readings of the pressure sensors
+static struct spi_ioc_transfer batched_transfer[2]; ///< Single-segment SPI transfer of the radial ([0]) and axial ([1]) sensors (#SPI_TRANSFER_BATCHED)
+static unsigned char batched_data[2][BYTE_NUMBER]; ///< Bytes received from the radial ([0]) and axial ([1]) sensors by #batched_transfer
+struct Pressure_history pressure_history; ///< Latest readings of the sensors at the full sampling rate
+static struct Decimator_design pressure_decimator_design; ///< Anti-aliasing filter of both sensors (#SPI__DECIMATOR)
+static struct Decimator radial_decimator; ///< Decimation of the radial pressure
+static struct Decimator axial_decimator; ///< Decimation of the axial pressure
+
 /**
  * @fn void pressure_sensor_SPI_connect(const char *directory,unsigned int *fd,unsigned char mode, unsigned char bits, unsigned long int max_speed)
  *
@@ -76,11 +88,322 @@ void pressure_sensor_SPI_connect(const char *directory,unsigned int *fd,unsigned
 	}
 }
 
+/**
+ * @fn void Pressure_transfer_setup(const struct SPI_data *config)
+ *
+ * This function prepares the SPI transfers reading the sensors for #SPI__TRANSFER_MODE. In #SPI_TRANSFER_BYTEWISE mode,
+ * a reading is #BYTE_NUMBER 1-byte segments, each followed by #SPI_BYTEWISE_DELAY, i.e. about 0.5 [ms] per sensor. In
+ * #SPI_TRANSFER_BATCHED mode, it is a single #BYTE_NUMBER-byte segment with the chip select held low throughout, as
+ * the sensors allow, i.e. 40 [us] at 800 [kHz]. The sensors being on different chip selects (different spidev
+ * devices), they cannot share a transfer : they are read back to back instead.
+ *
+ * @param config The SPI connection to the sensors.
+ */
+void Pressure_transfer_setup(const struct SPI_data *config) {
+	int ii;
+	for (ii=0;ii<BYTE_NUMBER;ii++) {
+		data[ii]=0; // Reset the value in data buffer to zero ==> send whatever (MOSI line not connected to sensor anyway), receive back the sensor reading
+
+		memset(transfer+ii,0,sizeof(struct spi_ioc_transfer)); // Reset transfer struct to NULL, otherwise does not work!
+		transfer[ii].tx_buf = (unsigned long)(data+ii);	// Buffer for SENDING data (MOSI)
+		transfer[ii].rx_buf = (unsigned long)(data+ii); //  Buffer for RECEIVING data (MISO)
+		transfer[ii].len = sizeof(*(data+ii)); // Length of buffer, i.e. size in bytes of data[ii] (NB: data[ii]==*(data+ii) in pointer arithmetic)
+		transfer[ii].speed_hz = config->max_speed; // Speed in [Hz]
+		transfer[ii].bits_per_word = config->bits; // Bits per transmission ("per word")
+		transfer[ii].delay_usecs = SPI_BYTEWISE_DELAY; // Delay in [us]
+		transfer[ii].cs_change = 0;
+	}
+	for (ii=0;ii<2;ii++) {
+		memset(batched_data[ii],0,BYTE_NUMBER);
+		memset(&batched_transfer[ii],0,sizeof(struct spi_ioc_transfer));
+		batched_transfer[ii].tx_buf = (unsigned long)batched_data[ii]; // Whatever is sent (MOSI line not connected to sensor anyway)...
+		batched_transfer[ii].rx_buf = (unsigned long)batched_data[ii]; // ...is overwritten by the reading
+		batched_transfer[ii].len = BYTE_NUMBER;
+		batched_transfer[ii].speed_hz = config->max_speed;
+		batched_transfer[ii].bits_per_word = config->bits;
+		batched_transfer[ii].delay_usecs = 0;
+		batched_transfer[ii].cs_change = 0;
+	}
+	memset(&SPI_bus,0,sizeof(SPI_bus));
+}
+
+/**
+ * @fn static void Pressure_transfer(unsigned int fd, int sensor, unsigned char *bytes)
+ *
+ * This function reads the #BYTE_NUMBER bytes of a sensor (see Pressure_transfer_setup()).
+ *
+ * @param fd The SPI connection handle of the sensor.
+ * @param sensor 0 for the radial sensor, 1 for the axial sensor.
+ * @param bytes The bytes read.
+ */
+static void Pressure_transfer(unsigned int fd, int sensor, unsigned char *bytes) {
+	int status;
+	if (SPI__TRANSFER_MODE==SPI_TRANSFER_BATCHED) status=ioctl(fd,SPI_IOC_MESSAGE(1),&batched_transfer[sensor]);
+	else status=ioctl(fd,SPI_IOC_MESSAGE(BYTE_NUMBER),transfer);
+	if (status<0) { // Error in SPI communication
+		perror("SPI: SPI_IOC_MESSAGE Failed!");
+		write_to_file_custom(error_log,"SPI: SPI_IOC_MESSAGE Failed!",error_log);
+		exit(-2);
+	}
+	memcpy(bytes,(SPI__TRANSFER_MODE==SPI_TRANSFER_BATCHED) ? batched_data[sensor] : data,BYTE_NUMBER);
+}
+
+/**
+ * @fn static void Pressure_unpack(const unsigned char *bytes, unsigned char *status, unsigned short int *pressure_output, unsigned short int *temperature_output)
+ *
+ * This function extracts the status, pressure and temperature from the bytes read from a sensor. See
+ * (http://sensing.honeywell.com/spi-comms-digital-ouptu-pressure-sensors-tn-008202-3-en-final-30may12.pdf) Figure 3.
+ * (on page 2) for the layout of the bytes.
+ *
+ * @param bytes The #BYTE_NUMBER bytes read.
+ * @param status Status of the sensor.
+ * @param pressure_output Differential pressure (14 bits).
+ * @param temperature_output Compensated temperature (11 bits).
+ */
+static void Pressure_unpack(const unsigned char *bytes, unsigned char *status, unsigned short int *pressure_output, unsigned short int *temperature_output) {
+	*status = (bytes[0] & 0b11000000)>>6; // 2 MSB bits of first byte (status written on 2 bits)
+	*pressure_output = ((bytes[0] & 0b00111111)<<8) | bytes[1]; // 6 LSB bits of first byte and all bits of second byte (differential pressure 14 bits resolution)
+	*temperature_output = (bytes[2]<<3) | ((bytes[3] & 0b11100000)>>5); // third byte and 3 MSB bits of fourth byte (compensated temperature 11 bits resolution)
+}
+
+/**
+ * @fn static float Pressure_convert(const struct SPI_data *config, float pressure_output)
+ *
+ * This function converts a (possibly filtered, hence fractional) pressure output of a sensor into a pressure with
+ * the transfer function of the sensors.
+ *
+ * @param config The SPI connection to the sensors (transfer function).
+ * @param pressure_output Differential pressure output.
+ *
+ * @return [mbar] Differential pressure.
+ */
+static float Pressure_convert(const struct SPI_data *config, float pressure_output) {
+	return (pressure_output-(float)config->P_OUT__MIN)*((float)(config->P__MAX-config->P__MIN))/((float)(config->P_OUT__MAX-config->P_OUT__MIN))+config->P__MIN;
+}
+
+/**
+ * @fn static float Pressure_temperature_convert(unsigned short int temperature_output)
+ *
+ * This function converts a temperature output of a sensor into a temperature.
+ *
+ * @param temperature_output Compensated temperature output.
+ *
+ * @return [°C] Compensated temperature.
+ */
+static float Pressure_temperature_convert(unsigned short int temperature_output) {
+	return (((float)(temperature_output))/2047.0)*200.0-50.0;
+}
+
+/**
+ * @fn static void Pressure_publish(const struct SPI_data *config, const struct Pressure_sample *sample, unsigned long long int time, float radial_output, float axial_output)
+ *
+ * This function updates #radial_pressure, #axial_pressure, etc. and pushes them to the flight recorder as a
+ * #Pressure_record. The statuses and temperatures are those of the latest reading.
+ *
+ * @param config The SPI connection to the sensors (transfer function).
+ * @param sample The latest reading.
+ * @param time [us] Time of the pressures since #GLOBAL__TIME_STARTPOINT.
+ * @param radial_output Radial differential pressure output, raw or decimated.
+ * @param axial_output Axial differential pressure output, raw or decimated.
+ */
+static void Pressure_publish(const struct SPI_data *config, const struct Pressure_sample *sample, unsigned long long int time, float radial_output, float axial_output) {
+	struct Pressure_record record; // Flight recorder record
+
+	radial_status=sample->radial_status;
+	radial_pressure=Pressure_convert(config,radial_output);
+	radial_temperature=Pressure_temperature_convert(sample->radial_temperature_output);
+	axial_status=sample->axial_status;
+	axial_pressure=Pressure_convert(config,axial_output);
+	axial_temperature=Pressure_temperature_convert(sample->axial_temperature_output);
+
+	record.time_pressure_glob=time;
+	record.radial_status=radial_status; record.radial_pressure=radial_pressure; record.radial_temperature=radial_temperature;
+	record.axial_status=axial_status; record.axial_pressure=axial_pressure; record.axial_temperature=axial_temperature;
+	Recorder_push(&pressure_record_stream,&record);
+}
+
+/**
+ * @fn void Pressure_decimation_setup(const struct SPI_data *config)
+ *
+ * This function prepares the decimation of the readings of the sensors (see Pressure_read_sensors()) and empties
+ * #pressure_history. Must be called before the sensors are read. The program quits if the decimation is out of range,
+ * or if reading both sensors with #SPI__TRANSFER_MODE would take more than half of the sampling period (e.g.
+ * #SPI_TRANSFER_BYTEWISE, about 0.9 [ms], with a 1 [ms] period), since every period would then overrun.
+ *
+ * @param config The SPI connection to the sensors.
+ */
+void Pressure_decimation_setup(const struct SPI_data *config) {
+	// [us] Minimum time on the bus of a reading of both sensors : 2*#BYTE_NUMBER bytes, plus the delays of the bytewise mode
+	unsigned long long int bus_time=2*BYTE_NUMBER*(8000000ULL/config->max_speed+((SPI__TRANSFER_MODE==SPI_TRANSFER_BATCHED) ? 0 : SPI_BYTEWISE_DELAY));
+
+	if (SPI__DECIMATION<1 || SPI__DECIMATION>DECIMATOR_MAX_FACTOR || 2*bus_time>SPI__READ_TIMESTEP/SPI__DECIMATION) {
+		sprintf(ERROR_MESSAGE,"SPI pressure decimation (%u) must be between 1 and %d and leave a sampling period of at least twice the %llu [us] bus time of a reading (%s transfers).\n",
+			SPI__DECIMATION,DECIMATOR_MAX_FACTOR,bus_time,(SPI__TRANSFER_MODE==SPI_TRANSFER_BATCHED) ? "batched" : "bytewise");
+		printf("%s",ERROR_MESSAGE);
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+		exit(-2);
+	}
+	Decimator_design(&pressure_decimator_design,SPI__DECIMATOR,SPI__DECIMATION);
+	Decimator_init(&radial_decimator,&pressure_decimator_design);
+	Decimator_init(&axial_decimator,&pressure_decimator_design);
+	atomic_init(&pressure_history.started,0);
+	atomic_init(&pressure_history.count,0);
+}
+
+/**
+ * @fn unsigned long long int Pressure_sample_period(void)
+ *
+ * This function gives the period at which Pressure_read_sensors() must be called : #SPI__READ_TIMESTEP divided by
+ * #SPI__DECIMATION, so that the decimated readings are still published every #SPI__READ_TIMESTEP.
+ *
+ * @return [us] The sampling period.
+ */
+unsigned long long int Pressure_sample_period(void) {
+	return SPI__READ_TIMESTEP/SPI__DECIMATION;
+}
+
+/**
+ * @fn unsigned int Pressure_history_read(struct Pressure_sample *destination, unsigned int count)
+ *
+ * This function copies out the latest readings of #pressure_history, oldest first. Any thread may call it. Readings
+ * overwritten by the reading thread while they were being copied are left out.
+ *
+ * @param destination Where to copy the readings.
+ * @param count Largest number of readings to copy (at most #PRESSURE_HISTORY_SIZE are available).
+ *
+ * @return The number of readings copied.
+ */
+unsigned int Pressure_history_read(struct Pressure_sample *destination, unsigned int count) {
+	unsigned long int first, last, valid, n;
+
+	last=atomic_load_explicit(&pressure_history.count,memory_order_acquire);
+	if (count>PRESSURE_HISTORY_SIZE) count=PRESSURE_HISTORY_SIZE;
+	first=(last>count) ? last-count : 0;
+	for (n=first;n<last;n++) destination[n-first]=pressure_history.samples[n%PRESSURE_HISTORY_SIZE];
+	atomic_thread_fence(memory_order_acquire); // The copy must be complete before the started readings are checked
+	valid=atomic_load_explicit(&pressure_history.started,memory_order_relaxed); // The slots of the readings before valid-#PRESSURE_HISTORY_SIZE may have been (or be being) overwritten
+	valid=(valid>PRESSURE_HISTORY_SIZE) ? valid-PRESSURE_HISTORY_SIZE : 0;
+	if (valid>first) {
+		if (valid>=last) return 0;
+		memmove(destination,destination+(valid-first),(last-valid)*sizeof(struct Pressure_sample));
+		first=valid;
+	}
+	return last-first;
+}
+
+/**
+ * @fn unsigned int Pressure_history_spread(const struct SPI_data *config, unsigned int count, float *radial_spread, float *axial_spread)
+ *
+ * This function gives the spread (maximum minus minimum) of the latest raw pressures in #pressure_history, e.g. to
+ * show before flight the noise that the decimation removes.
+ *
+ * @param config The SPI connection to the sensors (transfer function).
+ * @param count Number of latest readings to look at (at most #DECIMATOR_MAX_FACTOR).
+ * @param radial_spread [mbar] Spread of the radial pressure.
+ * @param axial_spread [mbar] Spread of the axial pressure.
+ *
+ * @return The number of readings looked at (0 if there were none, the spreads being then 0).
+ */
+unsigned int Pressure_history_spread(const struct SPI_data *config, unsigned int count, float *radial_spread, float *axial_spread) {
+	struct Pressure_sample samples[DECIMATOR_MAX_FACTOR];
+	unsigned short int radial_min, radial_max, axial_min, axial_max;
+	unsigned int n, k;
+
+	*radial_spread=0; *axial_spread=0;
+	if ((n=Pressure_history_read(samples,(count<DECIMATOR_MAX_FACTOR) ? count : DECIMATOR_MAX_FACTOR))==0) return 0;
+	radial_min=radial_max=samples[0].radial_pressure_output;
+	axial_min=axial_max=samples[0].axial_pressure_output;
+	for (k=1;k<n;k++) {
+		if (samples[k].radial_pressure_output<radial_min) radial_min=samples[k].radial_pressure_output;
+		if (samples[k].radial_pressure_output>radial_max) radial_max=samples[k].radial_pressure_output;
+		if (samples[k].axial_pressure_output<axial_min) axial_min=samples[k].axial_pressure_output;
+		if (samples[k].axial_pressure_output>axial_max) axial_max=samples[k].axial_pressure_output;
+	}
+	*radial_spread=Pressure_convert(config,radial_max)-Pressure_convert(config,radial_min);
+	*axial_spread=Pressure_convert(config,axial_max)-Pressure_convert(config,axial_min);
+	return n;
+}
+
+/**
+ * @fn void Pressure_read_sensors(const struct SPI_data *config)
+ *
+ * This function reads the Honeywell HSC sensors (pressure and temperature) once, back to back, and adds the reading
+ * to #pressure_history. With #SPI__DECIMATION==1, the reading is published as is (see Pressure_publish()). Otherwise,
+ * the pressures are low-pass filtered by the fixed-point #SPI__DECIMATOR, and every #SPI__DECIMATION readings the
+ * filtered pressures are published, dated back by the delay of the filter : the logged and displayed data keep
+ * their rate, but without the noise and aliasing of a single reading. The time spent on the bus and in the filters is accumulated in #SPI_bus.
+ *
+ * @param config The SPI connection to the sensors.
+ */
+void Pressure_read_sensors(const struct SPI_data *config) {
+	unsigned char radial_bytes[BYTE_NUMBER], axial_bytes[BYTE_NUMBER];
+	unsigned long long int bus_time, decimation_time;
+	unsigned long int count;
+	struct Pressure_sample sample;
+	int32_t radial_filtered, axial_filtered;
+	int ready;
+
+	sample.time=time_since_start_us(); // Time [us] since #GLOBAL__TIME_STARTPOINT at which the sensors are read
+
+	bus_time=now_ns();
+	Pressure_transfer(config->radial_sensor_fd,0,radial_bytes); // Read RADIAL pressure sensor
+	Pressure_transfer(config->axial_sensor_fd,1,axial_bytes); // Read AXIAL pressure sensor
+	bus_time=now_ns()-bus_time;
+	SPI_bus.samples++;
+	SPI_bus.bus_time_sum+=bus_time;
+	if (bus_time>SPI_bus.bus_time_max) SPI_bus.bus_time_max=bus_time;
+
+	Pressure_unpack(radial_bytes,&sample.radial_status,&sample.radial_pressure_output,&sample.radial_temperature_output);
+	Pressure_unpack(axial_bytes,&sample.axial_status,&sample.axial_pressure_output,&sample.axial_temperature_output);
+	SPI_bus.stale+=(sample.radial_status==PRESSURE_STATUS_STALE)+(sample.axial_status==PRESSURE_STATUS_STALE);
+
+	count=atomic_load_explicit(&pressure_history.count,memory_order_relaxed); // Written by this thread only
+	atomic_store_explicit(&pressure_history.started,count+1,memory_order_relaxed);
+	atomic_thread_fence(memory_order_release); // A reader that sees the new slot content also sees started
+	pressure_history.samples[count%PRESSURE_HISTORY_SIZE]=sample;
+	atomic_store_explicit(&pressure_history.count,count+1,memory_order_release);
+
+	if (SPI__DECIMATION==1) {
+		Pressure_publish(config,&sample,sample.time,sample.radial_pressure_output,sample.axial_pressure_output);
+		return;
+	}
+	// A stale reading repeats the previous one, which is the sensor output held since : it is filtered like the others
+	decimation_time=now_ns();
+	ready=Decimator_push(&radial_decimator,sample.radial_pressure_output,&radial_filtered);
+	Decimator_push(&axial_decimator,sample.axial_pressure_output,&axial_filtered); // In lockstep with the radial decimator
+	decimation_time=now_ns()-decimation_time;
+	SPI_bus.decimation_time_sum+=decimation_time;
+	if (decimation_time>SPI_bus.decimation_time_max) SPI_bus.decimation_time_max=decimation_time;
+	if (ready) {
+		SPI_bus.decimated++;
+		Pressure_publish(config,&sample,sample.time-pressure_decimator_design.delay*Pressure_sample_period()/2, // Time the filtered pressures correspond to
+			(float)radial_filtered/(1<<DECIMATOR_Q),(float)axial_filtered/(1<<DECIMATOR_Q));
+	}
+}
+
+/**
+ * @fn void Pressure_report(void)
+ *
+ * This function prints the timing of the readings of the pressure sensors (see #SPI_bus) once they have stopped.
+ */
+void Pressure_report(void) {
+	printf("SPI pressure sensors (%s transfers): %lu readings, bus time per reading of both sensors average %llu [us] maximum %llu [us], %lu stale sensor readings\n",
+		(SPI__TRANSFER_MODE==SPI_TRANSFER_BATCHED) ? "batched" : "bytewise",SPI_bus.samples,(SPI_bus.samples>0) ? SPI_bus.bus_time_sum/SPI_bus.samples/1000 : 0,SPI_bus.bus_time_max/1000,SPI_bus.stale);
+	if (SPI__DECIMATION>1) {
+		printf("SPI pressure decimation (%s, factor %u): %lu outputs, filtering time per reading of both sensors average %llu [ns] maximum %llu [ns]\n",
+			(SPI__DECIMATOR==DECIMATOR_FIR) ? "FIR" : "CIC",SPI__DECIMATION,SPI_bus.decimated,(SPI_bus.samples>0) ? SPI_bus.decimation_time_sum/SPI_bus.samples : 0,SPI_bus.decimation_time_max);
+	}
+}
+
 /**
  * @fn void *get_readings_SPI_parallel(void *args)
  *
  * This is a (p)thread which does the sole job of reading data from the Honeywell HSC sensors (pressure and
- * temperature).
+ * temperature) every Pressure_sample_period() with Pressure_read_sensors(). It is used when #IO__MODE is
+ * #IO_MODE_THREADS, and also when #SPI__DECIMATION>1 : reading the sensors every millisecond or so must then be done at
+ * the low #SPI__RT priority, not in IO_reactor_parallel() above the control loop and the IMU filtering.
  *
  * @param args A pointer to the input arguments. We pass the SPI connection struct pointer as a void pointer and then typecast it back to a struct pointer (see <a href="https://computing.llnl.gov/tutorials/pthreads/samples/hello_arg2.c">example</a>).
  */
@@ -89,64 +412,15 @@ void *get_readings_SPI_parallel(void *args) {
 	struct SPI_data *my_data;
 	my_data = (struct SPI_data *) args;
 
-	unsigned int radial_sensor_fd = (*my_data).radial_sensor_fd; // Equivalent : my_data->radial_sensor_fd
-	unsigned int axial_sensor_fd = (*my_data).axial_sensor_fd;
-	unsigned char buffer_length = (*my_data).buffer_length;
-
-	unsigned int P_OUT__MAX = (*my_data).P_OUT__MAX;
-	unsigned int P_OUT__MIN = (*my_data).P_OUT__MIN;
-	float P__MAX = (*my_data).P__MAX;
-	float P__MIN = (*my_data).P__MIN;
-
-	unsigned int radial_pressure_output;
-	unsigned int radial_temperature_output;
-	unsigned int axial_pressure_output;
-	unsigned int axial_temperature_output;
-
-	char PRESSURE_WRITE[200];
-	write_to_file_custom(pressure_log,"time_pressure_glob \t radial_status \t radial_pressure \t radial_temperature \t axial_status \t axial_pressure \t axial_temperature\n",error_log);
-
-	gettimeofday(&before_pressure, NULL); // Get initial read time
+	struct Periodic_task pressure_task;
+	Thread_set_realtime("SPI pressure reading",&SPI__RT);
+	Periodic_task_start(&pressure_task,"SPI pressure reading",Pressure_sample_period()); // Get initial read time
 	do {
-		check_time(&now_pressure_glob,GLOBAL__TIME_STARTPOINT,elapsed_pressure_glob,&time_pressure_glob);
-
-		passive_wait(&now_pressure,&before_pressure,&elapsed_pressure,&time_pressure,SPI__READ_TIMESTEP);
-
-		//******************************** Read RADIAL pressure sensor ********************************
-		if ((ioctl(radial_sensor_fd,SPI_IOC_MESSAGE(buffer_length),transfer))<0) { // Error in SPI communication
-			perror("SPI: SPI_IOC_MESSAGE Failed!");
-			write_to_file_custom(error_log,"SPI: SPI_IOC_MESSAGE Failed!",error_log);
-			exit(-2);
-		}
-		//-------------------- Now convert received bits into pressure and temperature readings
-		// See (http://sensing.honeywell.com/spi-comms-digital-ouptu-pressure-sensors-tn-008202-3-en-final-30may12.pdf) Figure 3. (on page 2) for decoding of bytes into status,pressure,temperature below
-		radial_status = (data[0] & 0b11000000)>>6; // 2 MSB bits of first byte (status written on 2 bits)
-		radial_pressure_output = ((data[0] & 0b00111111)<<8) | data[1]; // 6 LSB bits of first byte and all bits of second byte (differential pressure 14 bits resolution)
-		radial_temperature_output = (data[2]<<3) | ((data[3] & 0b11100000)>>5); // third byte and 3 MSB bits of fourth byte (compensated temperature 11 bits resolution)
-
-		// Now convert p_output and t_output into a pressure [mbar] and a temperature [°C]
-		radial_pressure = ((float)(radial_pressure_output-P_OUT__MIN))*((float)(P__MAX-P__MIN))/((float)(P_OUT__MAX-P_OUT__MIN))+P__MIN; // Pressure reading in [mbar]
-		radial_temperature = (((float)(radial_temperature_output))/2047.0)*200.0-50.0; // Temperature reading in [°C]
-
-		//******************************** Read AXIAL pressure sensor ********************************
-		if ((ioctl(axial_sensor_fd,SPI_IOC_MESSAGE(buffer_length),transfer))<0) { // Error in SPI communication
-			perror("SPI: SPI_IOC_MESSAGE Failed!");
-			write_to_file_custom(error_log,"SPI: SPI_IOC_MESSAGE Failed!",error_log);
-			exit(-2);
-		}
-		//-------------------- Now convert received bits into pressure and temperature readings
-		axial_status = (data[0] & 0b11000000)>>6; // 2 MSB bits of first byte (status written on 2 bits)
-		axial_pressure_output = ((data[0] & 0b00111111)<<8) | data[1]; // 6 LSB bits of first byte and all bits of second byte (differential pressure 14 bits resolution)
-		axial_temperature_output = (data[2]<<3) | ((data[3] & 0b11100000)>>5); // third byte and 3 MSB bits of fourth byte (compensated temperature 11 bits resolution)
-
-		// Now convert p_output and t_output into a pressure [mbar] and a temperature [°C]
-		axial_pressure = ((float)(axial_pressure_output-P_OUT__MIN))*((float)(P__MAX-P__MIN))/((float)(P_OUT__MAX-P_OUT__MIN))+P__MIN; // Pressure reading in [mbar]
-		axial_temperature = (((float)(axial_temperature_output))/2047.0)*200.0-50.0; // Temperature reading in [°C]
-
-
-		sprintf(PRESSURE_WRITE,"%llu\t%d\t%.5f\t%.5f\t%d\t%.5f\t%.5f\n",time_pressure_glob,radial_status,radial_pressure,radial_temperature,axial_status,axial_pressure,axial_temperature);
-		write_to_file_custom(pressure_log,PRESSURE_WRITE,error_log);
+		Periodic_task_wait(&pressure_task);
+		Pressure_read_sensors(my_data);
 	} while(!SPI_quit); // Continue reading sensor until quit
+	Periodic_task_report(&pressure_task);
+	Pressure_report();
 
 	printf("\nQuitting SPI pressure sensor reading thread!\n");
 	pthread_exit(NULL); // Quit the pthread
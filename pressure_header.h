@@ -12,10 +12,17 @@
 #ifndef PRESSURE_HEADER_H_
 #define PRESSURE_HEADER_H_
 
+# include <stdatomic.h>
+
 extern const char RADIAL_SENSOR[];
 extern const char AXIAL_SENSOR[];
 
 # define BYTE_NUMBER 4 ///< How many bytes we want to receive from the pressure sensor per reading
+# define SPI_TRANSFER_BYTEWISE 0 ///< #SPI__TRANSFER_MODE value : each sensor is read in #BYTE_NUMBER 1-byte segments, each followed by #SPI_BYTEWISE_DELAY (the original timing)
+# define SPI_TRANSFER_BATCHED 1 ///< #SPI__TRANSFER_MODE value : each sensor is read in a single #BYTE_NUMBER-byte segment without any delay, the two sensors back to back
+# define SPI_BYTEWISE_DELAY 100 ///< [us] Delay after each byte when #SPI__TRANSFER_MODE is #SPI_TRANSFER_BYTEWISE
+# define PRESSURE_STATUS_STALE 2 ///< Sensor status : the reading has already been read (the sensor has not updated it since)
+# define PRESSURE_HISTORY_SIZE 1024 ///< Number of latest sensor readings kept in #pressure_history (power of 2)
 
 /**
  * @struct SPI_data
@@ -49,11 +56,68 @@ char axial_status; ///< Holds status of axial sensor
 float axial_pressure; ///< Holds differential pressure reading of axially mounted pressure sensor
 float axial_temperature; ///< Holds compensated temperature reading of axially mounted pressure sensor
 
-unsigned char data[BYTE_NUMBER]; ///< We will receive 4 bytes from the pressure sensor
-struct spi_ioc_transfer transfer[BYTE_NUMBER]; ///< SPI transfer structure
+/**
+ * @struct SPI_bus_statistics
+ * Timing of the readings of the pressure sensors (see Pressure_read_sensors()), written by the thread reading them only
+ * and printed by Pressure_report() once the readings have stopped.
+ */
+struct SPI_bus_statistics {
+	unsigned long int samples; ///< Number of readings of both sensors
+	unsigned long int stale; ///< Number of sensor readings with the #PRESSURE_STATUS_STALE status (the sensors are read faster than they update)
+	unsigned long long int bus_time_sum; ///< [ns] Sum of the times spent in the SPI transfers of both sensors, per reading
+	unsigned long long int bus_time_max; ///< [ns] Longest such time
+	unsigned long int decimated; ///< Number of outputs of the decimators (#SPI__DECIMATION>1)
+	unsigned long long int decimation_time_sum; ///< [ns] Sum of the times spent filtering both sensors' readings, per reading
+	unsigned long long int decimation_time_max; ///< [ns] Longest such time
+};
+
+/**
+ * @struct Pressure_sample
+ * One reading of both sensors, as output by the sensors (see the
+ * <a href="http://sensing.honeywell.com/spi-comms-digital-ouptu-pressure-sensors-tn-008202-3-en-final-30may12.pdf">Honeywell SPI companion</a>).
+ */
+struct Pressure_sample {
+	unsigned long long int time; ///< [us] Time of the reading since #GLOBAL__TIME_STARTPOINT
+	unsigned char radial_status; ///< Status of the radial sensor
+	unsigned char axial_status; ///< Status of the axial sensor
+	unsigned short int radial_pressure_output; ///< Radial differential pressure (14 bits)
+	unsigned short int radial_temperature_output; ///< Radial sensor temperature (11 bits)
+	unsigned short int axial_pressure_output; ///< Axial differential pressure (14 bits)
+	unsigned short int axial_temperature_output; ///< Axial sensor temperature (11 bits)
+};
+
+/**
+ * @struct Pressure_history
+ * The latest #PRESSURE_HISTORY_SIZE readings of the sensors at the full sampling rate, whatever #SPI__DECIMATION. The
+ * thread reading the sensors overwrites the oldest reading without ever waiting, and any thread can copy out the
+ * latest ones with Pressure_history_read(). As in a #Seqlock, the writer announces a reading in #started (followed by
+ * a release fence) before overwriting its slot, and publishes it in #count once written : a reader that has copied
+ * a slot then checks #started to know whether the slot was overwritten meanwhile.
+ */
+struct Pressure_history {
+	struct Pressure_sample samples[PRESSURE_HISTORY_SIZE]; ///< Reading number n is in samples[n%#PRESSURE_HISTORY_SIZE]
+	atomic_ulong started; ///< Number of readings whose writing has started
+	atomic_ulong count; ///< Number of readings completely written
+};
+
+extern unsigned char SPI__TRANSFER_MODE; ///< How the sensors are read (#SPI_TRANSFER_BATCHED or #SPI_TRANSFER_BYTEWISE)
+extern struct SPI_bus_statistics SPI_bus; ///< Timing of the readings of the pressure sensors
+extern unsigned int SPI__DECIMATION; ///< Number of sensor readings per #SPI__READ_TIMESTEP, filtered down to one (1 : no filtering)
+extern unsigned char SPI__DECIMATOR; ///< Anti-aliasing filter of the decimation (#DECIMATOR_FIR or #DECIMATOR_CIC)
+extern struct Pressure_history pressure_history; ///< Latest readings of the sensors at the full sampling rate
+
+unsigned char data[BYTE_NUMBER]; ///< We will receive 4 bytes from the pressure sensor (#SPI_TRANSFER_BYTEWISE)
+struct spi_ioc_transfer transfer[BYTE_NUMBER]; ///< SPI transfer structure (one per byte, #SPI_TRANSFER_BYTEWISE)
 
 /** @cond INCLUDE_WITH_DOXYGEN */
 void pressure_sensor_SPI_connect(const char *directory,unsigned int *fd,unsigned char mode, unsigned char bits, unsigned long int max_speed);
+void Pressure_transfer_setup(const struct SPI_data *config);
+void Pressure_decimation_setup(const struct SPI_data *config);
+unsigned long long int Pressure_sample_period(void);
+unsigned int Pressure_history_read(struct Pressure_sample *destination, unsigned int count);
+unsigned int Pressure_history_spread(const struct SPI_data *config, unsigned int count, float *radial_spread, float *axial_spread);
+void Pressure_read_sensors(const struct SPI_data *config);
+void Pressure_report(void);
 void *get_readings_SPI_parallel(void *args);
 /** @endcond */
 
@@ -0,0 +1,223 @@
+/**
+ * @file recorder_funcs.c
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Binary flight recorder functions file.
+ *
+ * This file contains the flight recorder, which saves the IMU, pressure and control data. The real-time threads only
+ * fill a fixed-layout binary record and copy it into a lock-free queue (see Recorder_push()). Formatting the records
+ * as text is left to the log decoder, on the ground. The writing to the SD card is done by a low-priority thread
+ * (see Recorder_write_parallel()) in large blocks, so that a slow write() or fsync() never delays the filtering or
+ * the control.
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <string.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <pthread.h>
+# include "recorder_header.h"
+# include "master_header.h"
+# include "scheduler_header.h"
+# include "timebase_header.h"
+
+struct Recorder_stream IMU_record_stream;
+struct Recorder_stream pressure_record_stream;
+struct Recorder_stream control_record_stream;
+
+/**
+ * @name Recorder stream storage
+ * Storage of the ring buffers of the recorder streams.
+ * @{
+ */
+struct IMU_record IMU_record_buffer[RECORDER_RING_SIZE];
+struct Pressure_record pressure_record_buffer[RECORDER_RING_SIZE];
+struct Control_record control_record_buffer[RECORDER_RING_SIZE];
+/** @} */
+
+unsigned char Recorder_quit=0; // By default don't quit recording!
+
+/**
+ * @name Recorder file group
+ * State of the flight record file, only used by the recorder thread (after Recorder_init()).
+ * @{
+ */
+int record_file=-1; ///< Flight record file descriptor
+unsigned char *record_block=NULL; ///< Block being filled before it is written to #record_file (page-aligned, #RECORDER_BLOCK_SIZE bytes)
+unsigned int record_block_fill=0; ///< [bytes] Used part of #record_block
+unsigned long long int record_bytes_written=0; ///< [bytes] Size of #record_file so far
+/** @} */
+
+/**
+ * @fn void Recorder_stream_init(struct Recorder_stream *stream, void *buffer, uint16_t type, uint16_t size)
+ *
+ * This function initializes an empty recorder stream.
+ *
+ * @param stream The stream.
+ * @param buffer Storage for #RECORDER_RING_SIZE records.
+ * @param type Type of the records (#RECORD_IMU, ...).
+ * @param size Size of the records.
+ */
+void Recorder_stream_init(struct Recorder_stream *stream, void *buffer, uint16_t type, uint16_t size) {
+	memset(buffer,0,(size_t)size*RECORDER_RING_SIZE); // Touch the storage now, so that the real-time threads do not take page faults on their first pushes
+	SPSC_ring_init(&stream->ring,buffer,size,RECORDER_RING_SIZE);
+	stream->type = type;
+	stream->size = size;
+	stream->sequence = 0;
+}
+
+/**
+ * @fn void Recorder_init(const char *path)
+ *
+ * This function creates the flight record file and initializes the recorder streams. Must be called before any thread
+ * pushes records or the recorder thread is started.
+ *
+ * @param path Path of the flight record file.
+ */
+void Recorder_init(const char *path) {
+	struct Record_file_header file_header;
+
+	if ((record_file=open(path,O_WRONLY|O_CREAT|O_TRUNC,0644))<0) {
+		sprintf(ERROR_MESSAGE,"CRITICAL ERROR: could not open() %s\n",path);
+		perror(ERROR_MESSAGE); fflush(stdout);
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+		exit(-2); // Exit with a critical failure
+	}
+	if (posix_memalign((void **)&record_block,4096,RECORDER_BLOCK_SIZE)!=0) {
+		perror("CRITICAL ERROR: could not allocate the flight recorder block.");
+		exit(-2);
+	}
+
+	// The file header goes at the start of the first block, so that every write() is a full block at a block-aligned offset
+	memcpy(file_header.magic,RECORD_FILE_MAGIC,sizeof(file_header.magic));
+	file_header.version = RECORD_FILE_VERSION;
+	file_header.block_size = RECORDER_BLOCK_SIZE;
+	memcpy(record_block,&file_header,sizeof(file_header));
+	record_block_fill = sizeof(file_header);
+	record_bytes_written = 0;
+
+	Recorder_stream_init(&IMU_record_stream,IMU_record_buffer,RECORD_IMU,sizeof(struct IMU_record));
+	Recorder_stream_init(&pressure_record_stream,pressure_record_buffer,RECORD_PRESSURE,sizeof(struct Pressure_record));
+	Recorder_stream_init(&control_record_stream,control_record_buffer,RECORD_CONTROL,sizeof(struct Control_record));
+}
+
+/**
+ * @fn void Recorder_push(struct Recorder_stream *stream, void *record)
+ *
+ * This function fills in the header of a record and queues it for writing. Only the thread owning the stream may call
+ * it. It never blocks : if the recorder thread has fallen so far behind that the queue is full, the record is dropped
+ * (which shows up as a gap in the sequence numbers, and in the count written to the #error_log at the end).
+ *
+ * @param stream The stream of the record type.
+ * @param record The record, starting with a struct #Record_header.
+ */
+void Recorder_push(struct Recorder_stream *stream, void *record) {
+	struct Record_header *header = (struct Record_header *)record;
+	header->type = stream->type;
+	header->size = stream->size;
+	header->sequence = stream->sequence++;
+	SPSC_ring_push(&stream->ring,record);
+}
+
+/**
+ * @fn void Recorder_write_block(void)
+ *
+ * This function writes #record_block to the flight record file, zero-padding its unused end, and starts a new block.
+ */
+void Recorder_write_block(void) {
+	ssize_t written;
+	unsigned int done = 0;
+
+	memset(record_block+record_block_fill,0,RECORDER_BLOCK_SIZE-record_block_fill); // #RECORD_PADDING
+	while (done<RECORDER_BLOCK_SIZE) {
+		if ((written=write(record_file,record_block+done,RECORDER_BLOCK_SIZE-done))<0) {
+			sprintf(ERROR_MESSAGE,"CRITICAL ERROR: could not write to the flight record file.\n");
+			perror(ERROR_MESSAGE); fflush(stdout);
+			pthread_mutex_lock(&error_log_write_lock);
+			write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+			pthread_mutex_unlock(&error_log_write_lock);
+			exit(-2); // Exit with a critical failure
+		}
+		done += written;
+	}
+	record_bytes_written += RECORDER_BLOCK_SIZE;
+	record_block_fill = 0;
+}
+
+/**
+ * @fn unsigned int Recorder_drain(struct Recorder_stream *stream)
+ *
+ * This function moves all the records queued in a stream into #record_block, writing out the block whenever the next
+ * record does not fit in it.
+ *
+ * @param stream The stream.
+ *
+ * @return The number of records moved.
+ */
+unsigned int Recorder_drain(struct Recorder_stream *stream) {
+	unsigned int count = 0;
+	while (1) {
+		if (record_block_fill+stream->size>RECORDER_BLOCK_SIZE) { // Records never cross a block boundary
+			Recorder_write_block();
+		}
+		if (SPSC_ring_pop(&stream->ring,record_block+record_block_fill)<0) break; // Copied straight into the block
+		record_block_fill += stream->size;
+		count++;
+	}
+	return count;
+}
+
+/**
+ * @fn void *Recorder_write_parallel(void *args)
+ *
+ * This (p)thread is the flight recorder. Every RECORDER__WRITE_TIMESTEP it collects the records queued in the
+ * recorder streams into a block of #RECORDER_BLOCK_SIZE bytes, and writes the block to the flight record file once it
+ * is full. At least every RECORDER__FSYNC_TIMESTEP, the (partial) block is written out and the file is fsync()'ed, so
+ * that a power loss at landing costs at most that much data. The thread runs with the default (non real-time)
+ * scheduling policy, hence it only uses the CPU time left by the real-time threads.
+ *
+ * @param args A pointer to the input arguments (we have none for this thread)
+ */
+void *Recorder_write_parallel(void *args) {
+	struct Periodic_task recorder_task;
+	unsigned long long int last_sync = now_ns();
+	unsigned long int records = 0;
+	unsigned char quitting;
+
+	Thread_set_realtime("flight recorder",&RECORDER__RT);
+	Periodic_task_start(&recorder_task,"Flight recorder",RECORDER__WRITE_TIMESTEP);
+	do {
+		Periodic_task_wait(&recorder_task);
+		quitting = Recorder_quit; // Read before draining, so that the records pushed before Recorder_quit was set are all written
+
+		records += Recorder_drain(&IMU_record_stream);
+		records += Recorder_drain(&pressure_record_stream);
+		records += Recorder_drain(&control_record_stream);
+
+		if (quitting || (now_ns()-last_sync)/1000>=RECORDER__FSYNC_TIMESTEP) {
+			if (record_block_fill>0) Recorder_write_block();
+			if (fsync(record_file)<0) {
+				perror("Failed to fsync() the flight record file.");
+			}
+			last_sync = now_ns();
+		}
+	} while(!quitting);
+
+	close(record_file);
+	free(record_block);
+
+	printf("\nFlight recorder: %lu records, %llu bytes written.\n",records,record_bytes_written);
+	sprintf(ERROR_MESSAGE,"Flight recorder queues were full, records dropped: IMU %lu, pressure %lu, control %lu.\n",atomic_load(&IMU_record_stream.ring.dropped),atomic_load(&pressure_record_stream.ring.dropped),atomic_load(&control_record_stream.ring.dropped));
+	if (atomic_load(&IMU_record_stream.ring.dropped) || atomic_load(&pressure_record_stream.ring.dropped) || atomic_load(&control_record_stream.ring.dropped)) {
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+	}
+	Periodic_task_report(&recorder_task);
+	printf("\nQuitting flight recorder thread!\n");
+	pthread_exit(NULL); // Quit the pthread
+}
@@ -0,0 +1,166 @@
+/**
+ * @file recorder_header.h
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Binary flight recorder header file.
+ *
+ * This is the header to recorder_funcs.c containing necessary definitions and
+ * initializations. It also defines the layout of the flight record file, so it is
+ * included as is by the log decoder (which runs on the ground and is not linked
+ * with the flight software) : this header must therefore not define any variable.
+ *
+ * <b>Flight record file layout</b> : the file is made of blocks of exactly #RECORDER_BLOCK_SIZE bytes, the first of which
+ * starts with a #Record_file_header. Each block holds records (#IMU_record, #Pressure_record, #Control_record) one after
+ * the other, each starting with a #Record_header. A record never crosses a block boundary : the unused end of a block is
+ * filled with zeros, so when the decoder reads a record type of #RECORD_PADDING (or fewer bytes than a #Record_header
+ * remain in the block), it skips to the next block. All values are little-endian (as written by the Raspberry Pi).
+ */
+
+#ifndef RECORDER_HEADER_H_
+#define RECORDER_HEADER_H_
+
+# include <stdint.h>
+# include "lockfree_header.h"
+
+# define RECORD_FILE_MAGIC "FALCOREC" ///< First 8 bytes of a flight record file
+# define RECORD_FILE_VERSION 3 ///< Version of the record layouts below, incremented whenever one of them changes
+# define RECORDER_BLOCK_SIZE 65536 ///< [bytes] Size of the blocks in which the file is written (a multiple of the SD card page size)
+# define RECORDER_RING_SIZE 1024 ///< Number of records each #Recorder_stream can hold while the recorder thread is busy writing (power of 2)
+
+/**
+ * @name Record types
+ * Values of #Record_header.type
+ * @{
+ */
+# define RECORD_PADDING 0 ///< Unused end of a block
+# define RECORD_IMU 1 ///< #IMU_record
+# define RECORD_PRESSURE 2 ///< #Pressure_record
+# define RECORD_CONTROL 3 ///< #Control_record
+/** @} */
+
+/**
+ * @struct Record_file_header
+ * Header at the very start of a flight record file.
+ */
+struct Record_file_header {
+	char magic[8]; ///< #RECORD_FILE_MAGIC (not null-terminated)
+	uint32_t version; ///< #RECORD_FILE_VERSION of the flight software that wrote the file
+	uint32_t block_size; ///< #RECORDER_BLOCK_SIZE of the flight software that wrote the file
+} __attribute__((packed));
+
+/**
+ * @struct Record_header
+ * Header at the start of every record.
+ */
+struct Record_header {
+	uint16_t type; ///< Record type (#RECORD_IMU, #RECORD_PRESSURE, ...)
+	uint16_t size; ///< [bytes] Size of the whole record, header included
+	uint32_t sequence; ///< Number of records of this type produced before this one (a gap means records were dropped)
+} __attribute__((packed));
+
+/**
+ * @struct IMU_record
+ * One filtered IMU frame (see Filter_IMU_frame()), i.e. one line of imu_log.txt once decoded.
+ */
+struct IMU_record {
+	struct Record_header header; ///< Record header (type #RECORD_IMU)
+	uint64_t time_imu_glob; ///< [us] Time stamp of the IMU frame since #GLOBAL__TIME_STARTPOINT (on the Razor IMU cadence, see IMU_receive())
+	float dt; ///< [s] Time step since the previous frame (see IMU_frame_interval())
+	float psi_save; ///< Zeroed yaw angle
+	float theta_save; ///< Zeroed pitch angle
+	float phi_save; ///< Zeroed roll angle
+	float psi_dot; ///< Raw yaw rate
+	float theta_dot; ///< Raw pitch rate
+	float phi_dot; ///< Raw roll rate
+	float psi_filt; ///< Filtered yaw
+	float theta_filt; ///< Filtered pitch
+	float phi_filt; ///< Filtered roll
+	float psi_dot_filt; ///< Filtered yaw rate
+	float theta_dot_filt; ///< Filtered pitch rate
+	float phi_dot_filt; ///< Filtered roll rate
+	float wx; ///< X-body rate
+	float wy; ///< Y-body rate
+	float wz; ///< Z-body rate
+	float accelX_save; ///< X-acceleration
+	float accelY_save; ///< Y-acceleration
+	float accelZ_save; ///< Z-acceleration
+	uint32_t latency; ///< [us] Reception-to-publish latency (see Filter_IMU_frame())
+} __attribute__((packed));
+
+/**
+ * @struct Pressure_record
+ * One reading of both Honeywell sensors, decimated if #SPI__DECIMATION>1 (see Pressure_read_sensors()), i.e. one line of pressure_log.txt once decoded.
+ */
+struct Pressure_record {
+	struct Record_header header; ///< Record header (type #RECORD_PRESSURE)
+	uint64_t time_pressure_glob; ///< [us] Time of the reading (of the center of the filter when decimated) since #GLOBAL__TIME_STARTPOINT
+	uint8_t radial_status; ///< Status of the radial sensor
+	uint8_t axial_status; ///< Status of the axial sensor
+	float radial_pressure; ///< [mbar] Radial differential pressure
+	float radial_temperature; ///< [degC] Radial sensor temperature
+	float axial_pressure; ///< [mbar] Axial differential pressure
+	float axial_temperature; ///< [degC] Axial sensor temperature
+} __attribute__((packed));
+
+/**
+ * @struct Control_record
+ * One control loop iteration (see main()), i.e. one line of control_log.txt once decoded.
+ */
+struct Control_record {
+	struct Record_header header; ///< Record header (type #RECORD_CONTROL)
+	uint64_t time_control_glob; ///< [us] Start of the iteration since #GLOBAL__TIME_STARTPOINT
+	uint32_t control_time; ///< [us] Time since the start of the previous iteration
+	float Fpitch; ///< [N] Commanded pitch force
+	float Fyaw; ///< [N] Commanded yaw force
+	float Mroll; ///< [Nm] Commanded roll moment
+	float R1; ///< [N] Valve R1 thrust
+	float R2; ///< [N] Valve R2 thrust
+	float R3; ///< [N] Valve R3 thrust
+	float R4; ///< [N] Valve R4 thrust
+	uint16_t PWM1; ///< Valve R1 PWM
+	uint16_t PWM2; ///< Valve R2 PWM
+	uint16_t PWM3; ///< Valve R3 PWM
+	uint16_t PWM4; ///< Valve R4 PWM
+	uint32_t attitude_epoch; ///< Epoch of the attitude estimate the command was computed from
+	uint64_t attitude_time; ///< [us] Reception time of the IMU frame behind that estimate
+	int8_t allocation_status; ///< Status returned by Allocate_thrust() (#ALLOCATION_OK, ...)
+	uint8_t simplex_pivots; ///< Simplex pivots the allocation took (#ALLOCATION_SIMPLEX mode only, see simplx_warm())
+} __attribute__((packed));
+
+/**
+ * @struct Recorder_stream
+ * Queue of records of one type, from the single thread producing them to the recorder thread (see
+ * Recorder_write_parallel()). Pushing a record is a copy into a lock-free ring buffer, so it never blocks the producer.
+ */
+struct Recorder_stream {
+	struct SPSC_ring ring; ///< Records waiting to be written
+	uint16_t type; ///< Type of the records
+	uint16_t size; ///< [bytes] Size of the records
+	uint32_t sequence; ///< Number of records pushed so far (including dropped ones)
+};
+
+/**
+ * @name Recorder streams
+ * One stream per producing thread.
+ * @{
+ */
+extern struct Recorder_stream IMU_record_stream; ///< Written by get_filtered_attitude_parallel()
+extern struct Recorder_stream pressure_record_stream; ///< Written by get_readings_SPI_parallel()
+extern struct Recorder_stream control_record_stream; ///< Written by the control loop in main()
+/** @} */
+
+extern unsigned long long int RECORDER__WRITE_TIMESTEP; ///< [us] Time intervals at which the recorder thread collects the queued records
+extern unsigned long long int RECORDER__FSYNC_TIMESTEP; ///< [us] Longest time records may stay in memory or in the kernel cache before they are forced onto the SD card
+extern unsigned char Recorder_quit; ///< ==0 by default, ==1 signals the recorder thread (Recorder_write_parallel()) to write out everything and exit.
+
+/** @cond INCLUDE_WITH_DOXYGEN */
+void Recorder_stream_init(struct Recorder_stream *stream, void *buffer, uint16_t type, uint16_t size);
+void Recorder_init(const char *path);
+void Recorder_push(struct Recorder_stream *stream, void *record);
+void Recorder_write_block(void);
+unsigned int Recorder_drain(struct Recorder_stream *stream);
+void *Recorder_write_parallel(void *args);
+/** @endcond */
+
+#endif /* RECORDER_HEADER_H_ */
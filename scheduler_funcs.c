@@ -0,0 +1,163 @@
+/**
+ * @file scheduler_funcs.c
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Periodic task scheduler functions file.
+ *
+ * This file contains the functions that cadence the periodic loops of the GNC program (IMU calibration and filtering,
+ * pressure reading, control) and give the threads running them real-time priority. The loops sleep until absolute
+ * deadlines with clock_nanosleep(), which, unlike a relative usleep(), does not let the period drift by the time spent
+ * in the loop body.
+ */
+
+# define _GNU_SOURCE // For pthread_setaffinity_np()
+# include <stdio.h>
+# include <errno.h>
+# include <sched.h>
+# include <string.h>
+# include <pthread.h>
+# include <time.h>
+# include "scheduler_header.h"
+# include "master_header.h"
+
+/**
+ * @fn unsigned long long int timespec_diff_us(const struct timespec *later, const struct timespec *earlier)
+ *
+ * This function returns the time in [us] from earlier to later (0 if later is before earlier).
+ *
+ * @param later The later time.
+ * @param earlier The earlier time.
+ */
+static unsigned long long int timespec_diff_us(const struct timespec *later, const struct timespec *earlier) {
+	long long int diff = (long long int)(later->tv_sec-earlier->tv_sec)*1000000+(later->tv_nsec-earlier->tv_nsec)/1000;
+	return diff>0 ? (unsigned long long int)diff : 0;
+}
+
+/**
+ * @fn void timespec_add_us(struct timespec *time, unsigned long long int us)
+ *
+ * This function adds us [us] to a time.
+ *
+ * @param time The time.
+ * @param us The duration to add, in [us].
+ */
+static void timespec_add_us(struct timespec *time, unsigned long long int us) {
+	time->tv_sec += us/1000000;
+	time->tv_nsec += (us%1000000)*1000;
+	if (time->tv_nsec>=1000000000) {
+		time->tv_nsec -= 1000000000;
+		time->tv_sec++;
+	}
+}
+
+/**
+ * @fn void Periodic_task_start(struct Periodic_task *task, const char *name, unsigned long long int period)
+ *
+ * This function makes the current time the first release of a periodic loop. Call it just before entering the loop,
+ * then call Periodic_task_wait() at the top of every iteration.
+ *
+ * @param task The timing state of the loop.
+ * @param name Name of the loop (for Periodic_task_report()).
+ * @param period [us] period of the loop.
+ */
+void Periodic_task_start(struct Periodic_task *task, const char *name, unsigned long long int period) {
+	memset(task,0,sizeof(struct Periodic_task));
+	task->name = name;
+	task->period = period;
+	clock_gettime(CLOCK_MONOTONIC,&task->start);
+	task->deadline = task->start;
+	task->release = task->start;
+}
+
+/**
+ * @fn void Periodic_task_wait(struct Periodic_task *task)
+ *
+ * This function sleeps until the next release of a periodic loop, i.e. one period after the previous deadline. If that
+ * deadline has already passed (the previous iteration took too long), the function returns immediately, counts an
+ * overrun and skips the missed releases so that the loop does not run a burst of iterations to catch up.
+ *
+ * @param task The timing state of the loop (see Periodic_task_start()).
+ */
+void Periodic_task_wait(struct Periodic_task *task) {
+	struct timespec now;
+	unsigned long long int late;
+
+	timespec_add_us(&task->deadline,task->period);
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	late = timespec_diff_us(&now,&task->deadline);
+	if (late>0) { // Deadline already missed
+		task->overruns++;
+		timespec_add_us(&task->deadline,(late/task->period)*task->period); // Skip the missed periods, but stay in phase
+	} else {
+		while (clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&task->deadline,NULL)==EINTR) {
+			// Woken up by a signal, go back to sleep until the deadline
+		}
+		clock_gettime(CLOCK_MONOTONIC,&now);
+	}
+
+	late = timespec_diff_us(&now,&task->deadline);
+	if (late>task->max_lateness) task->max_lateness = late;
+	task->last_step = timespec_diff_us(&now,&task->release);
+	task->elapsed = timespec_diff_us(&now,&task->start);
+	task->release = now;
+	task->cycles++;
+}
+
+/**
+ * @fn void Periodic_task_report(const struct Periodic_task *task)
+ *
+ * This function prints the timing statistics of a periodic loop once it is finished, and also writes them to the
+ * #error_log if the loop overran.
+ *
+ * @param task The timing state of the loop.
+ */
+void Periodic_task_report(const struct Periodic_task *task) {
+	char REPORT[200];
+	sprintf(REPORT,"%s loop: %lu iterations of %llu [us], %lu overruns, maximum lateness %llu [us]\n",task->name,task->cycles,task->period,task->overruns,task->max_lateness);
+	printf("%s",REPORT);
+	if (task->overruns>0) {
+		pthread_mutex_lock(&error_log_write_lock);
+		write_to_file_custom(error_log,REPORT,error_log);
+		pthread_mutex_unlock(&error_log_write_lock);
+	}
+}
+
+/**
+ * @fn void Thread_set_realtime(const char *name, const struct RT_config *config)
+ *
+ * This function gives the calling thread the SCHED_FIFO priority and CPU affinity of config. A real-time thread is only
+ * preempted by threads of higher priority, so its loop wakes up on time even when the other threads are busy. Setting
+ * a real-time priority requires root privileges : if it fails, the error is logged and the thread keeps running with
+ * the default policy.
+ *
+ * @param name Name of the thread (for the error message).
+ * @param config The scheduling settings.
+ */
+void Thread_set_realtime(const char *name, const struct RT_config *config) {
+	int error;
+	if (config->priority>0) {
+		struct sched_param param;
+		memset(&param,0,sizeof(param));
+		param.sched_priority = config->priority;
+		if ((error=pthread_setschedparam(pthread_self(),SCHED_FIFO,&param))!=0) {
+			sprintf(ERROR_MESSAGE,"Could not set SCHED_FIFO priority %d for the %s thread: %s\n",config->priority,name,strerror(error));
+			printf("%s",ERROR_MESSAGE);
+			pthread_mutex_lock(&error_log_write_lock);
+			write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+			pthread_mutex_unlock(&error_log_write_lock);
+		}
+	}
+	if (config->cpu>=0) {
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(config->cpu,&cpus);
+		if ((error=pthread_setaffinity_np(pthread_self(),sizeof(cpus),&cpus))!=0) {
+			sprintf(ERROR_MESSAGE,"Could not pin the %s thread to CPU %d: %s\n",name,config->cpu,strerror(error));
+			printf("%s",ERROR_MESSAGE);
+			pthread_mutex_lock(&error_log_write_lock);
+			write_to_file_custom(error_log,ERROR_MESSAGE,error_log);
+			pthread_mutex_unlock(&error_log_write_lock);
+		}
+	}
+}
@@ -0,0 +1,64 @@
+/**
+ * @file scheduler_header.h
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Periodic task scheduler header file.
+ *
+ * This is the header to scheduler_funcs.c containing necessary definitions and
+ * initializations.
+ */
+
+#ifndef SCHEDULER_HEADER_H_
+#define SCHEDULER_HEADER_H_
+
+# include <time.h>
+
+/**
+ * @struct Periodic_task
+ * Timing state of a loop that must run at a fixed period. The releases are absolute deadlines on CLOCK_MONOTONIC
+ * (start + k*period), so the time the loop body takes and the wake-up latency of the previous iteration do not
+ * accumulate into drift. An iteration that starts after its deadline has passed is counted in #overruns.
+ */
+struct Periodic_task {
+	const char *name; ///< Name used when reporting the statistics (see Periodic_task_report())
+	unsigned long long int period; ///< [us] period of the loop
+	struct timespec start; ///< First release
+	struct timespec deadline; ///< Release of the current iteration
+	struct timespec release; ///< Time at which the current iteration actually started
+	unsigned long long int elapsed; ///< [us] time between the first release and the start of the current iteration
+	unsigned long long int last_step; ///< [us] time between the start of the previous iteration and the start of the current one
+	unsigned long long int max_lateness; ///< [us] largest delay between a deadline and the actual start of its iteration
+	unsigned long int cycles; ///< Number of iterations done
+	unsigned long int overruns; ///< Number of iterations that started after their deadline (the missed periods are skipped)
+};
+
+/**
+ * @struct RT_config
+ * Real-time scheduling settings of one thread (see Thread_set_realtime()).
+ */
+struct RT_config {
+	int priority; ///< SCHED_FIFO priority (1-99, higher preempts lower), 0 keeps the default time-sharing policy
+	int cpu; ///< CPU the thread is pinned to, -1 lets it run on any CPU
+};
+
+/**
+ * @name Thread real-time settings
+ * Scheduling settings given to each thread with Thread_set_realtime() when it starts.
+ * @{
+ */
+extern struct RT_config IMU_READER__RT; ///< IMU UART reading thread (read_IMU_parallel())
+extern struct RT_config IMU_FILTER__RT; ///< IMU filtering thread (get_filtered_attitude_parallel())
+extern struct RT_config SPI__RT; ///< Pressure/temperature reading thread (get_readings_SPI_parallel())
+extern struct RT_config CONTROL__RT; ///< Control loop (main())
+extern struct RT_config RECORDER__RT; ///< Flight recorder thread (Recorder_write_parallel())
+/** @} */
+
+/** @cond INCLUDE_WITH_DOXYGEN */
+void Periodic_task_start(struct Periodic_task *task, const char *name, unsigned long long int period);
+void Periodic_task_wait(struct Periodic_task *task);
+void Periodic_task_report(const struct Periodic_task *task);
+void Thread_set_realtime(const char *name, const struct RT_config *config);
+/** @endcond */
+
+#endif /* SCHEDULER_HEADER_H_ */
@@ -11,7 +11,9 @@
  * the kindly provided code by Jean-Pierre Moreau <a href="http://jean-pierre.moreau.pagesperso-orange.fr/Cplus/tsimplex_cpp.txt">here</a>.
  * where only get_simplex_solution() function is new (i.e. not found at the above site)
  * and is used to conveniently extract the optimal solution directly into the valve thrusts
- * R1, R2, R3, R4 that are defined in the GNC program (see master_header.h).
+ * R1, R2, R3, R4 that are defined in the GNC program (see master_header.h). simplx_warm() and the
+ * Simplex_context functions are new as well : consecutive control iterations solve nearly the
+ * same problem, so simplx_warm() restarts from the previous optimal basis instead of from scratch.
  *
  * License from the original .cpp file:
  * @verbatim
@@ -30,11 +32,13 @@
  */
 
 # include <stdio.h>
+# include <string.h>
 # include <math.h>
+# include "master_header.h"
 # include "simplex_header.h"
 
 /**
- * @fn void simplx(MAT a, int m, int n, int m1, int m2, int m3, int *icase, int *izrov,int *iposv)
+ * @fn void simplx(MAT a, int m, int n, int m1, int m2, int m3, int *icase, int *izrov,int *iposv, int *pivots)
  *
  * USES simp1,simp2,simp3
  * Simplex method for linear programming. Input parameters a, m, n, mp, np, m1, m2, and m3,
@@ -49,13 +53,19 @@
  * @param m1 Number of (<=) type inequality constraints.
  * @param m2 Number of (>=) type inequality constraints.
  * @param m3 Number of (=) type constraints.
+ * @param icase Set to 0 if an optimal solution was found, 1 if the problem is unbounded, -1 if it is infeasible
+ * (or if m or n do not fit in #MMAX and #NMAX).
+ * @param izrov Right-hand variables of the solution.
+ * @param iposv Left-hand variables of the solution.
+ * @param pivots Incremented by the number of pivots (simp3() calls) made.
  */
 void simplx(MAT a, int m, int n, int m1, int m2, int m3, int *icase, int *izrov,
-		int *iposv) {
+		int *iposv, int *pivots) {
 	int i, ip, ir, is, k, kh, kp, m12, nl1, nl2, l1[NMAX], l2[MMAX], l3[MMAX];
 	REAL bmax, q1, EPS = 1e-6;
-	if (m != m1 + m2 + m3) {
+	if (m != m1 + m2 + m3 || m + 2 >= MMAX || n + 1 >= NMAX) {
 		printf(" Bad input constraint counts in simplx.\n");
+		*icase = -1;
 		return;
 	}
 	nl1 = n;
@@ -68,6 +78,7 @@ void simplx(MAT a, int m, int n, int m1, int m2, int m3, int *icase, int *izrov,
 		if (a[i + 1][1] < 0.0) {
 			printf(
 					" Bad input tableau in simplx, Constants bi must be nonnegative.\n");
+			*icase = -1;
 			return;
 		}
 		l2[i] = i;
@@ -129,6 +140,7 @@ void simplx(MAT a, int m, int n, int m1, int m2, int m3, int *icase, int *izrov,
 		return;
 	}
 	e1: simp3(a, m + 1, n, ip, kp);
+	(*pivots)++;
 //Exchange a left- and a right-hand variable (phase one), then update lists.
 	if (iposv[ip] >= n + m1 + m2 + 1) { //Exchanged out an artificial variable for an
 										//equality constraint. Make sure it stays
@@ -171,10 +183,135 @@ void simplx(MAT a, int m, int n, int m1, int m2, int m3, int *icase, int *izrov,
 		return;
 	}
 	simp3(a, m, n, ip, kp); //Exchange a left- and a right-hand variable (phase two),
+	(*pivots)++;
 	goto e20;
 	//update lists of left- and right-hand variables and
 }                           //return for another iteration.
 
+/**
+ * @fn int simplx_warm(MAT a, int m, int n, int *basis, int *icase, int *izrov, int *iposv, int *pivots)
+ *
+ * Warm-started Simplex method for problems with only (=) type constraints (m3=m), given in the same
+ * table a as to simplx(). Instead of searching for a feasible basis from the artificial variables,
+ * the left-hand variables of the previous optimal solution (basis) are pivoted back into the table.
+ * If that basis is primal feasible (all left-hand values >=0) and dual feasible (no cost function
+ * coefficient >0), it is optimal and no Simplex pivot is made. If it is only one of the two, at most
+ * #SIMPLEX_WARM_MAX_PIVOTS primal (resp. dual) Simplex pivots are tried from it. In every other case
+ * (no previous basis, an artificial variable in it, a singular pivot, too many pivots), the table is
+ * restored and solved from scratch by simplx(). basis is updated with every optimal solution.
+ *
+ * @param a Simplex table.
+ * @param m Total number of constraints (all of (=) type).
+ * @param n Number of variables in cost function.
+ * @param basis Left-hand variables of the previous optimal solution (basis[1]==0 if there is none).
+ * @param icase Set to 0 if an optimal solution was found, 1 if the problem is unbounded, -1 if it is infeasible.
+ * @param izrov Right-hand variables of the solution.
+ * @param iposv Left-hand variables of the solution.
+ * @param pivots Set to the number of Simplex pivots made (those installing the previous basis excluded).
+ *
+ * @return How the solution was found (#SIMPLEX_WARM_OPTIMAL, #SIMPLEX_WARM_REPAIRED or #SIMPLEX_COLD).
+ */
+int simplx_warm(MAT a, int m, int n, int *basis, int *icase, int *izrov, int *iposv, int *pivots) {
+	int i, k, ip, kp, is, nl1, l1[NMAX], l2[MMAX], primal, dual;
+	REAL bmax, q1, ratio, best, EPS = 1e-6, FEASIBILITY_EPS = 1e-12;
+	MAT cold;
+
+	*pivots = 0;
+	if (m + 2 >= MMAX || n + 1 >= NMAX) {
+		*icase = -1;
+		return SIMPLEX_COLD;
+	}
+	memcpy(cold, a, sizeof(MAT)); // Kept to fall back to simplx()
+	if (basis[1] == 0)
+		goto cold_start;
+	for (k = 1; k <= n; k++)
+		izrov[k] = k;
+	for (i = 1; i <= m; i++) {
+		iposv[i] = n + i;
+		l2[i] = i;
+	}
+	// Install the previous basis : pivot each of its variables into the row of an artificial variable, choosing the
+	// largest pivot element (the row a variable was in does not matter, and may have a zero pivot element by now)
+	for (i = 1; i <= m; i++) {
+		if (basis[i] < 1 || basis[i] > n)
+			goto cold_start; // Artificial variable left in the basis
+		for (kp = 1; kp <= n; kp++)
+			if (izrov[kp] == basis[i])
+				break;
+		if (kp > n)
+			goto cold_start;
+		ip = 0;
+		for (k = 1; k <= m; k++)
+			if (iposv[k] > n && (ip == 0 || fabs(a[k + 1][kp + 1]) > fabs(a[ip + 1][kp + 1])))
+				ip = k;
+		if (fabs(a[ip + 1][kp + 1]) < EPS)
+			goto cold_start; // The previous basis is singular for this problem
+		simp3(a, m, n, ip, kp);
+		izrov[kp] = iposv[ip];
+		iposv[ip] = basis[i];
+	}
+	nl1 = 0; // Columns of the original variables (the artificial ones must stay right-hand)
+	for (k = 1; k <= n; k++)
+		if (izrov[k] <= n)
+			l1[++nl1] = k;
+
+	for (;;) {
+		primal = 1;
+		for (i = 1; i <= m; i++)
+			if (a[i + 1][1] < -FEASIBILITY_EPS) // Much tighter than EPS : a slightly negative thrust is not accepted
+				primal = 0;
+		bmax = 0.0;
+		if (nl1 > 0)
+			simp1(a, 0, l1, nl1, 0, &kp, &bmax);
+		dual = (bmax <= EPS);
+		if (primal && dual) {
+			*icase = 0;
+			for (i = 1; i <= m; i++)
+				basis[i] = iposv[i];
+			return *pivots == 0 ? SIMPLEX_WARM_OPTIMAL : SIMPLEX_WARM_REPAIRED;
+		}
+		if ((!primal && !dual) || *pivots >= SIMPLEX_WARM_MAX_PIVOTS)
+			goto cold_start;
+		if (primal) { // Primal Simplex pivot on the column kp found by simp1()
+			simp2(a, m, n, l2, m, &ip, kp, &q1);
+			if (ip == 0) {
+				*icase = 1;
+				return SIMPLEX_WARM_REPAIRED;
+			}
+		} else { // Dual Simplex pivot : the most negative left-hand variable leaves
+			ip = 1;
+			for (i = 2; i <= m; i++)
+				if (a[i + 1][1] < a[ip + 1][1])
+					ip = i;
+			kp = 0;
+			best = 0.0;
+			for (k = 1; k <= nl1; k++)
+				if (a[ip + 1][l1[k] + 1] > EPS) {
+					ratio = -a[1][l1[k] + 1] / a[ip + 1][l1[k] + 1];
+					if (kp == 0 || ratio < best) {
+						kp = l1[k];
+						best = ratio;
+					}
+				}
+			if (kp == 0)
+				goto cold_start;
+		}
+		simp3(a, m, n, ip, kp);
+		(*pivots)++;
+		is = izrov[kp];
+		izrov[kp] = iposv[ip];
+		iposv[ip] = is;
+	}
+
+	cold_start: memcpy(a, cold, sizeof(MAT));
+	*pivots = 0;
+	simplx(a, m, n, 0, 0, m, icase, izrov, iposv, pivots);
+	if (*icase == 0)
+		for (i = 1; i <= m; i++)
+			basis[i] = iposv[i];
+	return SIMPLEX_COLD;
+}
+
 // The preceding routine makes use of the following utility subroutines:
 
 /**
@@ -273,54 +410,107 @@ void simp3(MAT a, int i1, int k1, int ip, int kp) {
 }
 
 /**
- * @fn void get_simplex_solution(int ICASE, int *IPOSV, MAT A, int M, int N, double *R1, double *R2, double *R3, double *R4)
- * This function writes the result of the Simplex optimization into R1, R2, R3 and R4 (the valve thrusts).
+ * @fn void get_simplex_solution(int icase, const int *iposv, MAT a, int m, int n, double *R1, double *R2, double *R3, double *R4)
+ * This function writes the result of the Simplex optimization into R1, R2, R3 and R4 (the valve thrusts). If no
+ * solution was found (icase!=0), they are left unchanged : the caller must check icase (see Allocate_thrust_simplex()).
  *
- * @param A Simplex table.
- * @param M Total number of contraints.
- * @param N Total number of variables in cost function.
+ * @param icase Result of simplx().
+ * @param iposv Left-hand variables of the solution.
+ * @param a Simplex table.
+ * @param m Total number of contraints.
+ * @param n Total number of variables in cost function.
  * @param R1 Pointer to the memory holding the R1 valve thrust.
  * @param R2 Pointer to the memory holding the R2 valve thrust.
  * @param R3 Pointer to the memory holding the R3 valve thrust.
  * @param R4 Pointer to the memory holding the R4 valve thrust.
  */
-void get_simplex_solution(int ICASE, int *IPOSV, MAT A, int M, int N, double *R1, double *R2, double *R3, double *R4) {
-	if (ICASE == 0) {  //result ok.
-		for (i = 1; i <= N; i++) {
-			for (j = 1; j <= M; j++) {
-				if (IPOSV[j] == i) {
-					switch (i) { // Assign simplex result to appropriate valve
-					case 1:
-						*R1 = A[j + 1][1];
-						break;
-					case 2:
-						*R2 = A[j + 1][1];
-						break;
-					case 3:
-						*R3 = A[j + 1][1];
-						break;
-					case 4:
-						*R4 = A[j + 1][1];
-					}
-					goto e3;
-				}
-			}
-			switch (i) { // Assign simplex result to appropriate valve (same as just above)
-			case 1:
-				*R1 = 0.0;
-				break;
-			case 2:
-				*R2 = 0.0;
-				break;
-			case 3:
-				*R3 = 0.0;
-				break;
-			case 4:
-				*R4 = 0.0;
-			}
-			e3: ;
-		}
-	} else {
-		printf(" No Simplex solution found (error code = %d).\n", ICASE);
+void get_simplex_solution(int icase, const int *iposv, MAT a, int m, int n, double *R1, double *R2, double *R3, double *R4) {
+	int i, j;
+	double R[5] = {0.0, 0.0, 0.0, 0.0, 0.0}; // R[1..4] : valve thrusts (right-hand variables are 0)
+	if (icase != 0)
+		return;
+	for (j = 1; j <= m; j++) {
+		i = iposv[j];
+		if (i >= 1 && i <= n && i <= 4)
+			R[i] = a[j + 1][1]; // Assign simplex result to appropriate valve
 	}
+	*R1 = R[1];
+	*R2 = R[2];
+	*R3 = R[3];
+	*R4 = R[4];
+}
+
+/**
+ * @fn void Simplex_statistics_add(struct Simplex_statistics *statistics, int start, int pivots)
+ *
+ * This function counts one Simplex solution in statistics.
+ *
+ * @param statistics The statistics.
+ * @param start How the solution was found (see simplx_warm()).
+ * @param pivots Number of pivots it took.
+ */
+void Simplex_statistics_add(struct Simplex_statistics *statistics, int start, int pivots) {
+	statistics->solves++;
+	statistics->starts[start]++;
+	statistics->pivots += pivots;
+	statistics->histogram[pivots < SIMPLEX_PIVOT_HISTOGRAM_SIZE ? pivots : SIMPLEX_PIVOT_HISTOGRAM_SIZE-1]++;
+	statistics->last_pivots = pivots;
+}
+
+/**
+ * @fn void Simplex_context_init(struct Simplex_context *context)
+ *
+ * This function clears a Simplex context : no previous basis (the next Simplex_solve() starts cold) and no statistics.
+ *
+ * @param context The context.
+ */
+void Simplex_context_init(struct Simplex_context *context) {
+	memset(context, 0, sizeof(struct Simplex_context));
+}
+
+/**
+ * @fn int Simplex_solve(struct Simplex_context *context, int m, int n)
+ *
+ * This function solves the problem of m (=) type constraints and n variables filled in context->a with simplx_warm(),
+ * from the optimal basis of the previous problem solved in the same context, and counts the pivots in
+ * context->statistics. It only touches context, so contexts can be used concurrently by different threads.
+ *
+ * @param context The context.
+ * @param m Total number of constraints (all of (=) type).
+ * @param n Number of variables in cost function.
+ *
+ * @return context->icase.
+ */
+int Simplex_solve(struct Simplex_context *context, int m, int n) {
+	int start, pivots;
+	start = simplx_warm(context->a, m, n, context->basis, &context->icase, context->izrov, context->iposv, &pivots);
+	Simplex_statistics_add(&context->statistics, start, pivots);
+	return context->icase;
+}
+
+/**
+ * @fn void Simplex_report(const char *name, const struct Simplex_context *context)
+ *
+ * This function prints the pivot counts of the Simplex solutions made in a context and also writes them to the
+ * #error_log.
+ *
+ * @param name Name of the context (e.g. of the loop using it).
+ * @param context The context.
+ */
+void Simplex_report(const char *name, const struct Simplex_context *context) {
+	char REPORT[400];
+	const struct Simplex_statistics *statistics = &context->statistics;
+	int length, k;
+	if (statistics->solves == 0)
+		return;
+	length = sprintf(REPORT,"%s Simplex: %lu solutions (%lu warm optimal, %lu warm repaired, %lu cold), %.3f pivots on average, histogram",
+			name,statistics->solves,statistics->starts[SIMPLEX_WARM_OPTIMAL],statistics->starts[SIMPLEX_WARM_REPAIRED],
+			statistics->starts[SIMPLEX_COLD],(double)statistics->pivots/statistics->solves);
+	for (k = 0; k < SIMPLEX_PIVOT_HISTOGRAM_SIZE; k++)
+		length += sprintf(REPORT+length," %d%s:%lu",k,k==SIMPLEX_PIVOT_HISTOGRAM_SIZE-1 ? "+" : "",statistics->histogram[k]);
+	sprintf(REPORT+length,"\n");
+	printf("%s",REPORT);
+	pthread_mutex_lock(&error_log_write_lock);
+	write_to_file_custom(error_log,REPORT,error_log);
+	pthread_mutex_unlock(&error_log_write_lock);
 }
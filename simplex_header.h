@@ -6,7 +6,9 @@
  * @brief Simplex header file.
  *
  * This is the header to simplex_funcs.c containing necessary definitions and
- * initializations. This header supports, but was not provided with, the code
+ * initializations. It defines no variable : every solution works in a caller-owned
+ * #Simplex_context, so independent problems can be solved concurrently on different
+ * cores (one context per thread). This header supports, but was not provided with, the code
  * kindly provided code by Jean-Pierre Moreau <a href="http://jean-pierre.moreau.pagesperso-orange.fr/Cplus/tsimplex_cpp.txt">here</a>.
  * where the header definitions in this file were directly incorporated into the
  * code at the above url.
@@ -30,24 +32,61 @@
 #ifndef SIMPLEX_HEADER_H_
 #define SIMPLEX_HEADER_H_
 
-#define  MMAX  5 ///< Number of rows of the simplex table
-#define  NMAX  6 ///< Number of columns of the simplex table
+#define  MMAX  6 ///< Number of rows of the simplex table (indexed from 1 : cost function, up to 3 constraints and the auxiliary cost function of phase one)
+#define  NMAX  6 ///< Number of columns of the simplex table (indexed from 1 : constant term and up to 4 variables)
 #define  REAL  double ///< Alias for a double
+#define  SIMPLEX_WARM_MAX_PIVOTS 4 ///< Most pivots simplx_warm() makes from the previous basis before falling back to simplx()
+#define  SIMPLEX_PIVOT_HISTOGRAM_SIZE 8 ///< Number of bins of #Simplex_statistics.histogram (the last one counts all larger pivot counts)
+
+/**
+ * @name Simplex start types
+ * Values returned by simplx_warm()
+ * @{
+ */
+#define  SIMPLEX_WARM_OPTIMAL 0 ///< The previous optimal basis was still optimal
+#define  SIMPLEX_WARM_REPAIRED 1 ///< The optimum was reached with a few pivots from the previous optimal basis
+#define  SIMPLEX_COLD 2 ///< The problem was solved from scratch by simplx()
+/** @} */
 
 typedef REAL MAT[MMAX][NMAX]; ///< A [MMAXxNMAX] matrix
 
-MAT  A; ///< Simplex table
-int  IPOSV[MMAX], IZROV[NMAX];
-int  i; ///< Index variable for loops
-int j; ///< Index variable for loops
-int ICASE,N,M,M1,M2,M3;
+/**
+ * @struct Simplex_statistics
+ * Pivot counts of the Simplex solutions of the flight (see Simplex_report()).
+ */
+struct Simplex_statistics {
+	unsigned long int solves; ///< Number of problems solved
+	unsigned long int starts[3]; ///< Number of solutions of each start type (#SIMPLEX_WARM_OPTIMAL, ...)
+	unsigned long int pivots; ///< Total number of Simplex pivots
+	unsigned long int histogram[SIMPLEX_PIVOT_HISTOGRAM_SIZE]; ///< Number of solutions which took 0, 1, 2, ... pivots
+	unsigned int last_pivots; ///< Number of pivots of the last solution
+};
+
+/**
+ * @struct Simplex_context
+ * Workspace and state of a sequence of Simplex solutions (see Simplex_solve()). Its size is fixed at compile time by
+ * #MMAX and #NMAX.
+ */
+struct Simplex_context {
+	MAT a; ///< Simplex table, filled by the caller (see simplx()) and holding the solution afterwards
+	int iposv[MMAX]; ///< Left-hand variables of the solution
+	int izrov[NMAX]; ///< Right-hand variables of the solution
+	int icase; ///< 0 if an optimal solution was found, 1 if the problem is unbounded, -1 if it is infeasible
+	int basis[MMAX]; ///< Left-hand variables of the last optimal solution, reused by simplx_warm() (basis[1]==0 : none)
+	struct Simplex_statistics statistics; ///< Pivot counts of the solutions
+};
 
 /** @cond INCLUDE_WITH_DOXYGEN */
-void simplx(MAT a,int m,int n,int m1,int m2,int m3,int *icase,int *izrov, int *iposv);
+void simplx(MAT a,int m,int n,int m1,int m2,int m3,int *icase,int *izrov, int *iposv, int *pivots);
+int simplx_warm(MAT a,int m,int n,int *basis,int *icase,int *izrov,int *iposv,int *pivots);
+void Simplex_statistics_add(struct Simplex_statistics *statistics, int start, int pivots);
+void Simplex_context_init(struct Simplex_context *context);
+int Simplex_solve(struct Simplex_context *context, int m, int n);
+void Simplex_report(const char *name, const struct Simplex_context *context);
 void simp1(MAT a,int mm,int *ll,int nll,int iabf,int *kp,REAL *bmax);
 void simp2(MAT a, int m,int n,int *l2,int nl2,int *ip,int kp,REAL *q1);
 void simp3(MAT a,int i1,int k1,int ip,int kp);
-void get_simplex_solution(int ICASE, int *IPOSV, MAT A, int M, int N, double *R1, double *R2, double *R3, double *R4);
+void get_simplex_solution(int icase, const int *iposv, MAT a, int m, int n, double *R1, double *R2, double *R3, double *R4);
 /** @endcond */
 
 #endif /* SIMPLEX_HEADER_H_ */
@@ -0,0 +1,84 @@
+/**
+ * @file timebase_funcs.c
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Timebase functions file.
+ *
+ * This file contains the set-up of the timebase (see now_ns()) that all threads use to time-stamp
+ * their data, and the profiler of the pre-flight phases (see Boot_phase_start()).
+ */
+
+# include <stdio.h>
+# include <stdlib.h>
+# include <time.h>
+# include "timebase_header.h"
+
+static struct Boot_phase boot_phases[BOOT_MAX_PHASES]; ///< Pre-flight phases timed so far
+static unsigned int boot_phase_count=0; ///< Number of entries of #boot_phases
+
+/**
+ * @fn void Timebase_init(void)
+ *
+ * This function sets #GLOBAL__TIME_STARTPOINT, the origin of all the logged time stamps, to the current time. It
+ * also makes sure the raw monotonic clock is available with at least microsecond resolution, since the logs are
+ * written in [us].
+ */
+void Timebase_init(void) {
+	struct timespec resolution;
+	if (clock_getres(CLOCK_MONOTONIC_RAW,&resolution)<0 || resolution.tv_sec!=0 || resolution.tv_nsec>1000) {
+		perror("CRITICAL ERROR: CLOCK_MONOTONIC_RAW is unavailable or coarser than 1 [us].");
+		exit(-2);
+	}
+	GLOBAL__TIME_STARTPOINT = now_ns();
+}
+
+/**
+ * @fn void Boot_phase_start(const char *name)
+ *
+ * This function starts timing a pre-flight phase, ending the previous one if it is still running. Only the automatic
+ * steps are meant to be timed : a phase should be ended with Boot_phase_end() before waiting for the operator. It is
+ * called by main() only.
+ *
+ * @param name Name of the phase (a string constant).
+ */
+void Boot_phase_start(const char *name) {
+	Boot_phase_end();
+	if (boot_phase_count==BOOT_MAX_PHASES) return; // Not timed
+	boot_phases[boot_phase_count].name=name;
+	boot_phases[boot_phase_count].start=time_since_start_us();
+	boot_phases[boot_phase_count].duration=0;
+	boot_phase_count++;
+}
+
+/**
+ * @fn void Boot_phase_end(void)
+ *
+ * This function ends the pre-flight phase started last by Boot_phase_start(), if it is still running.
+ */
+void Boot_phase_end(void) {
+	struct Boot_phase *phase;
+	if (boot_phase_count==0 || boot_phases[boot_phase_count-1].duration!=0) return;
+	phase=&boot_phases[boot_phase_count-1];
+	phase->duration=time_since_start_us()-phase->start;
+	if (phase->duration==0) phase->duration=1; // Ended
+}
+
+/**
+ * @fn void Boot_profile_report(void)
+ *
+ * This function prints the duration of each pre-flight phase timed so far, and their total (the time spent waiting for
+ * the operator is not included).
+ */
+void Boot_profile_report(void) {
+	unsigned long long int total=0;
+	unsigned int k;
+
+	Boot_phase_end();
+	printf("\nPre-flight timing:\n");
+	for (k=0;k<boot_phase_count;k++) {
+		printf("  %-28s %10.3f [s]\n",boot_phases[k].name,boot_phases[k].duration/1e6);
+		total+=boot_phases[k].duration;
+	}
+	printf("  %-28s %10.3f [s]\n","Total (without the operator)",total/1e6);
+}
@@ -0,0 +1,62 @@
+/**
+ * @file timebase_header.h
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Timebase header file.
+ *
+ * This is the header to timebase_funcs.c containing necessary definitions and
+ * initializations. The time reading functions are inline so that time-stamping
+ * a sample costs a single clock_gettime() (a vDSO call, no system call).
+ */
+
+#ifndef TIMEBASE_HEADER_H_
+#define TIMEBASE_HEADER_H_
+
+# include <time.h>
+
+unsigned long long int GLOBAL__TIME_STARTPOINT; ///< [ns] now_ns() when the program started (very first line of main(), see Timebase_init())
+
+# define BOOT_MAX_PHASES 16 ///< Largest number of pre-flight phases timed by Boot_phase_start()
+
+/**
+ * @struct Boot_phase
+ * Duration of one pre-flight phase (see Boot_phase_start() and Boot_profile_report()).
+ */
+struct Boot_phase {
+	const char *name; ///< Name of the phase
+	unsigned long long int start; ///< [us] time since #GLOBAL__TIME_STARTPOINT at which the phase started
+	unsigned long long int duration; ///< [us] duration of the phase (0 while it runs)
+};
+
+/**
+ * @fn unsigned long long int now_ns(void)
+ *
+ * This function returns the current time in [ns] on the raw monotonic clock of the Raspberry Pi. Unlike gettimeofday(),
+ * this clock never jumps (e.g. when NTP sets the date) and is not slewed, so differences between two readings are true
+ * durations. The origin is arbitrary : only use differences (see time_since_start_us()).
+ */
+static inline unsigned long long int now_ns(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC_RAW,&now);
+	return (unsigned long long int)now.tv_sec*1000000000ULL+(unsigned long long int)now.tv_nsec;
+}
+
+/**
+ * @fn unsigned long long int time_since_start_us(void)
+ *
+ * This function returns the time in [us] elapsed since #GLOBAL__TIME_STARTPOINT. It is the time stamp written to the
+ * IMU, pressure and control logs, so all three logs share the same time axis.
+ */
+static inline unsigned long long int time_since_start_us(void) {
+	return (now_ns()-GLOBAL__TIME_STARTPOINT)/1000;
+}
+
+/** @cond INCLUDE_WITH_DOXYGEN */
+void Timebase_init(void);
+void Boot_phase_start(const char *name);
+void Boot_phase_end(void);
+void Boot_profile_report(void);
+/** @endcond */
+
+#endif /* TIMEBASE_HEADER_H_ */
@@ -0,0 +1,237 @@
+/**
+ * @file valve_funcs.c
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Valve curve functions file.
+ *
+ * This file contains the functions which convert the valve thrusts computed by the thrust allocation into the PWM
+ * values sent to the MSP430, using the calibrated thrust curve of the valves (see search_PWM()). The curve is
+ * piecewise linear between its calibration points : everything that can be computed in advance (segment slopes, the
+ * segment of each thrust bucket) is computed once by Valve_curve_init(), so a conversion is a few operations without
+ * any search or division.
+ */
+
+# include <stdio.h>
+# include <string.h>
+# include <math.h>
+# include "master_header.h"
+# include "valve_header.h"
+
+struct Valve_curve valve_curves[VALVE_COUNT]; ///< Thrust curves of the R1, R2, R3, R4 valves
+
+/**
+ * @fn int Valve_curve_init(struct Valve_curve *curve, const unsigned int *PWM, const double *thrust, unsigned int points)
+ *
+ * This function checks calibration points and prepares the valve curve going through them for Valve_thrust_to_PWM().
+ * Both the thrusts and the PWMs of the points must be strictly increasing.
+ *
+ * @param curve The valve curve.
+ * @param PWM PWM of each calibration point.
+ * @param thrust [N] Thrust of each calibration point.
+ * @param points Number of calibration points.
+ *
+ * @return #VALVE_CURVE_OK, or #VALVE_CURVE_INVALID with the reason in #ERROR_MESSAGE.
+ */
+int Valve_curve_init(struct Valve_curve *curve, const unsigned int *PWM, const double *thrust, unsigned int points) {
+	unsigned int k, bucket, buckets, segment;
+	double narrowest;
+
+	if (points<2 || points>VALVE_CURVE_MAX_POINTS) {
+		sprintf(ERROR_MESSAGE,"Valve curve has %u points (2 to %d expected)\n",points,VALVE_CURVE_MAX_POINTS);
+		return VALVE_CURVE_INVALID;
+	}
+	for (k=0;k<points;k++) {
+		if (!(thrust[k]>=0) || !isfinite(thrust[k]) || PWM[k]>VALVE_PWM_MAX) {
+			sprintf(ERROR_MESSAGE,"Valve curve point %u (PWM %u, thrust %g) out of range\n",k,PWM[k],thrust[k]);
+			return VALVE_CURVE_INVALID;
+		}
+		if (k>0 && (thrust[k]<=thrust[k-1] || PWM[k]<=PWM[k-1])) {
+			sprintf(ERROR_MESSAGE,"Valve curve not strictly increasing at point %u (PWM %u, thrust %g)\n",k,PWM[k],thrust[k]);
+			return VALVE_CURVE_INVALID;
+		}
+	}
+
+	memset(curve,0,sizeof(struct Valve_curve));
+	curve->points=points;
+	narrowest=HUGE_VAL;
+	for (k=0;k<points;k++) {
+		curve->thrust[k]=thrust[k];
+		curve->PWM[k]=PWM[k];
+		if (k+1<points) {
+			curve->slope[k]=((double)PWM[k+1]-PWM[k])/(thrust[k+1]-thrust[k]);
+			narrowest=fmin(narrowest,thrust[k+1]-thrust[k]);
+		}
+	}
+
+	// Buckets half as wide as the narrowest segment, so that a rounding of the bucket index never skips a segment
+	curve->bucket_scale=2.0/narrowest;
+	buckets=(unsigned int)((thrust[points-1]-thrust[0])*curve->bucket_scale)+1;
+	if (buckets>VALVE_INVERSE_TABLE_SIZE) {
+		sprintf(ERROR_MESSAGE,"Valve curve needs %u thrust buckets (at most %d) : its narrowest segment is too narrow\n",buckets,VALVE_INVERSE_TABLE_SIZE);
+		return VALVE_CURVE_INVALID;
+	}
+	segment=0;
+	for (bucket=0;bucket<buckets;bucket++) {
+		while (segment+2<points && thrust[segment+1]<=thrust[0]+bucket/curve->bucket_scale) segment++;
+		curve->bucket_segment[bucket]=segment;
+	}
+	return VALVE_CURVE_OK;
+}
+
+/**
+ * @fn int Valve_calibration_load(struct Valve_curve *curves, const char *path)
+ *
+ * This function reads the calibrated thrust curves of the #VALVE_COUNT valves from a text file and prepares each of
+ * them with Valve_curve_init(), so that nothing is parsed or checked in flight. The file holds one section per valve,
+ * headed [R1], [R2], [R3] and [R4] (in any order), each followed by its calibration points, one per line : PWM and
+ * thrust [N] separated by spaces. A file without any section holds a single curve used for all the valves. Empty
+ * lines and lines starting with '#' are ignored. For example :
+ * @verbatim
+   # PWM  thrust [N]
+   [R1]
+   310    0.0
+   420    0.17
+   ...
+   [R2]
+   305    0.0
+   ...
+   @endverbatim
+ * The curves may have any number of points up to #VALVE_CURVE_MAX_POINTS, not necessarily the same for all valves.
+ * Nothing is written into curves unless all of them are valid.
+ *
+ * @param curves The #VALVE_COUNT valve curves.
+ * @param path Path of the calibration file.
+ *
+ * @return #VALVE_CURVE_OK, #VALVE_CURVE_NO_FILE, or #VALVE_CURVE_INVALID with the reason in #ERROR_MESSAGE.
+ */
+int Valve_calibration_load(struct Valve_curve *curves, const char *path) {
+	FILE *file;
+	char line[200], first[2], reason[sizeof(ERROR_MESSAGE)];
+	static unsigned int PWM[VALVE_COUNT][VALVE_CURVE_MAX_POINTS];
+	static double thrust[VALVE_COUNT][VALVE_CURVE_MAX_POINTS];
+	static struct Valve_curve loaded[VALVE_COUNT];
+	unsigned int points[VALVE_COUNT]={0}, line_number=0;
+	int valve=0, sections=0, section_seen[VALVE_COUNT]={0}, number;
+
+	if ((file=fopen(path,"r"))==NULL) return VALVE_CURVE_NO_FILE;
+	while (fgets(line,sizeof(line),file)!=NULL) {
+		line_number++;
+		if (sscanf(line," %1s",first)!=1 || first[0]=='#') continue; // Empty line or comment
+		if (first[0]=='[') { // Section header
+			if (sscanf(line," [R%d]",&number)!=1 || number<1 || number>VALVE_COUNT || section_seen[number-1] || (sections==0 && points[0]>0)) {
+				sprintf(ERROR_MESSAGE,"%s:%u: expected a new [R1] to [R%d] section before any point\n",path,line_number,VALVE_COUNT);
+				fclose(file);
+				return VALVE_CURVE_INVALID;
+			}
+			valve=number-1;
+			section_seen[valve]=1;
+			sections++;
+			continue;
+		}
+		if (points[valve]==VALVE_CURVE_MAX_POINTS || sscanf(line,"%u %lf",&PWM[valve][points[valve]],&thrust[valve][points[valve]])!=2) {
+			sprintf(ERROR_MESSAGE,"%s:%u: expected \"PWM thrust\" (at most %d points per valve)\n",path,line_number,VALVE_CURVE_MAX_POINTS);
+			fclose(file);
+			return VALVE_CURVE_INVALID;
+		}
+		points[valve]++;
+	}
+	fclose(file);
+
+	if (sections>0 && sections<VALVE_COUNT) {
+		sprintf(ERROR_MESSAGE,"%s: %d of the %d valve sections are missing\n",path,VALVE_COUNT-sections,VALVE_COUNT);
+		return VALVE_CURVE_INVALID;
+	}
+	for (valve=0;valve<VALVE_COUNT;valve++) {
+		number=(sections>0) ? valve : 0; // Without sections, the single curve is that of every valve
+		if (Valve_curve_init(&loaded[valve],PWM[number],thrust[number],points[number])!=VALVE_CURVE_OK) {
+			strcpy(reason,ERROR_MESSAGE);
+			snprintf(ERROR_MESSAGE,sizeof(ERROR_MESSAGE),"%s [R%d]: %.120s",path,valve+1,reason);
+			return VALVE_CURVE_INVALID;
+		}
+	}
+	memcpy(curves,loaded,sizeof(loaded));
+	return VALVE_CURVE_OK;
+}
+
+/**
+ * @fn unsigned int Valve_thrust_to_PWM(const struct Valve_curve *curve, double thrust)
+ *
+ * This function gives the PWM producing a valve thrust, by linear interpolation of the valve curve. A thrust of 0 or
+ * less (or NaN) closes the valve (PWM 0), a thrust beyond the last calibration point opens it fully (PWM of that
+ * point), and a thrust between 0 and the first calibration point gives the PWM of that point. The segment of the thrust
+ * is read from the bucket table (the bucket holds at most the start of the next segment, hence the single comparison),
+ * so the cost does not depend on the number of calibration points.
+ *
+ * @param curve The valve curve (see Valve_curve_init()).
+ * @param thrust [N] Desired valve thrust.
+ *
+ * @return The PWM, rounded to the nearest integer.
+ */
+unsigned int Valve_thrust_to_PWM(const struct Valve_curve *curve, double thrust) {
+	double R=fmin(fmax(thrust,curve->thrust[0]),curve->thrust[curve->points-1]); // fmax() also replaces NaN
+	unsigned int k=curve->bucket_segment[(unsigned int)((R-curve->thrust[0])*curve->bucket_scale)];
+	k+=(R>=curve->thrust[k+1]); // Next segment (or the last point, of slope 0)
+	return (thrust>0) ? (unsigned int)(curve->PWM[k]+curve->slope[k]*(R-curve->thrust[k])+0.5) : 0; // Rounded (the PWM is >=0)
+}
+
+/**
+ * @fn void Valve_thrusts_to_PWM(const struct Valve_curve *curves, const double *thrust, unsigned int *PWM)
+ *
+ * This function converts the thrusts of all the valves into PWMs (see Valve_thrust_to_PWM()).
+ *
+ * @param curves The #VALVE_COUNT valve curves.
+ * @param thrust [N] The #VALVE_COUNT desired valve thrusts.
+ * @param PWM The #VALVE_COUNT PWMs.
+ */
+void Valve_thrusts_to_PWM(const struct Valve_curve *curves, const double *thrust, unsigned int *PWM) {
+	int k;
+	for (k=0;k<VALVE_COUNT;k++) PWM[k]=Valve_thrust_to_PWM(&curves[k],thrust[k]);
+}
+
+/**
+ * @fn double Valve_curves_max_thrust(const struct Valve_curve *curves)
+ *
+ * This function gives the largest thrust that every valve can produce, i.e. the smallest thrust of the last
+ * calibration points. Above it, Valve_thrust_to_PWM() opens the weakest valve fully but it falls short of the demand.
+ *
+ * @param curves The #VALVE_COUNT valve curves.
+ *
+ * @return [N] The largest thrust common to all the valves.
+ */
+double Valve_curves_max_thrust(const struct Valve_curve *curves) {
+	double max_thrust=curves[0].thrust[curves[0].points-1];
+	int k;
+	for (k=1;k<VALVE_COUNT;k++) {
+		if (curves[k].thrust[curves[k].points-1]<max_thrust) max_thrust=curves[k].thrust[curves[k].points-1];
+	}
+	return max_thrust;
+}
+
+/**
+ * @fn unsigned int Valve_curve_self_test(const struct Valve_curve *curve)
+ *
+ * This function checks, before flight, Valve_thrust_to_PWM() against a linear search of the calibration points over a
+ * dense grid of thrusts from below 0 to beyond the last point.
+ *
+ * @param curve The valve curve.
+ *
+ * @return The largest PWM difference, to be compared to #VALVE_CURVE_SELF_TEST_TOLERANCE.
+ */
+unsigned int Valve_curve_self_test(const struct Valve_curve *curve) {
+	const unsigned int samples=100000;
+	double R_max=curve->thrust[curve->points-1];
+	double thrust, R, expected;
+	unsigned int n, k, PWM, reference, deviation=0;
+
+	for (n=0;n<=samples;n++) {
+		thrust=-0.1*R_max+n*(1.2*R_max/samples);
+		R=fmin(fmax(thrust,curve->thrust[0]),R_max);
+		for (k=0;k+2<curve->points && R>curve->thrust[k+1];k++);
+		expected=curve->PWM[k]+(curve->PWM[k+1]-curve->PWM[k])/(curve->thrust[k+1]-curve->thrust[k])*(R-curve->thrust[k]);
+		reference=(thrust>0) ? (unsigned int)floor(expected+0.5) : 0;
+		PWM=Valve_thrust_to_PWM(curve,thrust);
+		if (PWM>reference+deviation || reference>PWM+deviation) deviation=(PWM>reference) ? PWM-reference : reference-PWM;
+	}
+	return deviation;
+}
@@ -0,0 +1,58 @@
+/**
+ * @file valve_header.h
+ * @author Danylo Malyuta <danylo.malyuta@gmail.com>
+ * @version 1.0
+ *
+ * @brief Valve curve header file.
+ *
+ * This is the header to valve_funcs.c containing necessary definitions and
+ * initializations.
+ */
+
+#ifndef VALVE_HEADER_H_
+#define VALVE_HEADER_H_
+
+# define VALVE_COUNT 4 ///< Number of RCS valves (R1, R2, R3, R4)
+# define VALVE_CURVE_MAX_POINTS 128 ///< Largest number of points of a calibrated valve thrust curve (at most 256, see #Valve_curve.bucket_segment)
+# define VALVE_INVERSE_TABLE_SIZE 4096 ///< Largest number of uniform thrust buckets of the inverse table of a #Valve_curve (the narrowest segment of a curve must be at least 2/4096 of its thrust range)
+# define VALVE_PWM_MAX 1023 ///< Largest PWM value (10-bit PWM of the MSP430)
+# define VALVE_CURVE_SELF_TEST_TOLERANCE 1 ///< Largest PWM difference allowed by Valve_curve_self_test() (a rounding of .5 may go either way)
+
+/**
+ * @name Valve curve status codes
+ * Returned by Valve_curve_init() and Valve_calibration_load()
+ * @{
+ */
+# define VALVE_CURVE_OK 0 ///< The curve is ready for Valve_thrust_to_PWM()
+# define VALVE_CURVE_INVALID -1 ///< The calibration points are not a valid curve (the reason is in #ERROR_MESSAGE)
+# define VALVE_CURVE_NO_FILE -2 ///< The calibration file could not be opened
+/** @} */
+
+/**
+ * @struct Valve_curve
+ * Calibrated thrust curve of a valve (thrust vs. PWM, both strictly increasing) and its inverse. The thrust axis is cut
+ * into uniform buckets no wider than the narrowest segment of the curve, so each bucket holds at most one calibration
+ * point and the segment of any thrust is found in constant time (see Valve_thrust_to_PWM()).
+ */
+struct Valve_curve {
+	unsigned int points; ///< Number of calibration points
+	double thrust[VALVE_CURVE_MAX_POINTS]; ///< [N] Thrust of each calibration point
+	double PWM[VALVE_CURVE_MAX_POINTS]; ///< PWM of each calibration point
+	double slope[VALVE_CURVE_MAX_POINTS]; ///< [1/N] PWM increase per thrust increase from each point to the next one (0 after the last one)
+	double bucket_scale; ///< [1/N] Number of buckets per unit of thrust
+	unsigned char bucket_segment[VALVE_INVERSE_TABLE_SIZE]; ///< Segment (index of its first point) of the start of each bucket
+};
+
+extern struct Valve_curve valve_curves[VALVE_COUNT]; ///< Thrust curves of the R1, R2, R3, R4 valves
+extern char VALVE__CALIBRATION_FILE[]; ///< Calibration file of the valve curves (see Valve_calibration_load())
+
+/** @cond INCLUDE_WITH_DOXYGEN */
+int Valve_curve_init(struct Valve_curve *curve, const unsigned int *PWM, const double *thrust, unsigned int points);
+int Valve_calibration_load(struct Valve_curve *curves, const char *path);
+unsigned int Valve_thrust_to_PWM(const struct Valve_curve *curve, double thrust);
+void Valve_thrusts_to_PWM(const struct Valve_curve *curves, const double *thrust, unsigned int *PWM);
+double Valve_curves_max_thrust(const struct Valve_curve *curves);
+unsigned int Valve_curve_self_test(const struct Valve_curve *curve);
+/** @endcond */
+
+#endif /* VALVE_HEADER_H_ */